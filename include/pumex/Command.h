@@ -86,7 +86,10 @@ public:
   CommandBuffer& operator=(CommandBuffer&&)      = delete;
   virtual ~CommandBuffer();
 
-  inline void     setActiveIndex(uint32_t index);
+  // each index may have few variants recorded separately ( e.g. primary command buffer of a frame in flight rendering to different swap chain images ).
+  // Changing variant count reallocates command buffers, so they must not be in use
+  void            setVariantCount(uint32_t variantCount);
+  inline void     setActiveIndex(uint32_t index, uint32_t variant = 0);
   inline uint32_t getActiveIndex() const;
 
   void            invalidate(uint32_t index);
@@ -125,6 +128,7 @@ public:
   void            cmdDispatch(uint32_t x, uint32_t y, uint32_t z) const;
 
   void            cmdCopyBufferToImage(VkBuffer srcBuffer, const Image& image, VkImageLayout dstImageLayout, const std::vector<VkBufferImageCopy>& regions) const;
+  void            cmdCopyImage(const Image& srcImage, VkImageLayout srcImageLayout, const Image& dstImage, VkImageLayout dstImageLayout, const std::vector<VkImageCopy>& regions) const;
   void            cmdClearColorImage(const Image& image, VkImageLayout imageLayout, VkClearValue color, std::vector<VkImageSubresourceRange> subresourceRanges);
   void            cmdClearDepthStencilImage(const Image& image, VkImageLayout imageLayout, VkClearValue depthStencil, std::vector<VkImageSubresourceRange> subresourceRanges);
 
@@ -145,11 +149,13 @@ protected:
   mutable std::mutex             mutex;
   std::set<CommandBufferSource*> sources;
   uint32_t                       activeIndex   = 0;
+  uint32_t                       activeCount   = 1;
+  uint32_t                       variantCount  = 1;
 };
 
-void     CommandBuffer::setActiveIndex(uint32_t index) { activeIndex = index % commandBuffer.size(); }
-uint32_t CommandBuffer::getActiveIndex() const         { return activeIndex; }
-bool     CommandBuffer::isValid()                      { return valid[activeIndex]!=0; }
+void     CommandBuffer::setActiveIndex(uint32_t index, uint32_t variant) { activeIndex = (index % activeCount) + activeCount * (variant % variantCount); }
+uint32_t CommandBuffer::getActiveIndex() const                           { return activeIndex; }
+bool     CommandBuffer::isValid()                                        { return valid[activeIndex]!=0; }
 
 // helper class defining pipeline barrier used later in CommandBuffer::cmdPipelineBarrier()
 struct PUMEX_EXPORT PipelineBarrier
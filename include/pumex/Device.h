@@ -25,6 +25,7 @@
 #include <memory>
 #include <tuple>
 #include <mutex>
+#include <unordered_map>
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 #include <pumex/Export.h>
@@ -38,6 +39,8 @@ class CommandPool;
 class DescriptorPool;
 class CommandBuffer;
 class StagingBuffer;
+class StagingRing;
+class DeviceMemoryAllocator;
 
 // struct that represents queues that must be provided by Vulkan implementation during initialization
 struct PUMEX_EXPORT QueueTraits
@@ -104,8 +107,23 @@ public:
 
   std::shared_ptr<DescriptorPool> getDescriptorPool();
 
-  std::shared_ptr<StagingBuffer>  acquireStagingBuffer( const void* data, VkDeviceSize size );
-  void                            releaseStagingBuffer(std::shared_ptr<StagingBuffer> buffer);
+  // staging buffers are ranges of a persistently mapped staging ring. Its memory budget may be set before first staging buffer is acquired
+  inline void                     setStagingBudget(VkDeviceSize budget);
+  inline VkDeviceSize             getStagingBudget() const;
+  // alignment : required alignment of a buffer offset ( e.g. texel block size when data is copied to an image )
+  std::shared_ptr<StagingBuffer>  acquireStagingBuffer( const void* data, VkDeviceSize size, VkDeviceSize alignment = 1 );
+  // frameNumber : memory is reused after that frame is retired. Use 0 when GPU finished using the buffer already ( e.g. after endSingleTimeCommands() )
+  void                            releaseStagingBuffer(std::shared_ptr<StagingBuffer> buffer, unsigned long long frameNumber = 0);
+
+  // allocators with non coherent memory register here after host writes. All pending ranges are flushed before queue submission
+  void                            addAllocatorToFlush(std::shared_ptr<DeviceMemoryAllocator> allocator);
+  void                            flushMappedMemory();
+
+  // allocators using RING strategy are informed about frames started and finished on a device. When device renders to many surfaces
+  // the frame is finished when all surfaces have finished it
+  void                            addFrameAllocator(std::shared_ptr<DeviceMemoryAllocator> allocator);
+  void                            beginFrame(unsigned long long frameNumber);
+  void                            retireFrame(VkSurfaceKHR surface, unsigned long long frameNumber);
 
   inline void                     setID(uint32_t newID);
   inline uint32_t                 getID() const;
@@ -151,19 +169,27 @@ protected:
   std::vector<QueueTraits>                    requestedQueues;
   std::vector<std::shared_ptr<Queue>>         queues;
   std::shared_ptr<DescriptorPool>             descriptorPool;
-  std::vector<std::shared_ptr<StagingBuffer>> stagingBuffers;
+  std::unique_ptr<StagingRing>                stagingRing;
+  VkDeviceSize                                stagingBudget = 64 * 1024 * 1024;
+  std::vector<std::weak_ptr<DeviceMemoryAllocator>> allocatorsToFlush;
+  std::vector<std::weak_ptr<DeviceMemoryAllocator>> frameAllocators;
+  std::unordered_map<VkSurfaceKHR, unsigned long long> retiredFrames;
 
   std::vector<const char*>                    requestedDeviceExtensions;
   std::vector<const char*>                    enabledDeviceExtensions;
 
   mutable std::mutex                          stagingMutex;
   mutable std::mutex                          submitMutex;
+  mutable std::mutex                          flushMutex;
+  mutable std::mutex                          frameMutex;
 };
 
-void     Device::resetRequestedQueues()                   { requestedQueues.clear(); }
-void     Device::addRequestedQueue(const QueueTraits& rq) { requestedQueues.push_back(rq); }
-bool     Device::isRealized() const                       { return device != VK_NULL_HANDLE; }
-void     Device::setID(uint32_t newID)                    { id = newID; }
-uint32_t Device::getID() const                            { return id; }
+void         Device::resetRequestedQueues()                   { requestedQueues.clear(); }
+void         Device::addRequestedQueue(const QueueTraits& rq) { requestedQueues.push_back(rq); }
+bool         Device::isRealized() const                       { return device != VK_NULL_HANDLE; }
+void         Device::setStagingBudget(VkDeviceSize budget)    { stagingBudget = budget; }
+VkDeviceSize Device::getStagingBudget() const                 { return stagingBudget; }
+void         Device::setID(uint32_t newID)                    { id = newID; }
+uint32_t     Device::getID() const                            { return id; }
 
 }
@@ -24,10 +24,16 @@
 #include <memory>
 #include <vector>
 #include <list>
+#include <map>
+#include <string>
+#include <iosfwd>
+#include <deque>
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
 #include <vulkan/vulkan.h>
 #include <pumex/Export.h>
+#include <pumex/HPClock.h>
 
 namespace pumex
 {
@@ -44,6 +50,8 @@ struct PUMEX_EXPORT DeviceMemoryBlock
   VkDeviceSize   alignedOffset;
   VkDeviceSize   realSize;
   VkDeviceSize   alignedSize;
+  uint32_t       blockIndex;    // index of device memory block in DeviceMemoryAllocator that stores the data
+  void*          mappedPointer; // host address of data at alignedOffset. Equal to nullptr when memory is not host visible
 };
 
 struct FreeBlock
@@ -53,24 +61,57 @@ struct FreeBlock
   VkDeviceSize size;
 };
 
+// memory usage of DeviceMemoryAllocator on a single device
+struct PUMEX_EXPORT DeviceMemoryStatistics
+{
+  VkDeviceSize allocatedSize    = 0;   // memory allocated from Vulkan by all memory blocks
+  VkDeviceSize usedSize         = 0;   // memory used by existing allocations, including alignment padding
+  VkDeviceSize freeSize         = 0;   // memory available for new allocations ( RING strategy keeps deallocated memory until frame retires )
+  VkDeviceSize largestFreeBlock = 0;
+  double       fragmentation    = 0.0; // 1 - largestFreeBlock / freeSize
+  uint32_t     allocationCount  = 0;
+  uint32_t     blockCount       = 0;
+  VkDeviceSize peakUsedSize     = 0;
+};
+
+// AllocationStrategy manages free space inside one VkDeviceMemory object. Each device memory owned by DeviceMemoryAllocator
+// gets its own instance of the strategy, so strategy may keep all bookkeeping data inside.
+// When there is no space for requested data allocate() returns empty DeviceMemoryBlock ( alignedSize == 0 ).
+// beginFrame() / retireFrame() inform strategy about frames rendered on a device. Only strategies that free memory per frame use them.
 class PUMEX_EXPORT AllocationStrategy
 {
 public:
   virtual ~AllocationStrategy();
-  virtual DeviceMemoryBlock allocate(VkDeviceMemory storageMemory, std::list<FreeBlock>& freeBlocks, VkMemoryRequirements memoryRequirements) = 0;
-  virtual void deallocate(std::list<FreeBlock>& freeBlocks, const DeviceMemoryBlock& block) = 0;
+  virtual DeviceMemoryBlock allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements) = 0;
+  virtual void              deallocate(const DeviceMemoryBlock& block) = 0;
+  // adds all free areas of the memory to freeBlocks
+  virtual void              getFreeBlocks(std::vector<FreeBlock>& freeBlocks) const = 0;
+  virtual void              beginFrame(unsigned long long frameNumber);
+  virtual void              retireFrame(unsigned long long frameNumber);
+  // informs about frame in flight that performs next allocations
+  virtual void              setFrameSlot(uint32_t frameSlot, uint32_t frameSlotCount);
 };
 
-// DeviceMemoryAllocator is a class that enables user to store different data ( Vulkan buffers and images ) in a single block of
+// DeviceMemoryAllocator is a class that enables user to store different data ( Vulkan buffers and images ) in blocks of
 // GPU/host memory allocated by vkAllocateMemory(). User may define what type of memory he wants from the Vulkan ( VkMemoryPropertyFlags ),
 // how much of that memory should be allocated and what allocation strategy to use when allocating/deallocating memory.
-// For now only one strategy is implemented : first fit allocation.
-class PUMEX_EXPORT DeviceMemoryAllocator
+// By default allocator uses one block of memory of the size provided in constructor. When maxSize is greater than size, allocator
+// adds new blocks of memory when existing blocks are full ( until the sum of all blocks reaches maxSize ). Data bigger than size gets
+// its own block. Empty blocks ( except the first one ) are released after emptyBlockGracePeriod seconds.
+// Host visible memory is mapped once, when memory block is created. DeviceMemoryBlock::mappedPointer may be used to write data directly.
+// When memory is not host coherent - written ranges are collected and flushed with a single vkFlushMappedMemoryRanges() call ( see Device::flushMappedMemory() ).
+// Three strategies are implemented :
+// - FIRST_FIT - first fit allocation on a sorted list of free blocks. Cheap in memory, but allocation time grows with the number of free blocks
+// - TLSF      - two level segregated fit allocation. Allocation and deallocation work in constant time
+// - RING      - linear allocation for data that is rewritten in every frame. Memory is divided into regions - one for each frame in flight.
+//               Memory of a region is reused when the device finishes the frame that used it ( see Device::retireFrame() ). Used by MemoryBuffer
+//               with swForEachImage behaviour
+class PUMEX_EXPORT DeviceMemoryAllocator : public std::enable_shared_from_this<DeviceMemoryAllocator>
 {
 public:
-  enum EnumStrategy { FIRST_FIT };
+  enum EnumStrategy { FIRST_FIT, TLSF, RING };
   DeviceMemoryAllocator()                                        = delete;
-  explicit DeviceMemoryAllocator(VkMemoryPropertyFlags propertyFlags, VkDeviceSize size, EnumStrategy strategy);
+  explicit DeviceMemoryAllocator(VkMemoryPropertyFlags propertyFlags, VkDeviceSize size, EnumStrategy strategy, VkDeviceSize maxSize = 0, double emptyBlockGracePeriod = 5.0);
   DeviceMemoryAllocator(const DeviceMemoryAllocator&)            = delete;
   DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator&) = delete;
   DeviceMemoryAllocator(DeviceMemoryAllocator&&)                 = delete;
@@ -78,43 +119,217 @@ public:
   ~DeviceMemoryAllocator();
 
 
-  DeviceMemoryBlock            allocate(Device* device, VkMemoryRequirements memoryRequirements);
+  // name is optional and is only used to describe allocation in statistics ( see dumpJSON() ).
+  // frameSlot and frameSlotCount describe the frame in flight that allocates the data ( see RenderContext::activeIndex ). Only RING strategy uses them
+  DeviceMemoryBlock            allocate(Device* device, VkMemoryRequirements memoryRequirements, const std::string& name = std::string(), uint32_t frameSlot = 0, uint32_t frameSlotCount = 1);
   void                         deallocate(VkDevice device, const DeviceMemoryBlock& block);
+  // releases empty memory blocks ( except the first one ). When ignoreGracePeriod == false only blocks that are empty for emptyBlockGracePeriod are released
+  void                         releaseEmptyBlocks(VkDevice device, bool ignoreGracePeriod = false);
+
+  // memory allocated after beginFrame() belongs to frame frameNumber. retireFrame() informs that all frames up to frameNumber are finished by the device
+  void                         beginFrame(VkDevice device, unsigned long long frameNumber);
+  void                         retireFrame(VkDevice device, unsigned long long frameNumber);
+
+  // defragment() starts moving allocations to memory blocks with lower index and to lower offsets, so that free memory forms large areas.
+  // MemoryBuffer and MemoryImage objects ask for a new place for their data during validation ( see relocate() ) and copy the data themselves.
+  // No more than maxBytesPerFrame bytes are moved during one frame. Defragmentation stops when no allocation was moved during a whole frame
+  void                         defragment(VkDeviceSize maxBytesPerFrame);
+  inline bool                  isDefragmenting() const;
+  // returns new place for the data stored in block or empty block when data should stay where it is.
+  // Caller copies the data to the new place and deallocates the old block when it is no longer used
+  DeviceMemoryBlock            relocate(Device* device, unsigned long long frameNumber, const DeviceMemoryBlock& block, VkMemoryRequirements memoryRequirements);
 
-  // method that makes vkMapMemory() / std::memcpy() / vkUnmapMemory() behind a mutex - use it instead of performing is yourself
-  void                         copyToDeviceMemory(Device* device, VkDeviceSize offset, const void* data, VkDeviceSize size, VkMemoryMapFlags flags);
-  void                         bindBufferMemory(Device* device, VkBuffer buffer, VkDeviceSize offset);
+  // copies data to persistently mapped memory and registers written range for flushing. Offset is relative to block.alignedOffset.
+  // Method does not lock allocator mutex, so writes to different blocks may be performed in parallel
+  void                         copyToDeviceMemory(Device* device, const DeviceMemoryBlock& block, VkDeviceSize offset, const void* data, VkDeviceSize size, VkMemoryMapFlags flags);
+  void                         bindBufferMemory(Device* device, VkBuffer buffer, const DeviceMemoryBlock& block);
+  // returns buffer covering the whole memory block that stores the data ( data starts at block.alignedOffset of that buffer ). Buffer is created
+  // on first use and destroyed together with the memory block. MemoryBuffer uses it for data allocated from RING allocator, so that VkBuffer
+  // does not change when the data moves to a new part of the ring
+  VkBuffer                     getMemoryBlockBuffer(Device* device, const DeviceMemoryBlock& block, VkBufferUsageFlags usage);
+
+  // returns host address of the block data ( nullptr if memory is not host visible ). Does not lock anything
+  inline void*                 getMappedPointer(const DeviceMemoryBlock& block) const;
+  // user that writes data through getMappedPointer() must inform allocator about written range. Does nothing when memory is host coherent
+  void                         addRangeToFlush(VkDevice device, const DeviceMemoryBlock& block, VkDeviceSize offset, VkDeviceSize size);
+  // flushes all registered ranges in a single vkFlushMappedMemoryRanges() call
+  void                         flushMappedMemory(VkDevice device);
+  inline bool                  isHostVisible() const;
+  inline bool                  isHostCoherent() const;
 
   inline VkMemoryPropertyFlags getMemoryPropertyFlags() const;
   inline VkDeviceSize          getMemorySize() const;
+  inline VkDeviceSize          getMaxMemorySize() const;
+  inline EnumStrategy          getStrategy() const;
+  uint32_t                     getBlockCount(VkDevice device) const;
+  VkDeviceSize                 getAllocatedSize(VkDevice device) const;
+
+  DeviceMemoryStatistics       getStatistics(VkDevice device) const;
+  // writes statistics and the map of all allocations and free areas for each device
+  void                         dumpJSON(std::ostream& stream) const;
 
 protected:
+  struct AllocationInfo
+  {
+    VkDeviceSize size;
+    std::string  name;
+  };
+  struct RetiringAllocation
+  {
+    unsigned long long frameNumber; // allocation was released during this frame
+    VkDeviceSize       alignedSize;
+  };
+  struct MemoryBlock
+  {
+    VkDeviceMemory                      storageMemory   = VK_NULL_HANDLE;
+    VkDeviceSize                        size            = 0;
+    uint32_t                            allocationCount = 0;
+    uint8_t*                            mappedMemory    = nullptr;
+    HPClock::time_point                 emptySince;
+    std::unique_ptr<AllocationStrategy> allocationStrategy;
+    std::map<VkDeviceSize, AllocationInfo> allocations; // allocations sorted by alignedOffset
+    std::unordered_map<VkBufferUsageFlags, VkBuffer> blockBuffers; // buffers covering whole memory block, see getMemoryBlockBuffer()
+    std::deque<RetiringAllocation>      retiringAllocations; // RING allocations released by user, but still used by frames in flight
+  };
   struct PerDeviceData
   {
     PerDeviceData()
     {
     }
-    VkDeviceMemory       storageMemory = VK_NULL_HANDLE;
-    std::list<FreeBlock> freeBlocks;
+    // released blocks leave a hole in a vector, so that DeviceMemoryBlock::blockIndex stays valid
+    std::vector<MemoryBlock> memoryBlocks;
+    VkDeviceSize             allocatedSize       = 0;
+    VkDeviceSize             nonCoherentAtomSize = 1;
+    unsigned long long       currentFrame        = 0;
+    VkDeviceSize             usedSize            = 0;
+    VkDeviceSize             peakUsedSize        = 0;
   };
+  uint32_t                                    createMemoryBlock(Device* device, PerDeviceData& pdd, VkDeviceSize blockSize, uint32_t memoryTypeBits);
+  void                                        releaseEmptyBlocks(VkDevice device, PerDeviceData& pdd, bool ignoreGracePeriod);
+  void                                        registerAllocation(PerDeviceData& pdd, DeviceMemoryBlock& block, uint32_t blockIndex, const std::string& name);
+  DeviceMemoryStatistics                      getStatistics(const PerDeviceData& pdd) const;
+
   mutable std::mutex                          mutex;
   std::unordered_map<VkDevice, PerDeviceData> perDeviceData;
+  // ranges waiting for vkFlushMappedMemoryRanges() are guarded by separate mutex, so that writes do not wait for allocations
+  mutable std::mutex                          flushMutex;
+  std::unordered_map<VkDevice, std::vector<VkMappedMemoryRange>> pendingFlushes;
   VkMemoryPropertyFlags                       propertyFlags;
   VkDeviceSize                                size;
-  std::unique_ptr<AllocationStrategy>         allocationStrategy;
+  VkDeviceSize                                maxSize;
+  double                                      emptyBlockGracePeriod;
+  EnumStrategy                                strategy;
+  std::atomic<bool>                           defragmenting;
+  VkDeviceSize                                defragmentationBudget  = 0;
+  VkDeviceSize                                defragmentationMoved   = 0;
+  unsigned long long                          defragmentationFrame   = 0;
 };
 
-VkMemoryPropertyFlags DeviceMemoryAllocator::getMemoryPropertyFlags() const { return propertyFlags; }
-VkDeviceSize          DeviceMemoryAllocator::getMemorySize() const { return size; }
+VkMemoryPropertyFlags                 DeviceMemoryAllocator::getMemoryPropertyFlags() const { return propertyFlags; }
+VkDeviceSize                          DeviceMemoryAllocator::getMemorySize() const          { return size; }
+VkDeviceSize                          DeviceMemoryAllocator::getMaxMemorySize() const       { return maxSize; }
+DeviceMemoryAllocator::EnumStrategy   DeviceMemoryAllocator::getStrategy() const            { return strategy; }
+bool                                  DeviceMemoryAllocator::isDefragmenting() const        { return defragmenting.load(); }
+void*                                 DeviceMemoryAllocator::getMappedPointer(const DeviceMemoryBlock& block) const { return block.mappedPointer; }
+bool                                  DeviceMemoryAllocator::isHostVisible() const          { return (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0; }
+bool                                  DeviceMemoryAllocator::isHostCoherent() const         { return (propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0; }
+
+PUMEX_EXPORT std::unique_ptr<AllocationStrategy> createAllocationStrategy(DeviceMemoryAllocator::EnumStrategy strategy, VkDeviceSize size);
 
 class PUMEX_EXPORT FirstFitAllocationStrategy : public AllocationStrategy
 {
 public:
-  FirstFitAllocationStrategy();
+  explicit FirstFitAllocationStrategy(VkDeviceSize size);
   virtual ~FirstFitAllocationStrategy();
 
-  DeviceMemoryBlock allocate(VkDeviceMemory storageMemory, std::list<FreeBlock>& freeBlocks, VkMemoryRequirements memoryRequirements) override;
-  void              deallocate(std::list<FreeBlock>& freeBlocks, const DeviceMemoryBlock& block) override;
+  DeviceMemoryBlock allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements) override;
+  void              deallocate(const DeviceMemoryBlock& block) override;
+  void              getFreeBlocks(std::vector<FreeBlock>& result) const override;
+protected:
+  std::list<FreeBlock> freeBlocks;
+};
+
+// Ring allocator : memory is divided into equal regions, one for each frame slot ( frame in flight ). Frame places its data linearly in the region
+// of its slot, starting from the beginning of the region. Data allocated in the same order gets the same offsets every time the slot is used,
+// so descriptors and command buffers referring to it do not have to be rebuilt. deallocate() does nothing - region is reused when the frame
+// that used it before is finished by the device. When region is still used by a frame in flight allocate() fails, so that DeviceMemoryAllocator
+// places the data in other memory block.
+class PUMEX_EXPORT RingAllocationStrategy : public AllocationStrategy
+{
+public:
+  explicit RingAllocationStrategy(VkDeviceSize size);
+  virtual ~RingAllocationStrategy();
+
+  DeviceMemoryBlock allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements) override;
+  void              deallocate(const DeviceMemoryBlock& block) override;
+  void              getFreeBlocks(std::vector<FreeBlock>& freeBlocks) const override;
+  void              beginFrame(unsigned long long frameNumber) override;
+  void              retireFrame(unsigned long long frameNumber) override;
+  void              setFrameSlot(uint32_t frameSlot, uint32_t frameSlotCount) override;
+protected:
+  struct FrameRegion
+  {
+    unsigned long long frameNumber = 0;     // last frame that placed data in the region
+    VkDeviceSize       head        = 0;     // end of the last allocation
+    bool               used        = false;
+  };
+  inline bool              isRetired(const FrameRegion& region) const;
+
+  VkDeviceSize             size;
+  VkDeviceSize             regionSize;
+  unsigned long long       currentFrame   = 0;
+  unsigned long long       retiredFrames  = 0; // frames lower than retiredFrames are finished by the device
+  uint32_t                 frameSlot      = 0;
+  uint32_t                 frameSlotCount = 1;
+  std::vector<FrameRegion> frameRegions;
+};
+
+// Two level segregated fit allocator ( M. Masmano, I. Ripoll, A. Crespo, J. Real : "TLSF: a New Dynamic Memory Allocator for Real-Time Systems" ).
+// Free blocks are stored in lists segregated by size. First level divides sizes by powers of two, second level divides each power of two
+// into SL_INDEX_COUNT linear ranges. Bitmaps mark nonempty lists, so a free block is found with two bit scans.
+// Physically adjacent free blocks are merged on deallocation.
+class PUMEX_EXPORT TLSFAllocationStrategy : public AllocationStrategy
+{
+public:
+  explicit TLSFAllocationStrategy(VkDeviceSize size);
+  TLSFAllocationStrategy(const TLSFAllocationStrategy&)            = delete;
+  TLSFAllocationStrategy& operator=(const TLSFAllocationStrategy&) = delete;
+  virtual ~TLSFAllocationStrategy();
+
+  DeviceMemoryBlock allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements) override;
+  void              deallocate(const DeviceMemoryBlock& block) override;
+  void              getFreeBlocks(std::vector<FreeBlock>& freeBlocks) const override;
+
+  static const uint32_t SL_INDEX_COUNT_LOG2 = 5;
+  static const uint32_t SL_INDEX_COUNT      = 1 << SL_INDEX_COUNT_LOG2;
+  static const uint32_t FL_INDEX_SHIFT      = SL_INDEX_COUNT_LOG2 + 3;
+  static const uint32_t FL_INDEX_COUNT      = 64 - FL_INDEX_SHIFT + 1;
+  static const uint32_t SMALL_BLOCK_SIZE    = 1 << FL_INDEX_SHIFT;
+protected:
+  struct Block
+  {
+    VkDeviceSize offset       = 0;
+    VkDeviceSize size         = 0;
+    bool         free         = false;
+    Block*       prevPhysical = nullptr;
+    Block*       nextPhysical = nullptr;
+    Block*       prevFree     = nullptr;
+    Block*       nextFree     = nullptr;
+  };
+
+  void   mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl) const;
+  Block* findFreeBlock(VkDeviceSize size);
+  void   insertFreeBlock(Block* block);
+  void   removeFreeBlock(Block* block);
+  Block* acquireBlock();
+  void   releaseBlock(Block* block);
+
+  uint64_t                                 flBitmap = 0;
+  uint32_t                                 slBitmap[FL_INDEX_COUNT];
+  Block*                                   freeLists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+  std::list<Block>                         blockStorage;
+  std::vector<Block*>                      unusedBlocks;
+  std::unordered_map<VkDeviceSize, Block*> usedBlocks;
 };
 
 // OK, last time I read a book about C++ templates about seven years ago, so this code may look ugly in 2017
@@ -122,5 +337,9 @@ template<typename T> size_t uglyGetSize(const T& t) { return sizeof(T); }
 template<typename T> size_t uglyGetSize(const std::vector<T>& t) { return t.size() * sizeof(T); }
 template<typename T> T*     uglyGetPointer(T& t) { return std::addressof(t); }
 template<typename T> T*     uglyGetPointer(std::vector<T>& t) { return t.data(); }
+template<typename T> size_t uglyGetElementSize(const T& t) { return sizeof(T); }
+template<typename T> size_t uglyGetElementSize(const std::vector<T>& t) { return sizeof(T); }
+template<typename T> struct UglyElementType                 { typedef T type; };
+template<typename T> struct UglyElementType<std::vector<T>> { typedef T type; };
 
 }
@@ -58,7 +58,11 @@ class PUMEX_EXPORT Image
 public:
   Image()                            = delete;
   // user creates VkImage and assigns memory to it
-  explicit Image(Device* device, const ImageTraits& imageTraits, std::shared_ptr<DeviceMemoryAllocator> allocator);
+  explicit Image(Device* device, const ImageTraits& imageTraits, std::shared_ptr<DeviceMemoryAllocator> allocator, const std::string& name = std::string());
+  // user creates VkImage and binds it to memory already allocated from allocator ( used when image is relocated during defragmentation )
+  explicit Image(Device* device, const ImageTraits& imageTraits, std::shared_ptr<DeviceMemoryAllocator> allocator, const DeviceMemoryBlock& memoryBlock);
+  // user creates VkImage and binds it to memory shared with other images ( memory aliasing ). Memory is released when last image using it is destroyed
+  explicit Image(Device* device, const ImageTraits& imageTraits, std::shared_ptr<DeviceMemoryBlock> sharedMemoryBlock);
   // user delivers VkImage, Image does not own it, just creates VkImageView
   explicit Image(Device* device, VkImage image, VkFormat format, const VkExtent3D& extent, uint32_t mipLevels = 1, uint32_t arrayLayers = 1);
   Image(const Image&)                = delete;
@@ -67,37 +71,48 @@ public:
   Image& operator=(Image&&)          = delete;
   virtual ~Image();
 
-  inline VkDevice           getDevice() const;
-  inline VkImage            getHandleImage() const;
-  inline VkDeviceSize       getMemorySize() const;
-  inline const ImageTraits& getImageTraits() const;
+  inline VkDevice                 getDevice() const;
+  inline VkImage                  getHandleImage() const;
+  inline VkDeviceSize             getMemorySize() const;
+  inline const ImageTraits&       getImageTraits() const;
+  inline const DeviceMemoryBlock& getMemoryBlock() const;
 
-  void                      getImageSubresourceLayout(VkImageSubresource& subRes, VkSubresourceLayout& subResLayout) const;
-  void*                     mapMemory(size_t offset, size_t range, VkMemoryMapFlags flags=0);
-  void                      unmapMemory();
+  void                            getImageSubresourceLayout(VkImageSubresource& subRes, VkSubresourceLayout& subResLayout) const;
+  void*                           mapMemory(size_t offset, size_t range, VkMemoryMapFlags flags=0);
+  void                            unmapMemory();
 protected:
+  void                                   createImage();
+
   ImageTraits                            imageTraits;
   VkDevice                               device       = VK_NULL_HANDLE;
   std::shared_ptr<DeviceMemoryAllocator> allocator;
   VkImage                                image        = VK_NULL_HANDLE;
   DeviceMemoryBlock                      memoryBlock;
+  std::shared_ptr<DeviceMemoryBlock>     sharedMemoryBlock;
   bool                                   ownsImage    = true;
+  VkDeviceSize                           mappedOffset = 0;
+  VkDeviceSize                           mappedRange  = 0;
 };
 
 // inlines
-VkDevice             Image::getDevice() const      { return device; }
-VkImage              Image::getHandleImage() const { return image; }
-VkDeviceSize         Image::getMemorySize() const  { return memoryBlock.alignedSize; }
-const ImageTraits&   Image::getImageTraits() const { return imageTraits; }
+VkDevice                 Image::getDevice() const      { return device; }
+VkImage                  Image::getHandleImage() const { return image; }
+VkDeviceSize             Image::getMemorySize() const  { return memoryBlock.alignedSize; }
+const ImageTraits&       Image::getImageTraits() const { return imageTraits; }
+const DeviceMemoryBlock& Image::getMemoryBlock() const { return memoryBlock; }
 
 // helper functions
 PUMEX_EXPORT ImageTraits        getImageTraitsFromTexture(const gli::texture& texture, VkImageUsageFlags usage);
+// creates temporary VkImage to find out memory requirements of an image with specific traits
+PUMEX_EXPORT VkMemoryRequirements getImageMemoryRequirements(VkDevice device, const ImageTraits& imageTraits);
 
 PUMEX_EXPORT VkFormat           vulkanFormatFromGliFormat(gli::texture::format_type format);
 PUMEX_EXPORT VkImageViewType    vulkanViewTypeFromGliTarget(gli::texture::target_type target);
 PUMEX_EXPORT VkImageType        vulkanImageTypeFromTextureExtents(const gli::extent3d& extents);
 PUMEX_EXPORT VkComponentSwizzle vulkanSwizzlesFromGliSwizzles(const gli::swizzle& s);
 PUMEX_EXPORT VkComponentMapping vulkanComponentMappingFromGliComponentMapping(const gli::swizzles& swz);
+// size of a texel in bytes. Returns 0 for compressed and unknown formats
+PUMEX_EXPORT uint32_t           getFormatTexelSize(VkFormat format);
 
 // Texture files are loaded through TextureLoader. Currently only gli library is used to load them
 // This is temporary solution.
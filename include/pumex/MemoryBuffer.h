@@ -34,6 +34,7 @@
 #include <pumex/DeviceMemoryAllocator.h>
 #include <pumex/Surface.h>
 #include <pumex/Command.h>
+#include <pumex/UploadBatch.h>
 #include <pumex/utils/Buffer.h>
 #include <pumex/utils/Log.h>
 
@@ -54,6 +55,9 @@ struct PUMEX_EXPORT BufferSubresourceRange
   BufferSubresourceRange(VkDeviceSize offset, VkDeviceSize range);
 
   bool contains(const BufferSubresourceRange& subRange) const;
+  // true when ranges overlap or touch each other, so they may be merged into one range
+  bool touches(const BufferSubresourceRange& subRange) const;
+  BufferSubresourceRange merge(const BufferSubresourceRange& subRange) const;
 
   VkDeviceSize offset;
   VkDeviceSize range;
@@ -79,10 +83,18 @@ public:
   inline VkBufferUsageFlags                     getBufferUsage() const;
 
   VkBuffer                                      getHandleBuffer(const RenderContext& renderContext) const;
+  // offset of the data in a buffer returned by getHandleBuffer(). Always 0, except for buffers using RING allocator
+  VkDeviceSize                                  getBufferOffset(const RenderContext& renderContext) const;
   size_t                                        getDataSizeRC(const RenderContext& renderContext) const;
 
   void                                          validate(const RenderContext& renderContext);
 
+  // zero-copy access to memory of the buffer used by current frame. See Buffer<T>::map() for details
+  void*                                         mapBufferMemory(const RenderContext& renderContext, size_t size);
+  void*                                         mapBufferMemory(Surface* surface, size_t size);
+  void                                          unmapBufferMemory(const RenderContext& renderContext);
+  void                                          unmapBufferMemory(Surface* surface);
+
   void                                          addCommandBufferSource(std::shared_ptr<CommandBufferSource> cbSource);
   void                                          notifyCommandBufferSources(const RenderContext& renderContext);
 
@@ -96,12 +108,16 @@ public:
   struct MemoryBufferInternal
   {
     MemoryBufferInternal()
-      : buffer{ VK_NULL_HANDLE }, dataSize{ 0 }, memoryBlock()
+      : buffer{ VK_NULL_HANDLE }, bufferOffset{ 0 }, dataSize{ 0 }, memoryBlock(), frameNumber{ 0 }, mappedSize{ 0 }
     {
     }
-    VkBuffer           buffer;
-    size_t             dataSize;
-    DeviceMemoryBlock  memoryBlock;
+    VkBuffer                       buffer;
+    VkDeviceSize                   bufferOffset;  // offset of the data in the buffer
+    size_t                         dataSize;
+    DeviceMemoryBlock              memoryBlock;
+    unsigned long long             frameNumber;   // frame in which the memory was allocated
+    size_t                         mappedSize;    // size of the memory mapped by mapBufferMemory()
+    std::shared_ptr<StagingBuffer> mappedStaging; // staging memory handed to the user, when buffer memory is not host visible
   };
   struct Operation
   {
@@ -140,14 +156,48 @@ public:
   virtual void*  getDataPointer() = 0;
   virtual size_t getDataSize() = 0;
   virtual void   sendDataToBuffer(uint32_t key, VkDevice device, VkSurfaceKHR surface) = 0;
+
+  // places the data in the ring region of current frame slot, when buffer uses RING allocator. All buffers share VkBuffer objects covering whole memory
+  // blocks of the allocator ( see DeviceMemoryAllocator::getMemoryBlockBuffer() ), so only the offset of the data may change.
+  // Must be called with the mutex locked ( during validate() )
+  void           allocateRingMemory(const RenderContext& renderContext, MemoryBufferInternal& internals, VkDeviceSize size);
+  // sends whole content of the buffer through transfer queue to a new buffer that replaces current one when frame acquires it ( see UploadBatch::getStreamLatency() ).
+  // Until then current buffer is used and following operations wait. Must be called with the mutex locked ( during validate() )
+  void           streamData(const RenderContext& renderContext, std::shared_ptr<StagingBuffer> stagingBuffer, VkDeviceSize size);
 protected:
   struct MemoryBufferLoadData
   {
     std::list<std::shared_ptr<Operation>> bufferOperations;
+    VkMemoryRequirements                  ringMemoryRequirements{}; // used by buffers with RING allocator, memoryTypeBits == 0 when not known yet
   };
   typedef PerObjectData<MemoryBufferInternal, MemoryBufferLoadData> MemoryBufferData;
 
+  // buffer left after relocation may still be used by frames in flight
+  struct RelocatedBuffer
+  {
+    VkDevice             device;
+    unsigned long long   frameNumber;
+    MemoryBufferInternal internals;
+  };
+
+  // buffer written by transfer queue, that replaces current buffer in frame readyFrame
+  struct StreamedBuffer
+  {
+    VkDevice             device;
+    uint32_t             key;
+    uint32_t             activeIndex;
+    unsigned long long   readyFrame;
+    MemoryBufferInternal internals;
+  };
+
+  void                                            relocateBuffer(const RenderContext& renderContext, MemoryBufferInternal& internals);
+  void                                            releaseRelocatedBuffers(const RenderContext& renderContext);
+  // returns true when buffer still waits for streamed data
+  bool                                            replaceStreamedBuffer(const RenderContext& renderContext, uint32_t key, uint32_t activeIndex);
+
   std::unordered_map<uint32_t, MemoryBufferData>  perObjectData;
+  std::list<RelocatedBuffer>                      relocatedBuffers;
+  std::list<StreamedBuffer>                       streamedBuffers;
   mutable std::mutex                              mutex;
   PerObjectBehaviour                              perObjectBehaviour;
   SwapChainImageBehaviour                         swapChainImageBehaviour;
@@ -161,6 +211,24 @@ protected:
   std::vector<std::weak_ptr<BufferView>>          bufferViews;
 };
 
+// typed view of the buffer memory returned by Buffer<T>::map()
+template <typename E>
+struct BufferSpan
+{
+  BufferSpan(E* d, size_t c)
+    : data{ d }, count{ c }
+  {
+  }
+  E*     begin() const                { return data; }
+  E*     end() const                  { return data + count; }
+  size_t size() const                 { return count; }
+  bool   empty() const                { return count == 0; }
+  E&     operator[](size_t idx) const { return data[idx]; }
+
+  E*     data;
+  size_t count;
+};
+
 // class that is an interface to MemoryBuffer. May store any structured data in a buffer
 template <typename T>
 class Buffer : public MemoryBuffer
@@ -179,6 +247,11 @@ public:
   void               setBufferSize(Device* device, size_t bufferSize);
 
   void               invalidateData();
+  // invalidate only part of the data ( offset and size in bytes ). Only that part is sent to GPU
+  void               invalidateRange(VkDeviceSize offset, VkDeviceSize size);
+  // invalidate only chosen elements of the data ( useful when T is a std::vector )
+  void               invalidateElement(size_t index);
+  void               invalidateElements(size_t firstIndex, size_t count);
   void               setData(const T& data);
   void               setData(Surface* surface, std::shared_ptr<T> data);
   void               setData(Device* device, std::shared_ptr<T> data);
@@ -186,6 +259,14 @@ public:
   void               setData(Device* device, const T& data);
   std::shared_ptr<T> getData();
 
+  // Zero-copy alternative to setData(Surface*,...) and setData(Device*,...) : returns memory that will become the content of the buffer used by current frame.
+  // It is persistently mapped buffer memory when allocator is host visible, or a staging memory otherwise. Each swapchain image has its own buffer,
+  // so the whole content must be written in every frame. Data is sent to GPU when unmap() is called - it must be done in the same frame
+  BufferSpan<typename UglyElementType<T>::type> map(const RenderContext& renderContext, size_t elementCount = 1);
+  BufferSpan<typename UglyElementType<T>::type> map(Surface* surface, size_t elementCount = 1);
+  void               unmap(const RenderContext& renderContext);
+  void               unmap(Surface* surface);
+
   void*              getDataPointer() override;
   size_t             getDataSize() override;
   void               sendDataToBuffer(uint32_t key, VkDevice device, VkSurfaceKHR surface) override;
@@ -249,11 +330,9 @@ struct SetDataOperation : public MemoryBuffer::Operation
 {
   SetDataOperation(MemoryBuffer* o, const BufferSubresourceRange& r, const BufferSubresourceRange& sr, std::shared_ptr<T> data, uint32_t ac);
   bool perform(const RenderContext& renderContext, MemoryBuffer::MemoryBufferInternal& internals, std::shared_ptr<CommandBuffer> commandBuffer) override;
-  void releaseResources(const RenderContext& renderContext) override;
 
-  std::shared_ptr<T>                          data;
-  BufferSubresourceRange                      sourceRange;
-  std::vector<std::shared_ptr<StagingBuffer>> stagingBuffers;
+  std::shared_ptr<T>     data;
+  BufferSubresourceRange sourceRange;
 };
 
 const PerObjectBehaviour&              MemoryBuffer::getPerObjectBehaviour() const      { return perObjectBehaviour; }
@@ -312,6 +391,53 @@ void Buffer<T>::invalidateData()
   invalidateResources();
 }
 
+template <typename T>
+void Buffer<T>::invalidateRange(VkDeviceSize offset, VkDeviceSize size)
+{
+  CHECK_LOG_THROW(!sameDataPerObject, "Cannot invalidate data - wrong constructor used to create an object");
+  CHECK_LOG_THROW((bufferUsage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) == 0, "Cannot set data for this buffer - user declared it as not writeable");
+  if (size == 0)
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  CHECK_LOG_THROW(offset + size > getDataSize(), "Cannot invalidate data - range ( " << offset << ", " << size << " ) exceeds data size " << getDataSize());
+  for (auto& pdd : perObjectData)
+  {
+    // merge all touching setData calls into one range. Merged range is sent again to all swapchain images, because some of them may have already received older part of the data
+    BufferSubresourceRange range(offset, size);
+    bool merged;
+    do
+    {
+      merged = false;
+      pdd.second.commonData.bufferOperations.remove_if([&range, &merged](std::shared_ptr<Operation> bufop)
+      {
+        if (bufop->type != MemoryBuffer::Operation::SetData || !range.touches(bufop->bufferRange))
+          return false;
+        range  = range.merge(bufop->bufferRange);
+        merged = true;
+        return true;
+      });
+    } while (merged);
+    // add setData operation with merged range
+    pdd.second.commonData.bufferOperations.push_back(std::make_shared<SetDataOperation<T>>(this, range, range, data, activeCount));
+    pdd.second.invalidate();
+  }
+  invalidateResources();
+}
+
+template <typename T>
+void Buffer<T>::invalidateElement(size_t index)
+{
+  invalidateElements(index, 1);
+}
+
+template <typename T>
+void Buffer<T>::invalidateElements(size_t firstIndex, size_t count)
+{
+  CHECK_LOG_THROW(!sameDataPerObject, "Cannot invalidate data - wrong constructor used to create an object");
+  VkDeviceSize elementSize = uglyGetElementSize(*data);
+  invalidateRange(firstIndex * elementSize, count * elementSize);
+}
+
 template <typename T>
 void Buffer<T>::setData(const T& dt)
 {
@@ -359,6 +485,32 @@ std::shared_ptr<T> Buffer<T>::getData()
   return data;
 }
 
+template <typename T>
+BufferSpan<typename UglyElementType<T>::type> Buffer<T>::map(const RenderContext& renderContext, size_t elementCount)
+{
+  typedef typename UglyElementType<T>::type E;
+  return BufferSpan<E>(static_cast<E*>(mapBufferMemory(renderContext, elementCount * sizeof(E))), elementCount);
+}
+
+template <typename T>
+BufferSpan<typename UglyElementType<T>::type> Buffer<T>::map(Surface* surface, size_t elementCount)
+{
+  typedef typename UglyElementType<T>::type E;
+  return BufferSpan<E>(static_cast<E*>(mapBufferMemory(surface, elementCount * sizeof(E))), elementCount);
+}
+
+template <typename T>
+void Buffer<T>::unmap(const RenderContext& renderContext)
+{
+  unmapBufferMemory(renderContext);
+}
+
+template <typename T>
+void Buffer<T>::unmap(Surface* surface)
+{
+  unmapBufferMemory(surface);
+}
+
 template <typename T>
 void*  Buffer<T>::getDataPointer()
 {
@@ -422,8 +574,14 @@ bool SetBufferSizeOperation<T>::perform(const RenderContext& renderContext, Memo
 {
   // release old buffer if exists
   auto ownerAllocator = owner->getAllocator();
+  if (ownerAllocator->getStrategy() == DeviceMemoryAllocator::RING)
+  {
+    owner->allocateRingMemory(renderContext, internals, std::max<VkDeviceSize>(1, bufferRange.range));
+    return false;
+  }
   if (internals.buffer != VK_NULL_HANDLE)
   {
+    renderContext.uploadBatch->cancelBufferUploads(renderContext.device, internals.buffer);
     vkDestroyBuffer(renderContext.vkDevice, internals.buffer, nullptr);
     ownerAllocator->deallocate(renderContext.vkDevice, internals.memoryBlock);
     internals.buffer      = VK_NULL_HANDLE;
@@ -438,9 +596,10 @@ bool SetBufferSizeOperation<T>::perform(const RenderContext& renderContext, Memo
   VkMemoryRequirements memReqs;
   vkGetBufferMemoryRequirements(renderContext.vkDevice, internals.buffer, &memReqs);
   internals.dataSize    = bufferCreateInfo.size;
-  internals.memoryBlock = ownerAllocator->allocate(renderContext.device, memReqs);
+  internals.memoryBlock = ownerAllocator->allocate(renderContext.device, memReqs, owner->getName());
+  internals.frameNumber = renderContext.frameNumber;
   CHECK_LOG_THROW(internals.memoryBlock.alignedSize == 0, "Cannot create a bufer");
-  ownerAllocator->bindBufferMemory(renderContext.device, internals.buffer, internals.memoryBlock.alignedOffset);
+  ownerAllocator->bindBufferMemory(renderContext.device, internals.buffer, internals.memoryBlock);
 
   owner->notifyCommandBufferSources(renderContext);
   owner->notifyBufferViews(renderContext, bufferRange);
@@ -459,8 +618,25 @@ bool SetDataOperation<T>::perform(const RenderContext& renderContext, MemoryBuff
 {
   // if new data size is bigger than existing buffer size - we have to remove it
   auto ownerAllocator = owner->getAllocator();
+  BufferSubresourceRange uploadRange = sourceRange;
+  bool memoryIsLocal = ((ownerAllocator->getMemoryPropertyFlags() & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // whole content of a buffer that was sent in previous frames may be streamed through transfer queue into a new buffer. New buffers have nothing to show
+  // in the meantime, so they are written by the frame. Data in RING allocator lives only for one frame
+  bool wholeBuffer = (uploadRange.offset == 0) && (uploadRange.range >= uglyGetSize(*data));
+  if (memoryIsLocal && wholeBuffer && uglyGetSize(*data) > 0 && renderContext.uploadBatch->getStreamLatency() > 0 && internals.buffer != VK_NULL_HANDLE && internals.frameNumber != renderContext.frameNumber && ownerAllocator->getStrategy() != DeviceMemoryAllocator::RING)
+  {
+    owner->streamData(renderContext, renderContext.device->acquireStagingBuffer(uglyGetPointer(*data), uglyGetSize(*data)), uglyGetSize(*data));
+    return false;
+  }
+  // buffer using RING allocator only moves its data to a bigger part of the ring region
+  if (ownerAllocator->getStrategy() == DeviceMemoryAllocator::RING && internals.memoryBlock.alignedSize < uglyGetSize(*data))
+  {
+    owner->allocateRingMemory(renderContext, internals, std::max<VkDeviceSize>(1, uglyGetSize(*data)));
+    uploadRange = BufferSubresourceRange(0, uglyGetSize(*data));
+  }
   if (internals.buffer!=VK_NULL_HANDLE && internals.memoryBlock.alignedSize < uglyGetSize(*data))
   {
+    renderContext.uploadBatch->cancelBufferUploads(renderContext.device, internals.buffer);
     vkDestroyBuffer(renderContext.vkDevice, internals.buffer, nullptr);
     ownerAllocator->deallocate(renderContext.vkDevice, internals.memoryBlock);
     internals.buffer      = VK_NULL_HANDLE;
@@ -478,41 +654,41 @@ bool SetDataOperation<T>::perform(const RenderContext& renderContext, MemoryBuff
     VkMemoryRequirements memReqs;
     vkGetBufferMemoryRequirements(renderContext.vkDevice, internals.buffer, &memReqs);
     internals.dataSize    = bufferCreateInfo.size;
-    internals.memoryBlock = ownerAllocator->allocate(renderContext.device, memReqs);
+    internals.memoryBlock = ownerAllocator->allocate(renderContext.device, memReqs, owner->getName());
+    internals.frameNumber = renderContext.frameNumber;
     CHECK_LOG_THROW(internals.memoryBlock.alignedSize == 0, "Cannot create a buffer");
-    ownerAllocator->bindBufferMemory(renderContext.device, internals.buffer, internals.memoryBlock.alignedOffset);
+    ownerAllocator->bindBufferMemory(renderContext.device, internals.buffer, internals.memoryBlock);
+
+    // new buffer is empty - whole data must be sent, not only the invalidated range
+    uploadRange = BufferSubresourceRange(0, uglyGetSize(*data));
 
     owner->notifyCommandBufferSources(renderContext);
-    owner->notifyBufferViews(renderContext, bufferRange);
+    owner->notifyBufferViews(renderContext, uploadRange);
     owner->notifyResources(renderContext);
   }
-  bool memoryIsLocal = ((ownerAllocator->getMemoryPropertyFlags() & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  if (uglyGetSize(*data) > 0)
+  // data could shrink after the range was invalidated
+  if (uploadRange.offset >= uglyGetSize(*data))
+    return false;
+  uploadRange.range = std::min<VkDeviceSize>(uploadRange.range, uglyGetSize(*data) - uploadRange.offset);
+
+  const char* sourcePointer = reinterpret_cast<const char*>(uglyGetPointer(*data)) + uploadRange.offset;
+  if (memoryIsLocal)
   {
-    if (memoryIsLocal)
-    {
-      std::shared_ptr<StagingBuffer> stagingBuffer = renderContext.device->acquireStagingBuffer(uglyGetPointer(*data), uglyGetSize(*data));
-      VkBufferCopy copyRegion{};
-      copyRegion.size = uglyGetSize(*data);
-      commandBuffer->cmdCopyBuffer(stagingBuffer->buffer, internals.buffer, copyRegion);
-      stagingBuffers.push_back(stagingBuffer);
-    }
-    else
-    {
-      ownerAllocator->copyToDeviceMemory(renderContext.device, internals.memoryBlock.alignedOffset, uglyGetPointer(*data), uglyGetSize(*data), 0);
-    }
+    // copy is sent to device together with all other uploads of this frame
+    std::shared_ptr<StagingBuffer> stagingBuffer = renderContext.device->acquireStagingBuffer(sourcePointer, uploadRange.range);
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = stagingBuffer->bufferOffset();
+    copyRegion.dstOffset = internals.bufferOffset + uploadRange.offset;
+    copyRegion.size      = uploadRange.range;
+    renderContext.uploadBatch->addBufferUpload(stagingBuffer, internals.buffer, copyRegion);
+  }
+  else
+  {
+    ownerAllocator->copyToDeviceMemory(renderContext.device, internals.memoryBlock, uploadRange.offset, sourcePointer, uploadRange.range, 0);
   }
 
-  // if we sent some data and memory is not accessible from host ( is local ) - we generated no commands to command buffer
-  return uglyGetSize(*data) > 0 && memoryIsLocal;
-}
-
-template<typename T>
-void SetDataOperation<T>::releaseResources(const RenderContext& renderContext)
-{
-  for (auto& s : stagingBuffers)
-    renderContext.device->releaseStagingBuffer(s);
-  stagingBuffers.clear();
+  // copies to local memory are recorded by UploadBatch - we generated no commands to command buffer
+  return false;
 }
 
 }
@@ -22,6 +22,7 @@
 
 #pragma once
 #include <unordered_map>
+#include <map>
 #include <memory>
 #include <list>
 #include <mutex>
@@ -39,6 +40,9 @@ class RenderContext;
 class CommandBuffer;
 class CommandBufferSource;
 class ImageView;
+class SharedImageMemory;
+class AttachmentMemoryPool;
+class StagingBuffer;
 
 // struct defining subresource range for image
 struct PUMEX_EXPORT ImageSubresourceRange
@@ -96,6 +100,12 @@ public:
   inline const SwapChainImageBehaviour&         getSwapChainImageBehaviour() const;
   inline std::shared_ptr<DeviceMemoryAllocator> getAllocator() const;
   inline std::shared_ptr<gli::texture>          getTexture() const;
+  // images created by setImageTraits() will use memory shared with other images ( see SharedImageMemory )
+  void                                          setSharedMemory(std::shared_ptr<SharedImageMemory> sharedMemory);
+  inline std::shared_ptr<SharedImageMemory>     getSharedMemory() const;
+  // images created by setImageTraits() will use memory borrowed from attachment memory pool ( see AttachmentMemoryPool )
+  void                                          setAttachmentMemoryPool(std::shared_ptr<AttachmentMemoryPool> memoryPool);
+  inline std::shared_ptr<AttachmentMemoryPool>  getAttachmentMemoryPool() const;
 
   void                                          validate(const RenderContext& renderContext);
 
@@ -111,6 +121,7 @@ public:
   struct MemoryImageInternal
   {
     std::shared_ptr<Image> image;
+    unsigned long long     frameNumber = 0; // frame in which the image was created
   };
   // struct that defines all operations that may be performed on that Texture ( set new image traits, clear it, set new data )
   struct Operation
@@ -146,6 +157,9 @@ public:
     ImageSubresourceRange imageRange;
     std::vector<char>     updated;
   };
+  // sends whole image through transfer queue to a new image that replaces current one when frame acquires it ( see UploadBatch::getStreamLatency() ).
+  // Until then current image is used and following operations wait. Must be called with the mutex locked ( during validate() )
+  void streamImage(const RenderContext& renderContext, const ImageTraits& traits, std::shared_ptr<StagingBuffer> stagingBuffer, VkImageAspectFlags aspectMask, const std::vector<VkBufferImageCopy>& regions);
 protected:
   struct MemoryImageLoadData
   {
@@ -153,7 +167,25 @@ protected:
   };
   typedef PerObjectData<MemoryImageInternal, MemoryImageLoadData> MemoryImageData;
 
+  // image left after relocation may still be used by frames in flight
+  struct RelocatedImage
+  {
+    unsigned long long     frameNumber;
+    std::shared_ptr<Image> image;
+  };
+
+  // image written by transfer queue, that replaces current image in frame readyFrame
+  struct StreamedImage
+  {
+    uint32_t               key;
+    uint32_t               activeIndex;
+    unsigned long long     readyFrame;
+    std::shared_ptr<Image> image;
+  };
+
   std::unordered_map<uint32_t, MemoryImageData>   perObjectData;
+  std::list<RelocatedImage>                       relocatedImages;
+  std::list<StreamedImage>                        streamedImages;
   mutable std::mutex                              mutex;
   PerObjectBehaviour                              perObjectBehaviour;
   SwapChainImageBehaviour                         swapChainImageBehaviour;
@@ -161,6 +193,8 @@ protected:
   ImageTraits                                     imageTraits;
   std::shared_ptr<gli::texture>                   texture;
   std::shared_ptr<DeviceMemoryAllocator>          allocator;
+  std::shared_ptr<SharedImageMemory>              sharedMemory;
+  std::shared_ptr<AttachmentMemoryPool>           attachmentMemoryPool;
   VkImageAspectFlags                              aspectMask;
   uint32_t                                        activeCount;
   // objects that may own a texture and must be informed when some changes happen
@@ -171,6 +205,78 @@ protected:
   void internalSetImage(uint32_t key, VkDevice device, VkSurfaceKHR surface, std::shared_ptr<gli::texture> texture);
   void internalSetImages(uint32_t key, VkDevice device, VkSurfaceKHR surface, std::vector<std::shared_ptr<Image>>& images);
   void internalClearImage(uint32_t key, VkDevice device, VkSurfaceKHR surface, const glm::vec4& clearValue, const ImageSubresourceRange& range);
+  void relocateImage(const RenderContext& renderContext, MemoryImageInternal& internals);
+  void releaseRelocatedImages(const RenderContext& renderContext);
+  // returns true when image still waits for streamed data
+  bool replaceStreamedImage(const RenderContext& renderContext, uint32_t key, uint32_t activeIndex);
+};
+
+// Memory shared by images that are never used at the same time ( e.g. transient frame buffer attachments with disjoint lifetimes ).
+// Each surface/device gets one memory block big enough to hold any of the registered images. Images are bound to the beginning of that block
+class PUMEX_EXPORT SharedImageMemory
+{
+public:
+  SharedImageMemory()                                    = delete;
+  explicit SharedImageMemory(std::shared_ptr<DeviceMemoryAllocator> allocator);
+  SharedImageMemory(const SharedImageMemory&)            = delete;
+  SharedImageMemory& operator=(const SharedImageMemory&) = delete;
+  SharedImageMemory(SharedImageMemory&&)                 = delete;
+  SharedImageMemory& operator=(SharedImageMemory&&)      = delete;
+
+  void                               setImageTraits(uint32_t key, const MemoryImage* memoryImage, const ImageTraits& traits);
+  // returns nullptr when registered images have no common memory type - images should allocate their own memory then
+  std::shared_ptr<DeviceMemoryBlock> getMemoryBlock(const RenderContext& renderContext, uint32_t key);
+protected:
+  struct SharedMemoryData
+  {
+    std::map<const MemoryImage*, ImageTraits> imageTraits;
+    std::shared_ptr<DeviceMemoryBlock>        memoryBlock;
+    bool                                      valid = false;
+  };
+  std::unordered_map<uint32_t, SharedMemoryData> perObjectData;
+  std::shared_ptr<DeviceMemoryAllocator>         allocator;
+  mutable std::mutex                             mutex;
+};
+
+// Pool of device memory for frame buffer attachments. Pool may be shared by many workflows and surfaces ( e.g. in multi window setups ).
+// Memory of destroyed images ( e.g. images released during swapchain resize or by closed surface ) returns to the pool and is reused by new images
+// with the same format, usage and sample count when it is big enough. Blocks are allocated with sizeReserve headroom, so that small
+// resizes reuse existing memory. Unused blocks that are too small for a new image are released. Pool must be created by std::make_shared()
+class PUMEX_EXPORT AttachmentMemoryPool : public std::enable_shared_from_this<AttachmentMemoryPool>
+{
+public:
+  AttachmentMemoryPool()                                       = delete;
+  explicit AttachmentMemoryPool(std::shared_ptr<DeviceMemoryAllocator> allocator, float sizeReserve = 1.25f);
+  AttachmentMemoryPool(const AttachmentMemoryPool&)            = delete;
+  AttachmentMemoryPool& operator=(const AttachmentMemoryPool&) = delete;
+  AttachmentMemoryPool(AttachmentMemoryPool&&)                 = delete;
+  AttachmentMemoryPool& operator=(AttachmentMemoryPool&&)      = delete;
+  ~AttachmentMemoryPool();
+
+  // returns memory block for an image with specific traits. Block returns to the pool when last image using it is destroyed
+  std::shared_ptr<DeviceMemoryBlock>            acquire(Device* device, const ImageTraits& traits);
+  // releases all memory that is not used by any image at the moment
+  void                                          releaseUnusedMemory(VkDevice device);
+  VkDeviceSize                                  getUnusedSize(VkDevice device) const;
+
+  inline std::shared_ptr<DeviceMemoryAllocator> getAllocator() const;
+protected:
+  struct PoolKey
+  {
+    VkFormat              format;
+    VkImageUsageFlags     usage;
+    VkSampleCountFlagBits samples;
+    bool                  linearTiling;
+    VkImageCreateFlags    imageCreate;
+
+    bool operator<(const PoolKey& rhs) const;
+  };
+  void                                          release(VkDevice device, const PoolKey& key, const DeviceMemoryBlock& block);
+
+  std::unordered_map<VkDevice, std::map<PoolKey, std::vector<DeviceMemoryBlock>>> unusedBlocks;
+  std::shared_ptr<DeviceMemoryAllocator>        allocator;
+  float                                         sizeReserve;
+  mutable std::mutex                            mutex;
 };
 
 class PUMEX_EXPORT ImageView : public std::enable_shared_from_this<ImageView>
@@ -223,5 +329,8 @@ const PerObjectBehaviour&              MemoryImage::getPerObjectBehaviour() cons
 const SwapChainImageBehaviour&         MemoryImage::getSwapChainImageBehaviour() const { return swapChainImageBehaviour; }
 std::shared_ptr<DeviceMemoryAllocator> MemoryImage::getAllocator() const               { return allocator; }
 std::shared_ptr<gli::texture>          MemoryImage::getTexture() const                 { return texture; }
+std::shared_ptr<SharedImageMemory>     MemoryImage::getSharedMemory() const            { return sharedMemory; }
+std::shared_ptr<AttachmentMemoryPool>  MemoryImage::getAttachmentMemoryPool() const    { return attachmentMemoryPool; }
+std::shared_ptr<DeviceMemoryAllocator> AttachmentMemoryPool::getAllocator() const      { return allocator; }
 
 }
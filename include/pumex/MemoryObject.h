@@ -21,6 +21,7 @@
 //
 
 #pragma once
+#include <string>
 #include <pumex/Export.h>
 
 namespace pumex
@@ -43,11 +44,16 @@ public:
   MemoryObject& operator=(MemoryObject&&)      = delete;
   virtual ~MemoryObject();
 
-  inline Type           getType();
-  virtual MemoryImage*  asMemoryImage();
-  virtual MemoryBuffer* asMemoryBuffer();
+  inline Type               getType();
+  virtual MemoryImage*      asMemoryImage();
+  virtual MemoryBuffer*     asMemoryBuffer();
+
+  // name is sent to DeviceMemoryAllocator to describe allocations in memory statistics
+  inline void               setName(const std::string& name);
+  inline const std::string& getName() const;
 protected:
-  Type type;
+  Type        type;
+  std::string name;
 };
 
 MemoryObject::Type MemoryObject::getType()
@@ -55,4 +61,14 @@ MemoryObject::Type MemoryObject::getType()
   return type;
 }
 
+void MemoryObject::setName(const std::string& n)
+{
+  name = n;
+}
+
+const std::string& MemoryObject::getName() const
+{
+  return name;
+}
+
 }
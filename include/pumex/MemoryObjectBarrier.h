@@ -32,13 +32,15 @@
 namespace pumex
 {
 
-// MemoryObjectBarrier objects are created during workflow compilation
+// MemoryObjectBarrier objects are created during workflow compilation.
+// Queue families are not known during compilation, so barriers store indices of workflow queues ( VK_QUEUE_FAMILY_IGNORED when barrier
+// does not transfer resource between queues ). Queue indices are translated to queue family indices when barrier is recorded
 class PUMEX_EXPORT MemoryObjectBarrier
 {
 public:
   MemoryObjectBarrier();
-  MemoryObjectBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex, std::shared_ptr<MemoryObject> memoryObject, VkImageLayout oldLayout, VkImageLayout newLayout, const ImageSubresourceRange& imageRange);
-  MemoryObjectBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex, std::shared_ptr<MemoryObject> memoryObject, const BufferSubresourceRange& bufferRange);
+  MemoryObjectBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueIndex, uint32_t dstQueueIndex, std::shared_ptr<MemoryObject> memoryObject, VkImageLayout oldLayout, VkImageLayout newLayout, const ImageSubresourceRange& imageRange);
+  MemoryObjectBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueIndex, uint32_t dstQueueIndex, std::shared_ptr<MemoryObject> memoryObject, const BufferSubresourceRange& bufferRange);
   MemoryObjectBarrier(const MemoryObjectBarrier&);
   MemoryObjectBarrier& operator=(const MemoryObjectBarrier&);
   ~MemoryObjectBarrier();
@@ -46,8 +48,8 @@ public:
   MemoryObject::Type            objectType;
   VkAccessFlags                 srcAccessMask;
   VkAccessFlags                 dstAccessMask;
-  uint32_t                      srcQueueFamilyIndex;
-  uint32_t                      dstQueueFamilyIndex;
+  uint32_t                      srcQueueIndex;
+  uint32_t                      dstQueueIndex;
   std::shared_ptr<MemoryObject> memoryObject;
 
   VkImageLayout                 oldLayout;   // used by images
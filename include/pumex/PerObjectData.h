@@ -30,7 +30,8 @@ namespace pumex
 {
 
 enum PerObjectBehaviour { pbPerDevice, pbPerSurface };
-enum SwapChainImageBehaviour { swOnce, swForEachImage };
+// swForEachImage creates a copy of data for each frame in flight, swForEachSwapChainImage - for each swap chain image ( used by objects that wrap swap chain images )
+enum SwapChainImageBehaviour { swOnce, swForEachImage, swForEachSwapChainImage };
 
 // helper class that stores info about internal data for many classes in a library
 template<typename T, typename U>
@@ -51,13 +52,15 @@ struct PerObjectData
 };
 
 inline void* getKey(const RenderContext& renderContext, const PerObjectBehaviour& pob);
+inline uint32_t getActiveCount(const RenderContext& renderContext, SwapChainImageBehaviour scib);
+inline uint32_t getActiveIndex(const RenderContext& renderContext, SwapChainImageBehaviour scib);
 uint32_t getKeyID(const RenderContext& renderContext, const PerObjectBehaviour& pob);
 
 template<typename T, typename U>
 PerObjectData<T,U>::PerObjectData(const RenderContext& renderContext, SwapChainImageBehaviour scib)
   : device{ renderContext.vkDevice }, surface{ renderContext.vkSurface }, commonData(), swapChainImageBehaviour{ scib }
 {
-  resize(swapChainImageBehaviour==swForEachImage ? renderContext.imageCount : 1);
+  resize(getActiveCount(renderContext, swapChainImageBehaviour));
 }
 
 template<typename T, typename U>
@@ -70,7 +73,7 @@ PerObjectData<T,U>::PerObjectData(VkDevice d, VkSurfaceKHR s, uint32_t ac, SwapC
 template<typename T, typename U>
 void PerObjectData<T,U>::resize(uint32_t ac)
 {
-  uint32_t newSize = (swapChainImageBehaviour == swForEachImage) ? ac : 1;
+  uint32_t newSize = (swapChainImageBehaviour != swOnce) ? ac : 1;
   valid.resize(newSize, false);
   data.resize(newSize, T());
 }
@@ -102,4 +105,26 @@ void* getKey(const RenderContext& renderContext, const PerObjectBehaviour& pob)
   return nullptr;
 }
 
+uint32_t getActiveCount(const RenderContext& renderContext, SwapChainImageBehaviour scib)
+{
+  switch (scib)
+  {
+  case swForEachImage:          return renderContext.activeCount;
+  case swForEachSwapChainImage: return renderContext.imageCount;
+  default:                      break;
+  }
+  return 1;
+}
+
+uint32_t getActiveIndex(const RenderContext& renderContext, SwapChainImageBehaviour scib)
+{
+  switch (scib)
+  {
+  case swForEachImage:          return renderContext.activeIndex;
+  case swForEachSwapChainImage: return renderContext.imageIndex;
+  default:                      break;
+  }
+  return 0;
+}
+
 }
@@ -37,6 +37,7 @@ class RenderPass;
 class RenderOperation;
 class PipelineLayout;
 class AssetBuffer;
+class UploadBatch;
 
 // class that is used extensively in Pumex : handles information about currently bound objects during data validation and command buffer creation
 class PUMEX_EXPORT RenderContext
@@ -61,8 +62,12 @@ public:
   Device*                          device                 = nullptr;
   VkDevice                         vkDevice               = VK_NULL_HANDLE;
   DescriptorPool*                  descriptorPool         = nullptr;
-  uint32_t                         activeIndex            = 0;
-  uint32_t                         imageCount             = 1;
+  UploadBatch*                     uploadBatch            = nullptr;
+  uint32_t                         activeIndex            = 0; // index of current frame in flight
+  uint32_t                         activeCount            = 1; // number of frames in flight
+  uint32_t                         imageIndex             = 0; // index of current swap chain image
+  uint32_t                         imageCount             = 1; // number of swap chain images
+  unsigned long long               frameNumber            = 0;
 
   // elements of the context that may change during visitor work
   std::shared_ptr<FrameBuffer>     frameBuffer;
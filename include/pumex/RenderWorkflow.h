@@ -23,10 +23,13 @@
 #pragma once
 #include <unordered_map>
 #include <vector>
+#include <list>
+#include <iosfwd>
 #include <set>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <tuple>
 #include <vulkan/vulkan.h>
 #include <gli/texture.hpp>
 #include <pumex/Export.h>
@@ -42,6 +45,7 @@ class  Device;
 struct QueueTraits;
 struct SubpassDefinition;
 class  DeviceMemoryAllocator;
+class  AttachmentMemoryPool;
 class  RenderPass;
 struct FrameBufferImageDefinition;
 class  Node;
@@ -196,7 +200,13 @@ public:
   std::weak_ptr<RenderWorkflow> renderWorkflow;
   std::shared_ptr<Node>         node;
 
-  bool                          enabled; // not implemented
+  bool                          enabled; // disabled operation is skipped when command buffers are built. Use RenderWorkflow::setRenderOperationEnabled() to change it
+  // operation is performed only in frames where frameNumber % updatePeriod == updatePhase. Use RenderWorkflow::setRenderOperationUpdatePeriod() to change it
+  uint32_t                      updatePeriod;
+  uint32_t                      updatePhase;
+
+  inline bool                   isRateLimited() const;
+  inline bool                   hasSameUpdatePeriod(const RenderOperation& rhs) const;
 };
 
 enum ResourceTransitionType
@@ -258,6 +268,9 @@ public:
   std::vector<QueueTraits>                                                           queueTraits;
   std::vector<std::vector<std::shared_ptr<RenderCommand>>>                           commands;
   std::map<std::string, std::string>                                                 resourceAlias;
+  std::map<std::string, std::shared_ptr<SharedImageMemory>>                          sharedImageMemory;
+  // attachments generated and consumed within one render pass - their content is never stored in memory
+  std::set<std::string>                                                              transientAttachments;
   std::shared_ptr<RenderPass>                                                        outputRenderPass;
   uint32_t                                                                           presentationQueueIndex = 0;
   std::map<std::string, std::shared_ptr<MemoryBuffer>>                               registeredMemoryBuffers;
@@ -265,6 +278,15 @@ public:
   std::map<std::string, std::shared_ptr<ImageView>>                                  registeredImageViews;
   std::map<std::string, std::tuple<VkImageLayout,AttachmentType,VkImageAspectFlags>> initialImageLayouts;
   std::vector<std::shared_ptr<FrameBuffer>>                                          frameBuffers;
+  // queueDependencies[i] stores queues that must finish their work before queue i may use its results ( and pipeline stages of queue i that wait for them )
+  std::vector<std::map<uint32_t, VkPipelineStageFlags>>                              queueDependencies;
+  // order in which command buffers are submitted to queues - queue is always submitted after queues it depends on
+  std::vector<uint32_t>                                                              queueSubmissionOrder;
+  // number of pipeline barriers ( and vkCmdPipelineBarrier() calls ) before and after barrier optimization
+  uint32_t                                                                           barrierCountBeforeOptimization      = 0;
+  uint32_t                                                                           barrierCountAfterOptimization       = 0;
+  uint32_t                                                                           barrierGroupCountBeforeOptimization = 0;
+  uint32_t                                                                           barrierGroupCountAfterOptimization  = 0;
 
   QueueTraits                getPresentationQueue() const;
   FrameBufferImageDefinition getSwapChainImageDefinition() const;
@@ -280,7 +302,8 @@ class PUMEX_EXPORT RenderWorkflow : public std::enable_shared_from_this<RenderWo
 {
 public:
   RenderWorkflow()                                 = delete;
-  explicit RenderWorkflow(const std::string& name, std::shared_ptr<DeviceMemoryAllocator> frameBufferAllocator, const std::vector<QueueTraits>& queueTraits);
+  // transient attachments are allocated from transientAttachmentAllocator ( preferably lazily allocated memory ). When it is not provided - frameBufferAllocator is used
+  explicit RenderWorkflow(const std::string& name, std::shared_ptr<DeviceMemoryAllocator> frameBufferAllocator, const std::vector<QueueTraits>& queueTraits, std::shared_ptr<DeviceMemoryAllocator> transientAttachmentAllocator = nullptr);
   RenderWorkflow(const RenderWorkflow&)            = delete;
   RenderWorkflow& operator=(const RenderWorkflow&) = delete;
   RenderWorkflow(RenderWorkflow&&)                 = delete;
@@ -304,6 +327,16 @@ public:
   void                                             setRenderOperationNode(const std::string& opName, std::shared_ptr<Node> node);
   std::shared_ptr<Node>                            getRenderOperationNode(const std::string& opName);
 
+  // Disabled operation does not record its node, but its render pass, pipeline barriers and layout transitions are still recorded.
+  // Attachments generated by disabled graphics operation keep the results of their load operation ( e.g. clear color ).
+  // Changing this flag does not require workflow recompilation - only primary command buffers are rebuilt
+  void                                             setRenderOperationEnabled(const std::string& opName, bool enabled);
+  bool                                             isRenderOperationEnabled(const std::string& opName) const;
+  // Operation updated every few frames ( reflection probes, distant shadows, voxelization ). Outputs of such operation are kept between frames
+  // ( they are never transient and never share memory ). Workflow must be compiled again after the change
+  void                                             setRenderOperationUpdatePeriod(const std::string& opName, uint32_t updatePeriod, uint32_t updatePhase = 0);
+  inline uint64_t                                  getOperationStateNumber() const;
+
   void                                             addAttachmentInput(const std::string& opName, const std::string& resourceType, const std::string& resourceName, VkImageLayout layout);
   void                                             addAttachmentOutput(const std::string& opName, const std::string& resourceType, const std::string& resourceName, VkImageLayout layout, const LoadOp& loadOp);
   void                                             addAttachmentResolveOutput(const std::string& opName, const std::string& resourceType, const std::string& resourceName, const std::string& resourceSource, VkImageLayout layout, const LoadOp& loadOp);
@@ -325,6 +358,7 @@ public:
   inline const std::map<std::string, std::shared_ptr<MemoryObject>>& getAssociatedMemoryObjects() const;
   inline const std::map<std::string, std::shared_ptr<ImageView>>&    getAssociatedImageViews() const;
 
+  inline const std::vector<std::shared_ptr<ResourceTransition>>& getTransitions() const;
   std::vector<std::shared_ptr<ResourceTransition>> getOperationIO(const std::string& opName, ResourceTransitionTypeFlags transitionTypes) const;
   std::vector<std::shared_ptr<ResourceTransition>> getResourceIO(const std::string& resourceName, ResourceTransitionTypeFlags transitionTypes) const;
 
@@ -335,8 +369,46 @@ public:
 
   bool compile(std::shared_ptr<RenderWorkflowCompiler> compiler);
 
+  // canonical description of everything that affects compilation results : operations, transitions, resource types, associated memory objects and queues.
+  // All lists are sorted, so the key does not depend on the order in which workflow elements were added
+  struct StructureKey
+  {
+    typedef std::tuple<const RenderOperation*, std::string, uint32_t, uint32_t, uint32_t, float, float, float, uint32_t, uint32_t> OperationKey;
+    typedef std::tuple<std::string, std::string, std::string, uint32_t, uint32_t, uint32_t, float, float, float, float, std::string,
+      VkImageAspectFlags, uint32_t, uint32_t, uint32_t, uint32_t, VkPipelineStageFlags, VkAccessFlags, VkDeviceSize, VkDeviceSize> TransitionKey;
+    typedef std::tuple<std::string, uint32_t, bool, uint32_t, uint32_t, uint32_t, uint32_t, float, float, float, VkImageUsageFlags, uint32_t, uint32_t, uint32_t, uint32_t> ResourceTypeKey;
+
+    std::vector<OperationKey>                                   operations;
+    std::vector<TransitionKey>                                  transitions;
+    std::vector<ResourceTypeKey>                                resourceTypes;   // only resource types used by transitions
+    std::vector<std::tuple<std::string, const MemoryObject*>>   memoryObjects;
+    std::vector<std::tuple<std::string, const ImageView*>>      memoryImageViews;
+    std::vector<std::tuple<VkQueueFlags, VkQueueFlags, float>>  queues;
+
+    bool        operator==(const StructureKey& rhs) const;
+    std::size_t hash() const;
+  };
+  StructureKey                                     calculateStructureKey() const;
+  // hash of the structure key
+  std::size_t                                      calculateStructureHash() const;
+  // compiled results are cached by structure hash, so that switching back to previously used workflow structure does not require recompilation.
+  // Cached results keep their frame buffer images alive - use size 0 to switch the cache off
+  void                                             setResultsCacheSize(uint32_t cacheSize);
+  inline uint32_t                                  getResultsCacheSize() const;
+  void                                             clearResultsCache();
+  // incremented each time workflowResults is updated ( even when results come from cache )
+  inline uint64_t                                  getCompilationNumber() const;
+  // writes operations, transitions and compilation results ( operation sequences, aliased resources, render passes and pipeline barriers )
+  // as Graphviz graph or as JSON document. Output does not depend on the order of containers, so it may be compared between builds
+  void                                             dumpDOT(std::ostream& stream) const;
+  void                                             dumpJSON(std::ostream& stream) const;
+
   // data created during workflow compilation - may be used in many surfaces at once
   std::shared_ptr<DeviceMemoryAllocator>                                       frameBufferAllocator;
+  std::shared_ptr<DeviceMemoryAllocator>                                       transientAttachmentAllocator;
+  // when attachment memory pool is set ( before first compilation ), frame buffer images borrow their memory from it instead of frameBufferAllocator.
+  // The same pool may be used by many workflows, so that surfaces reuse memory released by other surfaces and by swapchain resizes
+  std::shared_ptr<AttachmentMemoryPool>                                        attachmentMemoryPool;
   std::shared_ptr<RenderWorkflowResults>                                       workflowResults;
 
 protected:
@@ -351,37 +423,110 @@ protected:
   std::vector<QueueTraits>                                                     queueTraits;
   bool                                                                         valid                = false;
   mutable std::mutex                                                           compileMutex;
+
+  struct CachedResults
+  {
+    std::size_t                             structureHash;
+    StructureKey                            structureKey; // compared when hashes are equal
+    std::shared_ptr<RenderWorkflowCompiler> compiler;
+    std::shared_ptr<RenderWorkflowResults>  results;
+  };
+  std::list<CachedResults>                                                     resultsCache;        // most recently used results first
+  uint32_t                                                                     resultsCacheSize     = 8;
+  uint64_t                                                                     compilationNumber    = 0;
+  uint64_t                                                                     operationStateNumber = 0;
 };
 
 // This is the first implementation of workflow compiler
 // It only uses one queue to do the job
 
-struct PUMEX_EXPORT StandardRenderWorkflowCostCalculator
+// Cost calculator is used by workflow compiler to choose the order of operations. Operations with the same tag may become subpasses of the same render pass.
+class PUMEX_EXPORT RenderWorkflowCostCalculator
 {
-  void  tagOperationByAttachmentType(const RenderWorkflow& workflow);
-  float calculateWorkflowCost(const RenderWorkflow& workflow, const std::vector<std::shared_ptr<RenderOperation>>& operationSchedule) const;
+public:
+  virtual ~RenderWorkflowCostCalculator();
+
+  virtual void  tagOperationByAttachmentType(const RenderWorkflow& workflow);
+  virtual float calculateWorkflowCost(const RenderWorkflow& workflow, const std::vector<std::shared_ptr<RenderOperation>>& operationSchedule) const;
+  virtual float calculateTransitionCost(const RenderWorkflow& workflow, const std::shared_ptr<RenderOperation>& previousOperation, const std::shared_ptr<RenderOperation>& nextOperation) const = 0;
+  // true when both operations may become subpasses of the same render pass
+  bool          canShareRenderPass(const RenderOperation& lhs, const RenderOperation& rhs) const;
 
   std::unordered_map<std::string, int> attachmentTag;
 };
 
+// flat cost for each change of the operation tag
+class PUMEX_EXPORT StandardRenderWorkflowCostCalculator : public RenderWorkflowCostCalculator
+{
+public:
+  float calculateTransitionCost(const RenderWorkflow& workflow, const std::shared_ptr<RenderOperation>& previousOperation, const std::shared_ptr<RenderOperation>& nextOperation) const override;
+};
+
+// Estimates memory traffic ( in megabytes ) caused by the order of operations : attachments stored at the end of render pass and loaded
+// again in the next one, layout transitions between operations. Size of surface dependent attachments is estimated using referenceExtent
+class PUMEX_EXPORT BandwidthRenderWorkflowCostCalculator : public RenderWorkflowCostCalculator
+{
+public:
+  explicit BandwidthRenderWorkflowCostCalculator(const VkExtent2D& referenceExtent = VkExtent2D{ 1920, 1080 }, float renderPassCost = 0.5f, float layoutTransitionFactor = 0.5f);
+
+  float calculateTransitionCost(const RenderWorkflow& workflow, const std::shared_ptr<RenderOperation>& previousOperation, const std::shared_ptr<RenderOperation>& nextOperation) const override;
+  // estimated size of an attachment in megabytes ( 0 for resources that are not attachments )
+  float getAttachmentSize(const RenderWorkflowResourceType& resourceType) const;
+
+  VkExtent2D referenceExtent;
+  float      renderPassCost;         // fixed cost of starting a new render pass ( in megabytes )
+  float      layoutTransitionFactor; // part of an image that is read and written during layout transition
+};
+
 class PUMEX_EXPORT SingleQueueWorkflowCompiler : public RenderWorkflowCompiler
 {
 public:
+  // StandardRenderWorkflowCostCalculator is used when cost calculator is not provided
+  explicit SingleQueueWorkflowCompiler(std::shared_ptr<RenderWorkflowCostCalculator> costCalculator = nullptr);
+
   std::shared_ptr<RenderWorkflowResults> compile(RenderWorkflow& workflow) override;
-private:
+protected:
+  // builds one operation sequence per workflow queue. All operations are sent to the first queue
+  virtual void                           scheduleOperationSequences(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences);
+
   void                                   verifyOperations(const RenderWorkflow& workflow);
   void                                   calculatePartialOrdering(const RenderWorkflow& workflow, std::vector<std::shared_ptr<RenderOperation>>& partialOrdering);
   void                                   calculateAttachmentLayouts(const RenderWorkflow& workflow, const std::vector<std::shared_ptr<RenderOperation>>& partialOrdering, std::map<std::string, uint32_t>& resourceMap, std::map<std::string, uint32_t>& operationMap, std::vector<std::vector<VkImageLayout>>& allLayouts);
+  void                                   findTransientAttachments(const RenderWorkflow& workflow, const std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences, std::shared_ptr<RenderWorkflowResults> workflowResults);
   void                                   findAliasedResources(const RenderWorkflow& workflow, const std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences, std::shared_ptr<RenderWorkflowResults> workflowResults);
   void                                   createCommandSequence(const std::vector<std::shared_ptr<RenderOperation>>& operationSequence, std::vector<std::shared_ptr<RenderCommand>>& commands);
   void                                   buildFrameBuffersAndRenderPasses(const RenderWorkflow& workflow, const std::vector<std::shared_ptr<RenderOperation>>& partialOrdering, const std::map<std::string, uint32_t>& resourceMap, const std::map<std::string, uint32_t>& operationMap, const std::vector<std::vector<VkImageLayout>>& allLayouts, std::shared_ptr<RenderWorkflowResults> workflowResults);
   void                                   createPipelineBarriers(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderCommand>>>& commandSequences, std::shared_ptr<RenderWorkflowResults> workflowResults);
   void                                   createSubpassDependency(std::shared_ptr<ResourceTransition> generatingTransition, std::shared_ptr<RenderCommand> generatingCommand, std::shared_ptr<ResourceTransition> consumingTransition, std::shared_ptr<RenderCommand> consumingCommand, uint32_t generatingQueueIndex, uint32_t consumingQueueIndex, std::shared_ptr<RenderWorkflowResults> workflowResults);
   void                                   createPipelineBarrier(std::shared_ptr<ResourceTransition> generatingTransition, std::shared_ptr<RenderCommand> generatingCommand, std::shared_ptr<ResourceTransition> consumingTransition, std::shared_ptr<RenderCommand> consumingCommand, uint32_t generatingQueueIndex, uint32_t consumingQueueIndex, std::shared_ptr<RenderWorkflowResults> workflowResults);
+  void                                   calculateQueueSubmissionOrder(std::shared_ptr<RenderWorkflowResults> workflowResults);
+  void                                   mergeRenderPasses(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences);
+  void                                   shareFrameBuffers(std::shared_ptr<RenderWorkflowResults> workflowResults);
+  void                                   optimizePipelineBarriers(const RenderWorkflow& workflow, std::shared_ptr<RenderWorkflowResults> workflowResults);
+  void                                   createRateLimitedBarriers(const RenderWorkflow& workflow, std::shared_ptr<RenderWorkflowResults> workflowResults);
+  bool                                   canShareRenderPass(std::shared_ptr<RenderOperation> lhs, std::shared_ptr<RenderOperation> rhs) const;
+
+  std::shared_ptr<RenderWorkflowCostCalculator> costCalculator;
+};
 
-  StandardRenderWorkflowCostCalculator   costCalculator;
+// Workflow compiler that sends compute operations to a separate compute queue ( async compute ), if workflow defines such queue.
+// Compute operation is moved to the compute queue only when all operations it depends on are moved there too. Graphics queue waits
+// for the compute queue, but never the other way round, so the queues may work in parallel ( e.g. GPU culling and shadow rendering ).
+class PUMEX_EXPORT MultiQueueWorkflowCompiler : public SingleQueueWorkflowCompiler
+{
+public:
+  using SingleQueueWorkflowCompiler::SingleQueueWorkflowCompiler;
+protected:
+  void scheduleOperationSequences(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences) override;
 };
 
+// orders operations so that all dependencies are respected, preferring operations with the lowest transition cost. Operations must be tagged
+// by the cost calculator before ( see RenderWorkflowCostCalculator::tagOperationByAttachmentType() )
+PUMEX_EXPORT std::vector<std::shared_ptr<RenderOperation>> scheduleOperations(const RenderWorkflow& workflow, const RenderWorkflowCostCalculator& costCalculator);
+
+// assigns each operation to a workflow queue : compute operations that depend only on other compute operations go to computeQueueIndex, the rest goes to mainQueueIndex
+PUMEX_EXPORT std::map<std::string, uint32_t> assignOperationsToQueues(const RenderWorkflow& workflow, uint32_t mainQueueIndex, uint32_t computeQueueIndex);
+
 LoadOp             loadOpLoad()                        { return LoadOp(LoadOp::Load, glm::vec4(0.0f)); }
 LoadOp             loadOpClear(const glm::vec2& color) { return LoadOp(LoadOp::Clear, glm::vec4(color.x, color.y, 0.0f, 0.0f)); }
 LoadOp             loadOpClear(const glm::vec4& color) { return LoadOp(LoadOp::Clear, color); }
@@ -390,6 +535,8 @@ StoreOp            storeOpStore()                      { return StoreOp(StoreOp:
 StoreOp            storeOpDontCare()                   { return StoreOp(StoreOp::DontCare); }
 
 bool                            RenderWorkflowResourceType::isImageOrAttachment() const { return metaType == RenderWorkflowResourceType::Attachment || metaType == RenderWorkflowResourceType::Image; };
+bool                            RenderOperation::isRateLimited() const                  { return updatePeriod > 1; }
+bool                            RenderOperation::hasSameUpdatePeriod(const RenderOperation& rhs) const { return updatePeriod == rhs.updatePeriod && (updatePeriod <= 1 || updatePhase == rhs.updatePhase); }
 const std::vector<QueueTraits>& RenderWorkflow::getQueueTraits() const                  { return queueTraits; }
 
 VkImageAspectFlags getAspectMask(AttachmentType at)
@@ -555,6 +702,10 @@ void getAccessMasks(std::shared_ptr<ResourceTransition> generatingTransition, st
 
 const std::map<std::string, std::shared_ptr<MemoryObject>>& RenderWorkflow::getAssociatedMemoryObjects() const { return associatedMemoryObjects;  }
 const std::map<std::string, std::shared_ptr<ImageView>>&    RenderWorkflow::getAssociatedImageViews() const    { return associatedMemoryImageViews; }
+const std::vector<std::shared_ptr<ResourceTransition>>&     RenderWorkflow::getTransitions() const             { return transitions; }
+uint32_t                                                    RenderWorkflow::getResultsCacheSize() const        { return resultsCacheSize; }
+uint64_t                                                    RenderWorkflow::getCompilationNumber() const       { return compilationNumber; }
+uint64_t                                                    RenderWorkflow::getOperationStateNumber() const    { return operationStateNumber; }
 
 
 }
@@ -37,6 +37,7 @@ class Window;
 class RenderWorkflow;
 class RenderWorkflowCompiler;
 class RenderWorkflowResults;
+class RenderOperation;
 class CommandPool;
 class CommandBuffer;
 class FrameBuffer;
@@ -46,6 +47,7 @@ class ImageView;
 class Image;
 class Node;
 class TimeStatistics;
+class UploadBatch;
 
 const uint32_t TSS_STAT_BASIC   = 1;
 const uint32_t TSS_STAT_BUFFERS = 2;
@@ -78,6 +80,13 @@ struct PUMEX_EXPORT SurfaceTraits
   VkPresentModeKHR                   swapchainPresentMode;
   VkSurfaceTransformFlagBitsKHR      preTransform;
   VkCompositeAlphaFlagBitsKHR        compositeAlpha;
+  // number of frames rendered concurrently. Per frame resources are created for each frame in flight. 0 means one frame in flight for each swap chain image
+  uint32_t                           framesInFlight;
+  // streamed uploads ( whole content of existing buffers and images ) may be sent through separate transfer queue.
+  // Streamed data replaces previous content transferLatency frames later, so rendering never waits for the transfer
+  bool                               useTransferQueue;
+  QueueTraits                        transferQueueTraits;
+  uint32_t                           transferLatency;
 };
 
 // class representing a Vulkan surface
@@ -109,9 +118,27 @@ public:
   void                          resizeSurface(uint32_t newWidth, uint32_t newHeight);
   inline uint32_t               getImageCount() const;
   inline uint32_t               getImageIndex() const;
+  inline uint32_t               getFrameCount() const;
+  inline uint32_t               getFrameIndex() const;
 
   void                          setRenderWorkflow(std::shared_ptr<RenderWorkflow> workflow, std::shared_ptr<RenderWorkflowCompiler> compiler);
 
+  // Dynamic resolution : render passes with surface dependent attachments ( except render passes that render to swapchain images ) render only
+  // to the part of their attachments defined by resolution scale. Attachments keep their full size, so the workflow is not compiled again.
+  // Scale is updated after each frame, so that the render time reaches targetFrameTime. Shaders sampling such attachments should use getResolutionScale()
+  void                          setDynamicResolution(bool enabled, double targetFrameTime = 1.0 / 60.0, float minScale = 0.5f, float maxScale = 1.0f);
+  inline bool                   isDynamicResolutionEnabled() const;
+  // scale of the frame prepared by update thread. The same scale is used when that frame is rendered
+  float                         getResolutionScale() const;
+  // scale of the frame currently rendered
+  float                         getRenderResolutionScale() const;
+  // called by viewer with updateMutex locked : updateResolutionScale() before the update thread is woken up, storeResolutionScale() when update thread starts new frame
+  void                          updateResolutionScale(double renderTime);
+  void                          storeResolutionScale(uint32_t updateIndex);
+
+  // rate limited operations ( see RenderWorkflow::setRenderOperationUpdatePeriod() ) are recorded only in frames when they're updated
+  bool                          isOperationUpdated(const RenderOperation* operation) const;
+
   inline void                   setID(uint32_t newID);
   inline uint32_t               getID() const;
 
@@ -151,10 +178,13 @@ public:
 
   VkExtent2D                                    swapChainSize                = VkExtent2D{1,1};
   uint32_t                                      swapChainImageIndex          = 0;
+  uint32_t                                      frameIndex                   = 0;
   std::vector<std::shared_ptr<Image>>           swapChainImages;
 
   ActionQueue                                   actions;
   std::unique_ptr<TimeStatistics>               timeStatistics;
+  // uploads to device local memory gathered during validation. They're sent to the presentation queue before the frame
+  std::unique_ptr<UploadBatch>                  uploadBatch;
 
 protected:
   uint32_t                                      id                           = 0;
@@ -163,10 +193,19 @@ protected:
   bool                                          resized                      = false;
 
   std::vector<VkFence>                          waitFences;
+  std::vector<unsigned long long>               waitFrameNumbers;
+  std::vector<uint32_t>                         imageFrameIndices;  // frame in flight that last rendered to each swap chain image
+  std::shared_ptr<CommandBuffer>                uploadCommandBuffer;
   std::shared_ptr<CommandBuffer>                prepareCommandBuffer;
   std::vector<std::shared_ptr<CommandBuffer>>   primaryCommandBuffers;
   std::shared_ptr<CommandBuffer>                presentCommandBuffer;
 
+  std::shared_ptr<Queue>                        transferQueue;
+  std::shared_ptr<CommandPool>                  transferCommandPool;
+  std::shared_ptr<CommandBuffer>                transferCommandBuffer;
+  std::vector<VkSemaphore>                      transferCompleteSemaphores;
+  std::vector<unsigned long long>               transferFrameNumbers; // frame that submitted the transfer signaling transferCompleteSemaphores[i]
+
   std::vector<Node*>                            secondaryCommandBufferNodes;
   std::vector<VkRenderPass>                     secondaryCommandBufferRenderPasses;
   std::vector<uint32_t>                         secondaryCommandBufferSubPasses;
@@ -175,6 +214,34 @@ protected:
   std::vector<VkSemaphore>                      frameBufferReadySemaphores;
   std::vector<VkSemaphore>                      renderCompleteSemaphores;
   VkSemaphore                                   renderFinishedSemaphore      = VK_NULL_HANDLE;
+  // semaphores synchronizing workflow queues ( see RenderWorkflowResults::queueDependencies ) and uploads sent to other queues than presentation queue
+  std::vector<std::vector<VkSemaphore>>         queueSignalSemaphores;
+  std::vector<std::vector<VkSemaphore>>         queueWaitSemaphores;
+  std::vector<std::vector<VkPipelineStageFlags>> queueWaitStages;
+  std::vector<VkSemaphore>                      uploadCompleteSemaphores;
+
+  // workflow results may come back from workflow cache - their frame buffers need no rebuild if they were prepared for current swap chain
+  uint32_t                                      swapChainGeneration          = 0;
+  uint64_t                                      workflowCompilationNumber    = 0;
+  uint64_t                                      operationStateNumber         = 0;
+  // all rate limited operations are performed in the first frame after frame buffers were prepared
+  bool                                          updateAllOperations          = false;
+  // update states ( hashes of updated rate limited operations ) recorded in separate variants of primary command buffers. Empty when
+  // workflow has too many update states - then primary command buffer of a frame is built again when its update state changes
+  std::vector<std::size_t>                      operationUpdateStates;
+  uint32_t                                      operationUpdateStateIndex    = 0;
+  std::vector<std::size_t>                      frameUpdateStates;
+  std::vector<std::pair<std::weak_ptr<RenderWorkflowResults>, uint32_t>> preparedWorkflowResults;
+
+  bool                                          dynamicResolution            = false;
+  double                                        targetFrameTime              = 1.0 / 60.0;
+  float                                         minResolutionScale           = 0.5f;
+  float                                         maxResolutionScale           = 1.0f;
+  float                                         resolutionScale              = 1.0f;
+  float                                         frameResolutionScales[3]     = { 1.0f, 1.0f, 1.0f }; // scale of each update/render slot of the viewer
+  float                                         renderedResolutionScale      = 1.0f;                 // scale used by primary command buffers
+  double                                        averageFrameTime             = 0.0;
+  uint32_t                                      framesSinceScaleChange       = 0;
 
   std::function<void(std::shared_ptr<Surface>)> eventSurfaceRenderStart;
   std::function<void(std::shared_ptr<Surface>)> eventSurfaceRenderFinish;
@@ -182,13 +249,22 @@ protected:
 
   void                                          createSwapChain();
   bool                                          checkWorkflow();
+  void                                          createQueueSemaphores();
+  // finds all sets of rate limited operations that may be performed in a frame. Primary command buffers record separate variant for each set
+  void                                          createOperationUpdateStates();
+  void                                          setPrimaryVariantCount();
+  uint32_t                                      getPrimaryVariant() const;
+  void                                          destroyQueueSemaphores();
 };
 
 bool                         Surface::isRealized() const                                                               { return realized; }
 void                         Surface::setID(uint32_t newID)                                                            { id = newID; }
 uint32_t                     Surface::getID() const                                                                    { return id; }
-uint32_t                     Surface::getImageCount() const                                                            { return surfaceTraits.imageCount; }
+uint32_t                     Surface::getImageCount() const                                                            { return swapChainImages.empty() ? surfaceTraits.imageCount : static_cast<uint32_t>(swapChainImages.size()); }
 uint32_t                     Surface::getImageIndex() const                                                            { return swapChainImageIndex; }
+uint32_t                     Surface::getFrameCount() const                                                            { return (surfaceTraits.framesInFlight > 0) ? surfaceTraits.framesInFlight : surfaceTraits.imageCount; }
+uint32_t                     Surface::getFrameIndex() const                                                            { return frameIndex; }
+bool                         Surface::isDynamicResolutionEnabled() const                                               { return dynamicResolution; }
 void                         Surface::setEventSurfaceRenderStart(std::function<void(std::shared_ptr<Surface>)> event)  { eventSurfaceRenderStart = event; }
 void                         Surface::setEventSurfaceRenderFinish(std::function<void(std::shared_ptr<Surface>)> event) { eventSurfaceRenderFinish = event; }
 void                         Surface::setEventSurfacePrepareStatistics(std::function<void(Surface*, TimeStatistics*, TimeStatistics*)> event) { eventSurfacePrepareStatistics = event; }
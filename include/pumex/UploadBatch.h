@@ -0,0 +1,125 @@
+//
+// Copyright(c) 2017-2018 Paweł Księżopolski ( pumexx )
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <vulkan/vulkan.h>
+#include <pumex/Export.h>
+#include <pumex/Command.h>
+
+namespace pumex
+{
+
+class Device;
+class Image;
+class CommandBuffer;
+class StagingBuffer;
+
+// UploadBatch gathers uploads of data to device local buffers and images performed during frame validation.
+// All uploads are recorded into a single command buffer : copies between the same pair of buffers are merged into
+// multi-region calls and image layout transitions are sent in one barrier group before and one barrier group after the copies.
+// Staging buffers are released when the batch is recorded, so their memory is reused after the frame is retired.
+// Data of buffers and images relocated during defragmentation is copied by the same command buffer.
+// Uploads marked as streamed may be recorded separately by recordStreamed() and sent through a dedicated transfer queue
+class PUMEX_EXPORT UploadBatch
+{
+public:
+  UploadBatch()                              = default;
+  UploadBatch(const UploadBatch&)            = delete;
+  UploadBatch& operator=(const UploadBatch&) = delete;
+  UploadBatch(UploadBatch&&)                 = delete;
+  UploadBatch& operator=(UploadBatch&&)      = delete;
+
+  // number of frames between sending streamed uploads to the transfer queue and acquiring them by the frame. 0 means there's no transfer queue.
+  // Streamed data becomes visible to the frame with number frameNumber + streamLatency
+  inline void     setStreamLatency(uint32_t latency);
+  inline uint32_t getStreamLatency() const;
+
+  // region.srcOffset must already contain stagingBuffer->bufferOffset()
+  // streamed : destination is a new resource that will not be used until the frame acquires it ( see getStreamLatency() ), so upload may be sent through a transfer queue
+  void addBufferUpload(std::shared_ptr<StagingBuffer> stagingBuffer, VkBuffer dstBuffer, const VkBufferCopy& region, bool streamed = false);
+  // image is transitioned from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_GENERAL
+  void addImageUpload(std::shared_ptr<StagingBuffer> stagingBuffer, std::shared_ptr<Image> dstImage, VkImageAspectFlags aspectMask, const std::vector<VkBufferImageCopy>& regions, bool streamed = false);
+  // copies data of a relocated buffer. srcBuffer must not be destroyed until the frame is retired
+  void addBufferCopy(VkBuffer srcBuffer, VkBuffer dstBuffer, const VkBufferCopy& region);
+  // copies data of a relocated image. srcImage stays in VK_IMAGE_LAYOUT_GENERAL, dstImage is transitioned from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_GENERAL
+  void addImageCopy(std::shared_ptr<Image> srcImage, std::shared_ptr<Image> dstImage, VkImageAspectFlags aspectMask, const std::vector<VkImageCopy>& regions);
+  // buffer is about to be destroyed - its uploads and copies must not be recorded. Staging buffers of cancelled uploads are returned to the device
+  void cancelBufferUploads(Device* device, VkBuffer buffer);
+  // returns true when image waits for its uploads ( it is in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL during the copies )
+  bool hasImageUploads(VkImage image) const;
+  // returns true when there are no uploads to record ( acquires of streamed uploads are recorded only together with waiting for the transfer )
+  bool isEmpty() const;
+  bool hasStreamedUploads() const;
+
+  // records streamed uploads to commandBuffer of a transfer queue. When transferFamilyIndex differs from dstFamilyIndex, the ownership
+  // of all destinations is released to dstFamilyIndex and it is acquired by call to record() in frame frameNumber + streamLatency.
+  // Staging buffers are kept until that frame is retired
+  bool recordStreamed(Device* device, CommandBuffer* commandBuffer, unsigned long long frameNumber, uint32_t transferFamilyIndex, uint32_t dstFamilyIndex);
+  // records all remaining uploads and acquires of streamed uploads sent streamLatency frames ago to commandBuffer. Staging buffers are released with frameNumber.
+  // Returns false if there was nothing to record
+  bool record(Device* device, CommandBuffer* commandBuffer, unsigned long long frameNumber);
+  // drops all gathered uploads
+  void clear(Device* device);
+protected:
+  struct BufferUpload
+  {
+    std::shared_ptr<StagingBuffer> stagingBuffer; // nullptr for copies of relocated buffers
+    VkBuffer                       srcBuffer;
+    VkBuffer                       dstBuffer;
+    VkBufferCopy                   region;
+    bool                           streamed;
+  };
+  struct ImageUpload
+  {
+    std::shared_ptr<StagingBuffer> stagingBuffer;
+    std::shared_ptr<Image>         dstImage;
+    VkImageAspectFlags             aspectMask;
+    std::vector<VkBufferImageCopy> regions;
+    bool                           streamed;
+  };
+  struct ImageCopy
+  {
+    std::shared_ptr<Image>         srcImage;
+    std::shared_ptr<Image>         dstImage;
+    VkImageAspectFlags             aspectMask;
+    std::vector<VkImageCopy>       regions;
+  };
+
+  // staging buffers are released with frameNumber, acquires are recorded in frame frameNumber
+  bool recordUploads(Device* device, CommandBuffer* commandBuffer, unsigned long long frameNumber, const std::vector<BufferUpload>& buffers, const std::vector<ImageUpload>& images, const std::vector<ImageCopy>& copies, uint32_t srcFamilyIndex, uint32_t dstFamilyIndex);
+
+  std::vector<BufferUpload>                                    bufferUploads;
+  std::vector<ImageUpload>                                     imageUploads;
+  std::vector<ImageCopy>                                       imageCopies;
+  std::map<unsigned long long, std::vector<PipelineBarrier>>   acquireBarriers; // acquires sorted by frame number in which they are recorded
+  uint32_t                                                     streamLatency = 0;
+  mutable std::mutex                                           mutex;
+};
+
+void     UploadBatch::setStreamLatency(uint32_t latency) { streamLatency = latency; }
+uint32_t UploadBatch::getStreamLatency() const           { return streamLatency; }
+
+}
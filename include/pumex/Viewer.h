@@ -190,6 +190,7 @@ protected:
   unsigned long long                                     frameNumber                        = 0;
   HPClock::time_point                                    viewerStartTime;
   HPClock::time_point                                    renderStartTime;
+  HPClock::duration                                      renderDuration                     = HPClock::duration::zero(); // duration of last render
   HPClock::time_point                                    updateTimes[3];
   std::unique_ptr<TimeStatistics>                        timeStatistics;
 
@@ -23,6 +23,7 @@
 #pragma once
 #include <memory>
 #include <vector>
+#include <deque>
 #include <vulkan/vulkan.h>
 #include <pumex/Export.h>
 
@@ -57,11 +58,14 @@ PUMEX_EXPORT VkDeviceSize createBuffers(Device* device, std::vector<NBufferMemor
 PUMEX_EXPORT void         destroyBuffers(Device* device, std::vector<NBufferMemory>& multiBuffer, VkDeviceMemory memory);
 PUMEX_EXPORT void         destroyBuffers(VkDevice device, std::vector<NBufferMemory>& multiBuffer, VkDeviceMemory memory);
 
+// StagingBuffer is either a dedicated buffer with its own memory or a range of a buffer owned by StagingRing.
+// In both cases memory is persistently mapped, so remember to use bufferOffset() when copying from StagingBuffer::buffer
 class StagingBuffer
 {
 public:
   StagingBuffer()                                = delete;
   explicit StagingBuffer(Device* device, VkDeviceSize size);
+  explicit StagingBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, void* mappedPointer);
   StagingBuffer(const StagingBuffer&)            = delete;
   StagingBuffer& operator=(const StagingBuffer&) = delete;
   StagingBuffer(StagingBuffer&&)                 = delete;
@@ -70,27 +74,82 @@ public:
 
 
   inline VkDeviceSize bufferSize() const;
-  inline bool         isReserved() const;
-  inline void         setReserved(bool value);
+  inline VkDeviceSize bufferOffset() const;
+  inline bool         isDedicated() const;
 
-  // method that maps buffer memory, copies data and unmaps it
+  // method that copies data to buffer memory
   void  fillBuffer(const void* data, VkDeviceSize size);
   // methods for user to copy data by himself
   void* mapMemory(VkDeviceSize size);
   void  unmapMemory();
 
 
-  VkBuffer       buffer     = VK_NULL_HANDLE;
+  VkBuffer       buffer        = VK_NULL_HANDLE;
 protected:
-  VkDevice       device     = VK_NULL_HANDLE;
-  VkDeviceMemory memory     = VK_NULL_HANDLE;
-  VkDeviceSize   memorySize = 0;
-  bool           reserved   = false;
+  VkDevice       device        = VK_NULL_HANDLE;
+  VkDeviceMemory memory        = VK_NULL_HANDLE;
+  VkDeviceSize   memorySize    = 0;
+  VkDeviceSize   offset        = 0;
+  void*          mappedPointer = nullptr;
 };
 
-VkDeviceSize StagingBuffer::bufferSize() const { return memorySize; }
-bool         StagingBuffer::isReserved() const { return reserved; }
-void         StagingBuffer::setReserved(bool value) { reserved = value; }
+VkDeviceSize StagingBuffer::bufferSize() const   { return memorySize; }
+VkDeviceSize StagingBuffer::bufferOffset() const { return offset; }
+bool         StagingBuffer::isDedicated() const  { return memory != VK_NULL_HANDLE; }
+
+// StagingRing is a persistently mapped ring of host visible memory with size limited by budget. Ranges of the ring are
+// handed out as StagingBuffer objects and are reclaimed in allocation order, when they were released and the frame that used them
+// was retired by its fence. Uploads bigger than the budget, or uploads that do not fit while the ring is full, get a dedicated StagingBuffer.
+// StagingRing is not thread safe - Device guards it with its staging mutex
+class StagingRing
+{
+public:
+  StagingRing()                              = delete;
+  explicit StagingRing(Device* device, VkDeviceSize budget);
+  StagingRing(const StagingRing&)            = delete;
+  StagingRing& operator=(const StagingRing&) = delete;
+  StagingRing(StagingRing&&)                 = delete;
+  StagingRing& operator=(StagingRing&&)      = delete;
+  ~StagingRing();
+
+  std::shared_ptr<StagingBuffer> acquire(Device* device, VkDeviceSize size, VkDeviceSize alignment);
+  // frameNumber : buffer memory may be reused after that frame is retired. Value 0 means that GPU has finished using the buffer already
+  void                           release(std::shared_ptr<StagingBuffer> buffer, unsigned long long frameNumber);
+  void                           retireFrame(unsigned long long frameNumber);
+
+  inline VkDeviceSize            getBudget() const;
+  inline VkDeviceSize            getUsedSize() const;
+protected:
+  struct Range
+  {
+    Range(std::shared_ptr<StagingBuffer> b, VkDeviceSize re)
+      : buffer{ b }, rangeEnd{ re }
+    {
+    }
+    std::shared_ptr<StagingBuffer> buffer;
+    VkDeviceSize                   rangeEnd;
+    bool                           released    = false;
+    unsigned long long             frameNumber = 0;
+  };
+  void reclaim();
+
+  VkDevice                       device        = VK_NULL_HANDLE;
+  VkBuffer                       buffer        = VK_NULL_HANDLE;
+  VkDeviceMemory                 memory        = VK_NULL_HANDLE;
+  VkDeviceSize                   budget        = 0;
+  VkDeviceSize                   alignment     = 16;
+  unsigned char*                 mappedPointer = nullptr;
+  // ranges are stored in allocation order. Memory between tail and head is in use
+  std::deque<Range>              ranges;
+  VkDeviceSize                   head          = 0;
+  VkDeviceSize                   tail          = 0;
+  // released dedicated buffers waiting for retirement of a frame
+  std::deque<Range>              dedicatedBuffers;
+  unsigned long long             retiredFrame  = 0;
+};
+
+VkDeviceSize StagingRing::getBudget() const   { return budget; }
+VkDeviceSize StagingRing::getUsedSize() const { return ranges.empty() ? 0 : ( head > tail ? head - tail : budget - tail + head ); }
 
 
 
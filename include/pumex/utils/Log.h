@@ -50,6 +50,8 @@
 #define FLUSH_LOG  doLog(0.0f).flush();
 
 PUMEX_EXPORT std::string vulkanErrorString(VkResult errorCode);
+// escapes special characters, so that the text may be written as JSON string
+PUMEX_EXPORT std::string jsonEscape(const std::string& text);
 
 #define VK_CHECK_LOG_THROW( expression, loginfo ) \
 { \
@@ -221,9 +221,9 @@ void AssetBuffer::cmdBindVertexIndexBuffer(const RenderContext& renderContext, C
   }
   VkBuffer vBuffer = prmit->second.vertexBuffer->getHandleBuffer(renderContext);
   VkBuffer iBuffer = prmit->second.indexBuffer->getHandleBuffer(renderContext);
-  VkDeviceSize offsets = 0;
+  VkDeviceSize offsets = prmit->second.vertexBuffer->getBufferOffset(renderContext);
   vkCmdBindVertexBuffers(commandBuffer->getHandle(), vertexBinding, 1, &vBuffer, &offsets);
-  vkCmdBindIndexBuffer(commandBuffer->getHandle(), iBuffer, 0, VK_INDEX_TYPE_UINT32);
+  vkCmdBindIndexBuffer(commandBuffer->getHandle(), iBuffer, prmit->second.indexBuffer->getBufferOffset(renderContext), VK_INDEX_TYPE_UINT32);
 }
 
 void AssetBuffer::cmdDrawObject(const RenderContext& renderContext, CommandBuffer* commandBuffer, uint32_t renderMask, uint32_t typeID, uint32_t firstInstance, float distanceToViewer) const
@@ -263,16 +263,17 @@ void AssetBuffer::cmdDrawObjectsIndirect(const RenderContext& renderContext, Com
 {
   std::lock_guard<std::mutex> lock(mutex);
 
-  auto buffer = drawCommands->getHandleBuffer(renderContext);
+  auto buffer       = drawCommands->getHandleBuffer(renderContext);
+  auto bufferOffset = drawCommands->getBufferOffset(renderContext);
 
   uint32_t drawCount = drawCommands->getData()->size();
 
   if (renderContext.device->physical.lock()->features.multiDrawIndirect == 1)
-    commandBuffer->cmdDrawIndexedIndirect(buffer, 0, drawCount, sizeof(DrawIndexedIndirectCommand));
+    commandBuffer->cmdDrawIndexedIndirect(buffer, bufferOffset, drawCount, sizeof(DrawIndexedIndirectCommand));
   else
   {
     for (uint32_t i = 0; i < drawCount; ++i)
-      commandBuffer->cmdDrawIndexedIndirect(buffer, 0 + i * sizeof(DrawIndexedIndirectCommand), 1, sizeof(DrawIndexedIndirectCommand));
+      commandBuffer->cmdDrawIndexedIndirect(buffer, bufferOffset + i * sizeof(DrawIndexedIndirectCommand), 1, sizeof(DrawIndexedIndirectCommand));
   }
 }
 
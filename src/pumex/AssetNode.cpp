@@ -67,8 +67,8 @@ void AssetNode::cmdDraw(const RenderContext& renderContext, CommandBuffer* comma
   commandBuffer->addSource(this);
   VkBuffer vBuffer = vertexBuffer->getHandleBuffer(renderContext);
   VkBuffer iBuffer = indexBuffer->getHandleBuffer(renderContext);
-  VkDeviceSize offsets = 0;
+  VkDeviceSize offsets = vertexBuffer->getBufferOffset(renderContext);
   vkCmdBindVertexBuffers(commandBuffer->getHandle(), vertexBinding, 1, &vBuffer, &offsets);
-  vkCmdBindIndexBuffer(commandBuffer->getHandle(), iBuffer, 0, VK_INDEX_TYPE_UINT32);
+  vkCmdBindIndexBuffer(commandBuffer->getHandle(), iBuffer, indexBuffer->getBufferOffset(renderContext), VK_INDEX_TYPE_UINT32);
   commandBuffer->cmdDrawIndexed(indices->size(), 1, 0, 0, 0);
 }
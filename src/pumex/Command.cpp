@@ -69,7 +69,7 @@ VkCommandPool CommandPool::getHandle(VkDevice device) const
 }
 
 CommandBuffer::CommandBuffer(VkCommandBufferLevel bf, Device* d, std::shared_ptr<CommandPool> cp, uint32_t cbc)
-  : bufferLevel{ bf }, commandPool{ cp }, device{ d->device }
+  : bufferLevel{ bf }, commandPool{ cp }, device{ d->device }, activeCount{ cbc }
 {
   commandBuffer.resize(cbc);
   VkCommandBufferAllocateInfo cmdBufAllocateInfo{};
@@ -87,12 +87,33 @@ CommandBuffer::~CommandBuffer()
   vkFreeCommandBuffers(device, commandPool.lock()->getHandle(device), commandBuffer.size(), commandBuffer.data());
 }
 
+void CommandBuffer::setVariantCount(uint32_t vc)
+{
+  if (vc == 0 || vc == variantCount)
+    return;
+  vkFreeCommandBuffers(device, commandPool.lock()->getHandle(device), commandBuffer.size(), commandBuffer.data());
+  variantCount = vc;
+  commandBuffer.resize(activeCount * variantCount);
+  VkCommandBufferAllocateInfo cmdBufAllocateInfo{};
+    cmdBufAllocateInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdBufAllocateInfo.commandPool        = commandPool.lock()->getHandle(device);
+    cmdBufAllocateInfo.level              = bufferLevel;
+    cmdBufAllocateInfo.commandBufferCount = commandBuffer.size();
+  VK_CHECK_LOG_THROW(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, commandBuffer.data()), "failed vkAllocateCommandBuffers");
+  valid.assign(commandBuffer.size(), false);
+  activeIndex = 0;
+}
+
 void CommandBuffer::invalidate(uint32_t index)
 {
   if (index == std::numeric_limits<uint32_t>::max())
     std::fill(begin(valid), end(valid), false);
   else
-    valid[index % commandBuffer.size()] = false;
+  {
+    // all variants of the index must be recorded again
+    for (uint32_t i = index % activeCount; i < valid.size(); i += activeCount)
+      valid[i] = false;
+  }
 }
 
 void CommandBuffer::addSource(CommandBufferSource* source)
@@ -226,6 +247,20 @@ void CommandBuffer::cmdPipelineBarrier(const RenderContext& renderContext, const
 
   for (const auto& b : barriers)
   {
+    // barriers transferring resources between workflow queues store queue indices - find queue families
+    uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    if (b.srcQueueIndex != b.dstQueueIndex)
+    {
+      srcQueueFamilyIndex = renderContext.surface->queues[b.srcQueueIndex]->familyIndex;
+      dstQueueFamilyIndex = renderContext.surface->queues[b.dstQueueIndex]->familyIndex;
+      // queues from the same family need no ownership transfer : semaphore between queues is enough, and layout transition is done by acquiring barrier
+      if (srcQueueFamilyIndex == dstQueueFamilyIndex)
+      {
+        if (b.dstAccessMask == 0)
+          continue;
+        srcQueueFamilyIndex = dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      }
+    }
     switch (b.objectType)
     {
     case MemoryObject::moBuffer:
@@ -236,10 +271,10 @@ void CommandBuffer::cmdPipelineBarrier(const RenderContext& renderContext, const
         bufferBarrier.pNext               = nullptr;
         bufferBarrier.srcAccessMask       = b.srcAccessMask;
         bufferBarrier.dstAccessMask       = b.dstAccessMask;
-        bufferBarrier.srcQueueFamilyIndex = b.srcQueueFamilyIndex;
-        bufferBarrier.dstQueueFamilyIndex = b.dstQueueFamilyIndex;
+        bufferBarrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+        bufferBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
         bufferBarrier.buffer              = memoryBuffer->getHandleBuffer(renderContext);
-        bufferBarrier.offset              = b.bufferRange.offset;
+        bufferBarrier.offset              = memoryBuffer->getBufferOffset(renderContext) + b.bufferRange.offset;
         bufferBarrier.size                = b.bufferRange.range;
       bufferBarriers.emplace_back(bufferBarrier);
       break;
@@ -252,8 +287,8 @@ void CommandBuffer::cmdPipelineBarrier(const RenderContext& renderContext, const
         imageBarrier.pNext               = nullptr;
         imageBarrier.srcAccessMask       = b.srcAccessMask;
         imageBarrier.dstAccessMask       = b.dstAccessMask;
-        imageBarrier.srcQueueFamilyIndex = b.srcQueueFamilyIndex;
-        imageBarrier.dstQueueFamilyIndex = b.dstQueueFamilyIndex;
+        imageBarrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+        imageBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
         imageBarrier.oldLayout           = b.oldLayout;
         imageBarrier.newLayout           = b.newLayout;
         imageBarrier.image               = memoryImage->getImage(renderContext)->getHandleImage();
@@ -265,6 +300,8 @@ void CommandBuffer::cmdPipelineBarrier(const RenderContext& renderContext, const
       break;
     }
   }
+  if (bufferBarriers.empty() && imageBarriers.empty())
+    return;
   vkCmdPipelineBarrier(commandBuffer[activeIndex], barrierGroup.srcStageMask, barrierGroup.dstStageMask, barrierGroup.dependencyFlags,
     memoryBarriers.size(), memoryBarriers.data(), bufferBarriers.size(), bufferBarriers.data(), imageBarriers.size(), imageBarriers.data());
 }
@@ -336,6 +373,11 @@ void CommandBuffer::cmdCopyBufferToImage(VkBuffer srcBuffer, const Image& image,
   vkCmdCopyBufferToImage(commandBuffer[activeIndex], srcBuffer, image.getHandleImage(), dstImageLayout, regions.size(), regions.data());
 }
 
+void CommandBuffer::cmdCopyImage(const Image& srcImage, VkImageLayout srcImageLayout, const Image& dstImage, VkImageLayout dstImageLayout, const std::vector<VkImageCopy>& regions) const
+{
+  vkCmdCopyImage(commandBuffer[activeIndex], srcImage.getHandleImage(), srcImageLayout, dstImage.getHandleImage(), dstImageLayout, regions.size(), regions.data());
+}
+
 void CommandBuffer::cmdClearColorImage(const Image& image, VkImageLayout imageLayout, VkClearValue color, std::vector<VkImageSubresourceRange> subresourceRanges)
 {
   vkCmdClearColorImage(commandBuffer[activeIndex], image.getHandleImage(), imageLayout, &color.color, subresourceRanges.size(), subresourceRanges.data());
@@ -94,7 +94,7 @@ DescriptorPool::~DescriptorPool()
 
     if (poolDefinitions[index].maxSets == 0)
     {
-      uint32_t poolSize = poolDefinitions[index].registeredDescriptorSets * renderContext.imageCount * renderContext.surface->viewer.lock()->getNumSurfaces();
+      uint32_t poolSize = poolDefinitions[index].registeredDescriptorSets * renderContext.activeCount * renderContext.surface->viewer.lock()->getNumSurfaces();
       std::vector<VkDescriptorPoolSize> poolSizes = poolDefinitions[index].layout->getDescriptorPoolSize(poolSize);
       VkDescriptorPoolCreateInfo descriptorPoolCI{};
         descriptorPoolCI.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -300,9 +300,9 @@ void DescriptorSet::validate( const RenderContext& renderContext )
 
   // now check if descriptor set is dirty
   std::lock_guard<std::mutex> lock(mutex);
-  if (renderContext.imageCount > activeCount)
+  if (renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perObjectData)
       pdd.second.resize(activeCount);
   }
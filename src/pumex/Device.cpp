@@ -22,10 +22,12 @@
 
 #include <pumex/Device.h>
 #include <iterator>
+#include <algorithm>
 #include <pumex/Viewer.h>
 #include <pumex/PhysicalDevice.h>
 #include <pumex/Command.h>
 #include <pumex/Descriptor.h>
+#include <pumex/DeviceMemoryAllocator.h>
 #include <pumex/utils/Log.h>
 #include <pumex/utils/Buffer.h>
 
@@ -168,7 +170,7 @@ void Device::cleanup()
 {
   if (device != VK_NULL_HANDLE)
   {
-    stagingBuffers.clear();
+    stagingRing    = nullptr;
     descriptorPool = nullptr;
     vkDestroyDevice(device, nullptr);
     device = VK_NULL_HANDLE;
@@ -206,41 +208,98 @@ std::shared_ptr<DescriptorPool> Device::getDescriptorPool()
   return descriptorPool;
 }
 
-std::shared_ptr<StagingBuffer> Device::acquireStagingBuffer(const void* data, VkDeviceSize size)
+std::shared_ptr<StagingBuffer> Device::acquireStagingBuffer(const void* data, VkDeviceSize size, VkDeviceSize alignment)
 {
-  // find smallest staging buffer that is able to transfer data
-  VkDeviceSize smallestSize = std::numeric_limits<VkDeviceSize>::max();
   std::shared_ptr<StagingBuffer> resultBuffer;
+  {
+    std::lock_guard<std::mutex> lock(stagingMutex);
+    if (stagingRing.get() == nullptr)
+      stagingRing = std::make_unique<StagingRing>(this, stagingBudget);
+    resultBuffer = stagingRing->acquire(this, size, alignment);
+  }
+  // memory is persistently mapped, so data may be copied without holding the lock
+  if (data != nullptr)
+    resultBuffer->fillBuffer(data, size);
+  return resultBuffer;
+}
 
+void Device::releaseStagingBuffer(std::shared_ptr<StagingBuffer> buffer, unsigned long long frameNumber)
+{
   std::lock_guard<std::mutex> lock(stagingMutex);
-  for (auto it = begin(stagingBuffers); it != end(stagingBuffers); ++it)
+  if (stagingRing.get() != nullptr)
+    stagingRing->release(buffer, frameNumber);
+}
+
+void Device::addAllocatorToFlush(std::shared_ptr<DeviceMemoryAllocator> allocator)
+{
+  std::lock_guard<std::mutex> lock(flushMutex);
+  auto it = std::find_if(begin(allocatorsToFlush), end(allocatorsToFlush), [&allocator](std::weak_ptr<DeviceMemoryAllocator> a) { return a.lock() == allocator; });
+  if (it == end(allocatorsToFlush))
+    allocatorsToFlush.push_back(allocator);
+}
+
+void Device::addFrameAllocator(std::shared_ptr<DeviceMemoryAllocator> allocator)
+{
+  std::lock_guard<std::mutex> lock(frameMutex);
+  auto it = std::find_if(begin(frameAllocators), end(frameAllocators), [&allocator](std::weak_ptr<DeviceMemoryAllocator> a) { return a.lock() == allocator; });
+  if (it == end(frameAllocators))
+    frameAllocators.push_back(allocator);
+}
+
+void Device::beginFrame(unsigned long long frameNumber)
+{
+  std::vector<std::weak_ptr<DeviceMemoryAllocator>> allocators;
   {
-    if ( (*it)->isReserved() || (*it)->bufferSize() < size)
-      continue;
-    if ((*it)->bufferSize() < smallestSize)
-    {
-      smallestSize = (*it)->bufferSize();
-      resultBuffer = *it;
-    }
+    std::lock_guard<std::mutex> lock(frameMutex);
+    allocators = frameAllocators;
   }
-  if (resultBuffer.get() == nullptr)
+  for (auto& a : allocators)
   {
-    resultBuffer = std::make_shared<StagingBuffer>( this, size );
-    stagingBuffers.push_back(resultBuffer);
+    auto allocator = a.lock();
+    if (allocator.get() != nullptr)
+      allocator->beginFrame(device, frameNumber);
   }
-  resultBuffer->setReserved(true);
-  if (data != nullptr)
+}
+
+void Device::retireFrame(VkSurfaceKHR surface, unsigned long long frameNumber)
+{
+  std::vector<std::weak_ptr<DeviceMemoryAllocator>> allocators;
+  unsigned long long retiredFrame;
   {
-    resultBuffer->fillBuffer(data, size);
+    std::lock_guard<std::mutex> lock(frameMutex);
+    retiredFrames[surface] = frameNumber;
+    retiredFrame = frameNumber;
+    for (const auto& rf : retiredFrames)
+      retiredFrame = std::min(retiredFrame, rf.second);
+    frameAllocators.erase(std::remove_if(begin(frameAllocators), end(frameAllocators), [](std::weak_ptr<DeviceMemoryAllocator> a) { return a.expired(); }), end(frameAllocators));
+    allocators = frameAllocators;
+  }
+  {
+    std::lock_guard<std::mutex> lock(stagingMutex);
+    if (stagingRing.get() != nullptr)
+      stagingRing->retireFrame(retiredFrame);
+  }
+  for (auto& a : allocators)
+  {
+    auto allocator = a.lock();
+    if (allocator.get() != nullptr)
+      allocator->retireFrame(device, retiredFrame);
   }
-  return resultBuffer;
-
 }
 
-void Device::releaseStagingBuffer(std::shared_ptr<StagingBuffer> buffer)
+void Device::flushMappedMemory()
 {
-  std::lock_guard<std::mutex> lock(stagingMutex);
-  buffer->setReserved(false);
+  std::vector<std::weak_ptr<DeviceMemoryAllocator>> allocators;
+  {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    allocators.swap(allocatorsToFlush);
+  }
+  for (auto& a : allocators)
+  {
+    auto allocator = a.lock();
+    if (allocator.get() != nullptr)
+      allocator->flushMappedMemory(device);
+  }
 }
 
 bool Device::deviceExtensionEnabled(const char* extensionName) const
@@ -21,6 +21,12 @@
 //
 
 #include <cstring>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
 #include <pumex/DeviceMemoryAllocator.h>
 #include <pumex/Device.h>
 #include <pumex/PhysicalDevice.h>
@@ -29,12 +35,12 @@
 using namespace pumex;
 
 DeviceMemoryBlock::DeviceMemoryBlock()
-  : memory{ VK_NULL_HANDLE }, realOffset{ 0 }, alignedOffset{ 0 }, realSize{ 0 }, alignedSize{ 0 }
+  : memory{ VK_NULL_HANDLE }, realOffset{ 0 }, alignedOffset{ 0 }, realSize{ 0 }, alignedSize{ 0 }, blockIndex{ 0 }, mappedPointer{ nullptr }
 {
 }
 
 DeviceMemoryBlock::DeviceMemoryBlock(VkDeviceMemory m, VkDeviceSize ro, VkDeviceSize ao, VkDeviceSize rs, VkDeviceSize as)
-  : memory{ m }, realOffset{ ro }, alignedOffset{ ao }, realSize{ rs }, alignedSize{ as }
+  : memory{ m }, realOffset{ ro }, alignedOffset{ ao }, realSize{ rs }, alignedSize{ as }, blockIndex{ 0 }, mappedPointer{ nullptr }
 {
 }
 
@@ -47,77 +53,525 @@ AllocationStrategy::~AllocationStrategy()
 {
 }
 
-DeviceMemoryAllocator::DeviceMemoryAllocator(VkMemoryPropertyFlags pf, VkDeviceSize s, EnumStrategy st)
-  : propertyFlags{ pf }, size{ s }
+void AllocationStrategy::beginFrame(unsigned long long frameNumber)
+{
+}
+
+void AllocationStrategy::retireFrame(unsigned long long frameNumber)
+{
+}
+
+void AllocationStrategy::setFrameSlot(uint32_t frameSlot, uint32_t frameSlotCount)
+{
+}
+
+DeviceMemoryAllocator::DeviceMemoryAllocator(VkMemoryPropertyFlags pf, VkDeviceSize s, EnumStrategy st, VkDeviceSize ms, double gp)
+  : propertyFlags{ pf }, size{ s }, maxSize{ std::max(s, ms) }, emptyBlockGracePeriod{ gp }, strategy{ st }, defragmenting{ false }
 {
-  switch (st)
-  {
-  case FIRST_FIT: allocationStrategy = std::make_unique<FirstFitAllocationStrategy>(); break;
-  }
 }
 
 DeviceMemoryAllocator::~DeviceMemoryAllocator()
 {
   for (auto& pddit : perDeviceData)
-    vkFreeMemory(pddit.first, pddit.second.storageMemory, nullptr);
+  {
+    for (auto& mb : pddit.second.memoryBlocks)
+    {
+      if (mb.storageMemory == VK_NULL_HANDLE)
+        continue;
+      for (auto& bb : mb.blockBuffers)
+        vkDestroyBuffer(pddit.first, bb.second, nullptr);
+      if (mb.mappedMemory != nullptr)
+        vkUnmapMemory(pddit.first, mb.storageMemory);
+      vkFreeMemory(pddit.first, mb.storageMemory, nullptr);
+    }
+  }
 }
 
-DeviceMemoryBlock DeviceMemoryAllocator::allocate(Device* device, VkMemoryRequirements memoryRequirements)
+DeviceMemoryBlock DeviceMemoryAllocator::allocate(Device* device, VkMemoryRequirements memoryRequirements, const std::string& name, uint32_t frameSlot, uint32_t frameSlotCount)
 {
   std::lock_guard<std::mutex> lock(mutex);
   auto pddit = perDeviceData.find(device->device);
   if (pddit == end(perDeviceData))
     pddit = perDeviceData.insert({ device->device, PerDeviceData() }).first;
-  if (pddit->second.storageMemory == VK_NULL_HANDLE)
+  auto& pdd = pddit->second;
+
+  // try to place data in existing blocks
+  DeviceMemoryBlock block;
+  for (uint32_t i = 0; i < pdd.memoryBlocks.size(); ++i)
   {
-    VkMemoryAllocateInfo memAlloc{};
-      memAlloc.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-      memAlloc.allocationSize  = size;
-      memAlloc.memoryTypeIndex = device->physical.lock()->getMemoryType(memoryRequirements.memoryTypeBits, propertyFlags);
-    VK_CHECK_LOG_THROW(vkAllocateMemory(device->device, &memAlloc, nullptr, &pddit->second.storageMemory), "Cannot allocate memory in DeviceMemoryAllocator");
-    pddit->second.freeBlocks.push_front(FreeBlock(0, size));
+    auto& mb = pdd.memoryBlocks[i];
+    if (mb.storageMemory == VK_NULL_HANDLE || mb.size < memoryRequirements.size)
+      continue;
+    mb.allocationStrategy->setFrameSlot(frameSlot, frameSlotCount);
+    block = mb.allocationStrategy->allocate(mb.storageMemory, memoryRequirements);
+    if (block.alignedSize == 0)
+      continue;
+    registerAllocation(pdd, block, i, name);
+    return block;
   }
-  return allocationStrategy->allocate(pddit->second.storageMemory, pddit->second.freeBlocks, memoryRequirements);
+
+  // all blocks are full - create a new one. Data that does not fit into standard block gets its own block ( RING block must store it in each frame slot )
+  VkDeviceSize blockSize = std::max(size, (memoryRequirements.size + std::max<VkDeviceSize>(1, memoryRequirements.alignment) - 1) * ((strategy == RING) ? std::max(frameSlotCount, 1u) : 1u));
+  if (pdd.allocatedSize + blockSize > maxSize)
+    releaseEmptyBlocks(device->device, pdd, true);
+  CHECK_LOG_THROW(pdd.allocatedSize + blockSize > maxSize, "memory allocation failed : " << memoryRequirements.size << " ( allocator is full : " << pdd.allocatedSize << " / " << maxSize << " bytes )");
+  uint32_t blockIndex = createMemoryBlock(device, pdd, blockSize, memoryRequirements.memoryTypeBits);
+  auto& mb = pdd.memoryBlocks[blockIndex];
+  mb.allocationStrategy->setFrameSlot(frameSlot, frameSlotCount);
+  block = mb.allocationStrategy->allocate(mb.storageMemory, memoryRequirements);
+  CHECK_LOG_THROW(block.alignedSize == 0, "memory allocation failed : " << memoryRequirements.size);
+  registerAllocation(pdd, block, blockIndex, name);
+  return block;
+}
+
+void DeviceMemoryAllocator::registerAllocation(PerDeviceData& pdd, DeviceMemoryBlock& block, uint32_t blockIndex, const std::string& name)
+{
+  auto& mb            = pdd.memoryBlocks[blockIndex];
+  block.blockIndex    = blockIndex;
+  block.mappedPointer = (mb.mappedMemory != nullptr) ? mb.mappedMemory + block.alignedOffset : nullptr;
+  mb.allocationCount++;
+  mb.allocations[block.alignedOffset] = AllocationInfo{ block.alignedSize, name };
+  pdd.usedSize     += block.alignedSize;
+  pdd.peakUsedSize  = std::max(pdd.peakUsedSize, pdd.usedSize);
 }
 
 void DeviceMemoryAllocator::deallocate(VkDevice device, const DeviceMemoryBlock& block)
 {
+  // objects that were never allocated may send empty blocks here
+  if (block.alignedSize == 0)
+    return;
   std::lock_guard<std::mutex> lock(mutex);
   auto pddit = perDeviceData.find(device);
   CHECK_LOG_THROW(pddit == end(perDeviceData), "Cannot deallocate memory - device memory was never allocated");
-  allocationStrategy->deallocate(pddit->second.freeBlocks, block);
+  CHECK_LOG_THROW(block.blockIndex >= pddit->second.memoryBlocks.size() || pddit->second.memoryBlocks[block.blockIndex].storageMemory != block.memory, "Cannot deallocate memory - block does not belong to this allocator");
+  auto& mb = pddit->second.memoryBlocks[block.blockIndex];
+  mb.allocationStrategy->deallocate(block);
+  mb.allocations.erase(block.alignedOffset);
+  // ring memory may still be read by frames in flight - it is counted as used until current frame retires
+  if (strategy == RING)
+  {
+    mb.retiringAllocations.push_back(RetiringAllocation{ pddit->second.currentFrame, block.alignedSize });
+    return;
+  }
+  mb.allocationCount--;
+  pddit->second.usedSize -= block.alignedSize;
+  if (mb.allocationCount == 0)
+    mb.emptySince = HPClock::now();
+  releaseEmptyBlocks(device, pddit->second, false);
 }
 
-void DeviceMemoryAllocator::copyToDeviceMemory(Device* device, VkDeviceSize offset, const void* data, VkDeviceSize size, VkMemoryMapFlags flags)
+void DeviceMemoryAllocator::releaseEmptyBlocks(VkDevice device, bool ignoreGracePeriod)
 {
-  if (size == 0)
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
+    return;
+  releaseEmptyBlocks(device, pddit->second, ignoreGracePeriod);
+}
+
+void DeviceMemoryAllocator::beginFrame(VkDevice device, unsigned long long frameNumber)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
     return;
+  pddit->second.currentFrame = frameNumber;
+  for (auto& mb : pddit->second.memoryBlocks)
+    if (mb.allocationStrategy != nullptr)
+      mb.allocationStrategy->beginFrame(frameNumber);
+}
+
+void DeviceMemoryAllocator::retireFrame(VkDevice device, unsigned long long frameNumber)
+{
   std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
+    return;
+  auto now = HPClock::now();
+  for (auto& mb : pddit->second.memoryBlocks)
+  {
+    if (mb.allocationStrategy == nullptr)
+      continue;
+    mb.allocationStrategy->retireFrame(frameNumber);
+    if (mb.retiringAllocations.empty())
+      continue;
+    while (!mb.retiringAllocations.empty() && mb.retiringAllocations.front().frameNumber <= frameNumber)
+    {
+      mb.allocationCount--;
+      pddit->second.usedSize -= mb.retiringAllocations.front().alignedSize;
+      mb.retiringAllocations.pop_front();
+    }
+    if (mb.allocationCount == 0)
+      mb.emptySince = now;
+  }
+  releaseEmptyBlocks(device, pddit->second, false);
+}
+
+void DeviceMemoryAllocator::defragment(VkDeviceSize maxBytesPerFrame)
+{
+  // memory allocated from a ring is released every frame - there's nothing to defragment
+  if (strategy == RING)
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  defragmentationBudget = maxBytesPerFrame;
+  defragmentationMoved  = 0;
+  defragmentationFrame  = 0;
+  defragmenting         = true;
+}
+
+DeviceMemoryBlock DeviceMemoryAllocator::relocate(Device* device, unsigned long long frameNumber, const DeviceMemoryBlock& block, VkMemoryRequirements memoryRequirements)
+{
+  if (!defragmenting || block.alignedSize == 0)
+    return DeviceMemoryBlock();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (frameNumber != defragmentationFrame)
+  {
+    // nothing was moved during previous frame - memory is as compact as it can be
+    if (defragmentationFrame != 0 && defragmentationMoved == 0)
+    {
+      defragmenting = false;
+      return DeviceMemoryBlock();
+    }
+    defragmentationFrame = frameNumber;
+    defragmentationMoved = 0;
+  }
+  // at least one allocation is moved in each frame, even when it is bigger than the budget
+  if (defragmentationMoved > 0 && defragmentationMoved + block.alignedSize > defragmentationBudget)
+    return DeviceMemoryBlock();
+
   auto pddit = perDeviceData.find(device->device);
-  CHECK_LOG_THROW(pddit == end(perDeviceData), "DeviceMemoryAllocator::copyToDeviceMemory() : cannot copy to memory that not have been allocated yet");
-  uint8_t *pData;
-  VK_CHECK_LOG_THROW(vkMapMemory(device->device, pddit->second.storageMemory, offset, size, 0, (void **)&pData), "Cannot map memory");
-  std::memcpy(pData, data, size);
-  vkUnmapMemory(device->device, pddit->second.storageMemory);
+  if (pddit == end(perDeviceData) || block.blockIndex >= pddit->second.memoryBlocks.size())
+    return DeviceMemoryBlock();
+  auto& pdd = pddit->second;
+  // relocated data keeps its name
+  auto ait         = pdd.memoryBlocks[block.blockIndex].allocations.find(block.alignedOffset);
+  std::string name = (ait != end(pdd.memoryBlocks[block.blockIndex].allocations)) ? ait->second.name : std::string();
+  for (uint32_t i = 0; i <= block.blockIndex; ++i)
+  {
+    auto& mb = pdd.memoryBlocks[i];
+    if (mb.storageMemory == VK_NULL_HANDLE || mb.size < memoryRequirements.size)
+      continue;
+    DeviceMemoryBlock newBlock = mb.allocationStrategy->allocate(mb.storageMemory, memoryRequirements);
+    if (newBlock.alignedSize == 0)
+      continue;
+    // data stays in the same memory block - it is only worth moving when it goes closer to the beginning of the memory
+    if (i == block.blockIndex && newBlock.alignedOffset >= block.alignedOffset)
+    {
+      mb.allocationStrategy->deallocate(newBlock);
+      break;
+    }
+    registerAllocation(pdd, newBlock, i, name);
+    defragmentationMoved += block.alignedSize;
+    return newBlock;
+  }
+  return DeviceMemoryBlock();
 }
 
-void DeviceMemoryAllocator::bindBufferMemory(Device* device, VkBuffer buffer, VkDeviceSize offset)
+void DeviceMemoryAllocator::copyToDeviceMemory(Device* device, const DeviceMemoryBlock& block, VkDeviceSize offset, const void* data, VkDeviceSize size, VkMemoryMapFlags flags)
+{
+  if (size == 0)
+    return;
+  CHECK_LOG_THROW(block.mappedPointer == nullptr, "DeviceMemoryAllocator::copyToDeviceMemory() : memory is not host visible or was not allocated yet");
+  std::memcpy(static_cast<uint8_t*>(block.mappedPointer) + offset, data, size);
+  if (!isHostCoherent())
+  {
+    addRangeToFlush(device->device, block, offset, size);
+    device->addAllocatorToFlush(shared_from_this());
+  }
+}
+
+void DeviceMemoryAllocator::bindBufferMemory(Device* device, VkBuffer buffer, const DeviceMemoryBlock& block)
 {
   std::lock_guard<std::mutex> lock(mutex);
   auto pddit = perDeviceData.find(device->device);
   CHECK_LOG_THROW(pddit == end(perDeviceData), "DeviceMemoryAllocator::bindBufferMemory() : cannot bind memory that not have been allocated yet");
-  VK_CHECK_LOG_THROW(vkBindBufferMemory(device->device, buffer, pddit->second.storageMemory, offset), "Cannot bind memory to buffer");
+  VK_CHECK_LOG_THROW(vkBindBufferMemory(device->device, buffer, block.memory, block.alignedOffset), "Cannot bind memory to buffer");
 }
 
-FirstFitAllocationStrategy::FirstFitAllocationStrategy()
+VkBuffer DeviceMemoryAllocator::getMemoryBlockBuffer(Device* device, const DeviceMemoryBlock& block, VkBufferUsageFlags usage)
 {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device->device);
+  CHECK_LOG_THROW(pddit == end(perDeviceData), "DeviceMemoryAllocator::getMemoryBlockBuffer() : memory was not allocated yet");
+  CHECK_LOG_THROW(block.blockIndex >= pddit->second.memoryBlocks.size() || pddit->second.memoryBlocks[block.blockIndex].storageMemory != block.memory, "DeviceMemoryAllocator::getMemoryBlockBuffer() : block does not belong to this allocator");
+  auto& mb = pddit->second.memoryBlocks[block.blockIndex];
+  auto bbit = mb.blockBuffers.find(usage);
+  if (bbit != end(mb.blockBuffers))
+    return bbit->second;
+
+  VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.usage = usage;
+    bufferCreateInfo.size  = mb.size;
+  VkBuffer buffer;
+  VK_CHECK_LOG_THROW(vkCreateBuffer(device->device, &bufferCreateInfo, nullptr, &buffer), "Cannot create a buffer");
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(device->device, buffer, &memReqs);
+  if (memReqs.size > mb.size)
+  {
+    vkDestroyBuffer(device->device, buffer, nullptr);
+    CHECK_LOG_THROW(true, "DeviceMemoryAllocator::getMemoryBlockBuffer() : buffer requires more memory than memory block has : " << memReqs.size << " > " << mb.size);
+  }
+  VK_CHECK_LOG_THROW(vkBindBufferMemory(device->device, buffer, mb.storageMemory, 0), "Cannot bind memory to buffer");
+  mb.blockBuffers.insert({ usage, buffer });
+  return buffer;
+}
+
+void DeviceMemoryAllocator::addRangeToFlush(VkDevice device, const DeviceMemoryBlock& block, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (isHostCoherent() || size == 0)
+    return;
+  VkMappedMemoryRange range{};
+    range.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = block.memory;
+    range.offset = block.alignedOffset + offset;
+    range.size   = size;
+  std::lock_guard<std::mutex> lock(flushMutex);
+  pendingFlushes[device].push_back(range);
+}
+
+void DeviceMemoryAllocator::flushMappedMemory(VkDevice device)
+{
+  std::vector<VkMappedMemoryRange> ranges;
+  {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    auto fit = pendingFlushes.find(device);
+    if (fit == end(pendingFlushes) || fit->second.empty())
+      return;
+    ranges.swap(fit->second);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
+    return;
+  // ranges must be aligned to nonCoherentAtomSize ( memory blocks have sizes aligned to it, so aligned range never crosses the end of memory )
+  VkDeviceSize atomSize = pddit->second.nonCoherentAtomSize;
+  for (auto& range : ranges)
+  {
+    VkDeviceSize rangeEnd = ((range.offset + range.size + atomSize - 1) / atomSize) * atomSize;
+    range.offset          = (range.offset / atomSize) * atomSize;
+    range.size            = rangeEnd - range.offset;
+  }
+  // merge overlapping ranges, skip ranges from released memory blocks
+  std::sort(begin(ranges), end(ranges), [](const VkMappedMemoryRange& lhs, const VkMappedMemoryRange& rhs) { return (lhs.memory < rhs.memory) || (lhs.memory == rhs.memory && lhs.offset < rhs.offset); });
+  std::vector<VkMappedMemoryRange> mergedRanges;
+  for (const auto& range : ranges)
+  {
+    if (std::none_of(begin(pddit->second.memoryBlocks), end(pddit->second.memoryBlocks), [&range](const MemoryBlock& mb) { return mb.storageMemory == range.memory; }))
+      continue;
+    if (!mergedRanges.empty() && mergedRanges.back().memory == range.memory && mergedRanges.back().offset + mergedRanges.back().size >= range.offset)
+      mergedRanges.back().size = std::max(mergedRanges.back().offset + mergedRanges.back().size, range.offset + range.size) - mergedRanges.back().offset;
+    else
+      mergedRanges.push_back(range);
+  }
+  if (!mergedRanges.empty())
+    VK_CHECK_LOG_THROW(vkFlushMappedMemoryRanges(device, mergedRanges.size(), mergedRanges.data()), "Cannot flush mapped memory ranges");
+}
+
+uint32_t DeviceMemoryAllocator::getBlockCount(VkDevice device) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
+    return 0;
+  return std::count_if(begin(pddit->second.memoryBlocks), end(pddit->second.memoryBlocks), [](const MemoryBlock& mb) { return mb.storageMemory != VK_NULL_HANDLE; });
+}
+
+VkDeviceSize DeviceMemoryAllocator::getAllocatedSize(VkDevice device) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
+    return 0;
+  return pddit->second.allocatedSize;
+}
+
+DeviceMemoryStatistics DeviceMemoryAllocator::getStatistics(VkDevice device) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perDeviceData.find(device);
+  if (pddit == end(perDeviceData))
+    return DeviceMemoryStatistics();
+  return getStatistics(pddit->second);
+}
+
+DeviceMemoryStatistics DeviceMemoryAllocator::getStatistics(const PerDeviceData& pdd) const
+{
+  DeviceMemoryStatistics result;
+  result.allocatedSize = pdd.allocatedSize;
+  result.usedSize      = pdd.usedSize;
+  result.peakUsedSize  = pdd.peakUsedSize;
+  std::vector<FreeBlock> freeBlocks;
+  for (const auto& mb : pdd.memoryBlocks)
+  {
+    if (mb.storageMemory == VK_NULL_HANDLE)
+      continue;
+    result.blockCount++;
+    result.allocationCount += mb.allocationCount;
+    freeBlocks.clear();
+    mb.allocationStrategy->getFreeBlocks(freeBlocks);
+    for (const auto& fb : freeBlocks)
+    {
+      result.freeSize         += fb.size;
+      result.largestFreeBlock  = std::max(result.largestFreeBlock, fb.size);
+    }
+  }
+  if (result.freeSize > 0)
+    result.fragmentation = 1.0 - (double)result.largestFreeBlock / (double)result.freeSize;
+  return result;
+}
+
+void DeviceMemoryAllocator::dumpJSON(std::ostream& stream) const
+{
+  static const char* strategyNames[] = { "FIRST_FIT", "TLSF", "RING" };
+  std::lock_guard<std::mutex> lock(mutex);
+  stream << "{\n";
+  stream << "  \"strategy\": \"" << strategyNames[strategy] << "\",\n";
+  stream << "  \"propertyFlags\": " << propertyFlags << ",\n";
+  stream << "  \"size\": " << size << ",\n";
+  stream << "  \"maxSize\": " << maxSize << ",\n";
+  stream << "  \"devices\": [";
+  bool firstDevice = true;
+  std::vector<FreeBlock> freeBlocks;
+  for (const auto& pddit : perDeviceData)
+  {
+    DeviceMemoryStatistics statistics = getStatistics(pddit.second);
+    stream << (firstDevice ? "\n" : ",\n");
+    firstDevice = false;
+    stream << "    {\n";
+    stream << "      \"device\": \"" << (void*)pddit.first << "\",\n";
+    stream << "      \"statistics\": { \"allocatedSize\": " << statistics.allocatedSize << ", \"usedSize\": " << statistics.usedSize << ", \"freeSize\": " << statistics.freeSize
+      << ", \"largestFreeBlock\": " << statistics.largestFreeBlock << ", \"fragmentation\": " << statistics.fragmentation << ", \"allocationCount\": " << statistics.allocationCount
+      << ", \"blockCount\": " << statistics.blockCount << ", \"peakUsedSize\": " << statistics.peakUsedSize << " },\n";
+    stream << "      \"blocks\": [";
+    bool firstBlock = true;
+    for (uint32_t i = 0; i < pddit.second.memoryBlocks.size(); ++i)
+    {
+      const auto& mb = pddit.second.memoryBlocks[i];
+      if (mb.storageMemory == VK_NULL_HANDLE)
+        continue;
+      stream << (firstBlock ? "\n" : ",\n");
+      firstBlock = false;
+      stream << "        { \"index\": " << i << ", \"size\": " << mb.size << ",\n";
+      stream << "          \"allocations\": [";
+      bool firstEntry = true;
+      for (const auto& a : mb.allocations)
+      {
+        stream << (firstEntry ? "" : ", ") << "{ \"offset\": " << a.first << ", \"size\": " << a.second.size << ", \"name\": \"" << jsonEscape(a.second.name) << "\" }";
+        firstEntry = false;
+      }
+      stream << "],\n";
+      freeBlocks.clear();
+      mb.allocationStrategy->getFreeBlocks(freeBlocks);
+      std::sort(begin(freeBlocks), end(freeBlocks), [](const FreeBlock& lhs, const FreeBlock& rhs) { return lhs.offset < rhs.offset; });
+      stream << "          \"free\": [";
+      firstEntry = true;
+      for (const auto& fb : freeBlocks)
+      {
+        stream << (firstEntry ? "" : ", ") << "{ \"offset\": " << fb.offset << ", \"size\": " << fb.size << " }";
+        firstEntry = false;
+      }
+      stream << "] }";
+    }
+    stream << "\n      ]\n    }";
+  }
+  stream << "\n  ]\n}\n";
+}
+
+uint32_t DeviceMemoryAllocator::createMemoryBlock(Device* device, PerDeviceData& pdd, VkDeviceSize blockSize, uint32_t memoryTypeBits)
+{
+  auto it = std::find_if(begin(pdd.memoryBlocks), end(pdd.memoryBlocks), [](const MemoryBlock& mb) { return mb.storageMemory == VK_NULL_HANDLE; });
+  if (it == end(pdd.memoryBlocks))
+    it = pdd.memoryBlocks.insert(end(pdd.memoryBlocks), MemoryBlock());
+
+  auto physicalDevice = device->physical.lock();
+  if (isHostVisible() && !isHostCoherent())
+  {
+    pdd.nonCoherentAtomSize = std::max<VkDeviceSize>(1, physicalDevice->properties.limits.nonCoherentAtomSize);
+    blockSize = ((blockSize + pdd.nonCoherentAtomSize - 1) / pdd.nonCoherentAtomSize) * pdd.nonCoherentAtomSize;
+  }
+
+  // lazily allocated memory is only available on some ( mostly tiled ) GPUs - use ordinary memory when it is missing
+  VkMemoryPropertyFlags memoryProperties = propertyFlags;
+  VkBool32 memoryTypeFound = VK_FALSE;
+  physicalDevice->getMemoryType(memoryTypeBits, memoryProperties, &memoryTypeFound);
+  if (!memoryTypeFound)
+    memoryProperties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+  VkMemoryAllocateInfo memAlloc{};
+    memAlloc.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memAlloc.allocationSize  = blockSize;
+    memAlloc.memoryTypeIndex = physicalDevice->getMemoryType(memoryTypeBits, memoryProperties);
+  VK_CHECK_LOG_THROW(vkAllocateMemory(device->device, &memAlloc, nullptr, &it->storageMemory), "Cannot allocate memory in DeviceMemoryAllocator");
+  it->mappedMemory = nullptr;
+  if (isHostVisible())
+    VK_CHECK_LOG_THROW(vkMapMemory(device->device, it->storageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&it->mappedMemory), "Cannot map memory in DeviceMemoryAllocator");
+  it->size               = blockSize;
+  it->allocationCount    = 0;
+  it->allocationStrategy = createAllocationStrategy(strategy, blockSize);
+  it->allocationStrategy->beginFrame(pdd.currentFrame);
+  pdd.allocatedSize     += blockSize;
+  // device must inform ring allocator about frames that are started and finished
+  if (strategy == RING)
+    device->addFrameAllocator(shared_from_this());
+  return std::distance(begin(pdd.memoryBlocks), it);
+}
+
+void DeviceMemoryAllocator::releaseEmptyBlocks(VkDevice device, PerDeviceData& pdd, bool ignoreGracePeriod)
+{
+  auto now = HPClock::now();
+  // first block is never released
+  for (uint32_t i = 1; i < pdd.memoryBlocks.size(); ++i)
+  {
+    auto& mb = pdd.memoryBlocks[i];
+    if (mb.storageMemory == VK_NULL_HANDLE || mb.allocationCount > 0)
+      continue;
+    if (!ignoreGracePeriod && inSeconds(now - mb.emptySince) < emptyBlockGracePeriod)
+      continue;
+    for (auto& bb : mb.blockBuffers)
+      vkDestroyBuffer(device, bb.second, nullptr);
+    mb.blockBuffers.clear();
+    if (mb.mappedMemory != nullptr)
+      vkUnmapMemory(device, mb.storageMemory);
+    vkFreeMemory(device, mb.storageMemory, nullptr);
+    pdd.allocatedSize     -= mb.size;
+    mb.mappedMemory        = nullptr;
+    mb.storageMemory       = VK_NULL_HANDLE;
+    mb.size                = 0;
+    mb.allocationStrategy.reset();
+  }
+  // remove holes from the end of the vector
+  while (pdd.memoryBlocks.size() > 1 && pdd.memoryBlocks.back().storageMemory == VK_NULL_HANDLE)
+    pdd.memoryBlocks.pop_back();
+}
+
+namespace pumex
+{
+
+std::unique_ptr<AllocationStrategy> createAllocationStrategy(DeviceMemoryAllocator::EnumStrategy strategy, VkDeviceSize size)
+{
+  switch (strategy)
+  {
+  case DeviceMemoryAllocator::FIRST_FIT: return std::make_unique<FirstFitAllocationStrategy>(size);
+  case DeviceMemoryAllocator::TLSF:      return std::make_unique<TLSFAllocationStrategy>(size);
+  case DeviceMemoryAllocator::RING:      return std::make_unique<RingAllocationStrategy>(size);
+  }
+  return std::unique_ptr<AllocationStrategy>();
+}
+
+}
+
+FirstFitAllocationStrategy::FirstFitAllocationStrategy(VkDeviceSize size)
+{
+  freeBlocks.push_front(FreeBlock(0, size));
 }
 
 FirstFitAllocationStrategy::~FirstFitAllocationStrategy()
 {
 }
 
-DeviceMemoryBlock FirstFitAllocationStrategy::allocate(VkDeviceMemory storageMemory, std::list<FreeBlock>& freeBlocks, VkMemoryRequirements memoryRequirements)
+DeviceMemoryBlock FirstFitAllocationStrategy::allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements)
 {
   auto it = begin(freeBlocks);
   VkDeviceSize additionalSize;
@@ -128,7 +582,8 @@ DeviceMemoryBlock FirstFitAllocationStrategy::allocate(VkDeviceMemory storageMem
     if (it->size >= memoryRequirements.size + additionalSize)
       break;
   }
-  CHECK_LOG_THROW(it == end(freeBlocks), "memory allocation failed : " << memoryRequirements.size);
+  if (it == end(freeBlocks))
+    return DeviceMemoryBlock();
 
   DeviceMemoryBlock block(storageMemory, it->offset, it->offset + additionalSize, memoryRequirements.size, memoryRequirements.size + additionalSize);
   it->offset += memoryRequirements.size + additionalSize;
@@ -138,9 +593,15 @@ DeviceMemoryBlock FirstFitAllocationStrategy::allocate(VkDeviceMemory storageMem
   return block;
 }
 
-void FirstFitAllocationStrategy::deallocate(std::list<FreeBlock>& freeBlocks, const DeviceMemoryBlock& block)
+void FirstFitAllocationStrategy::getFreeBlocks(std::vector<FreeBlock>& result) const
+{
+  result.insert(end(result), begin(freeBlocks), end(freeBlocks));
+}
+
+void FirstFitAllocationStrategy::deallocate(const DeviceMemoryBlock& block)
 {
-  FreeBlock fBlock(block.realOffset, block.realSize);
+  // alignedSize covers alignment padding placed in front of the data, so the whole area is returned to free blocks
+  FreeBlock fBlock(block.realOffset, block.alignedSize);
   if (freeBlocks.empty())
   {
     freeBlocks.push_back(fBlock);
@@ -187,3 +648,309 @@ void FirstFitAllocationStrategy::deallocate(std::list<FreeBlock>& freeBlocks, co
     freeBlocks.erase(nit);
   }
 }
+
+RingAllocationStrategy::RingAllocationStrategy(VkDeviceSize s)
+  : size{ s }, regionSize{ s }, frameRegions(1)
+{
+}
+
+RingAllocationStrategy::~RingAllocationStrategy()
+{
+}
+
+bool RingAllocationStrategy::isRetired(const FrameRegion& region) const
+{
+  return !region.used || region.frameNumber < retiredFrames;
+}
+
+DeviceMemoryBlock RingAllocationStrategy::allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements)
+{
+  // regions cannot change their size while frames in flight use them
+  if (memoryRequirements.size == 0 || frameRegions.size() != frameSlotCount)
+    return DeviceMemoryBlock();
+  auto& region = frameRegions[frameSlot];
+  // region used by previous frame is reused from the beginning when that frame is finished
+  if (region.used && region.frameNumber != currentFrame)
+  {
+    if (!isRetired(region))
+      return DeviceMemoryBlock();
+    region.used = false;
+  }
+
+  VkDeviceSize regionBegin   = frameSlot * regionSize;
+  VkDeviceSize alignment     = std::max<VkDeviceSize>(1, memoryRequirements.alignment);
+  VkDeviceSize realOffset    = region.used ? region.head : regionBegin;
+  VkDeviceSize alignedOffset = ((realOffset + alignment - 1) / alignment) * alignment;
+  if (alignedOffset + memoryRequirements.size > regionBegin + regionSize)
+    return DeviceMemoryBlock();
+  region.used        = true;
+  region.frameNumber = currentFrame;
+  region.head        = alignedOffset + memoryRequirements.size;
+  return DeviceMemoryBlock(storageMemory, realOffset, alignedOffset, memoryRequirements.size, memoryRequirements.size + alignedOffset - realOffset);
+}
+
+void RingAllocationStrategy::deallocate(const DeviceMemoryBlock& block)
+{
+  // memory is reused when region's frame retires
+}
+
+void RingAllocationStrategy::getFreeBlocks(std::vector<FreeBlock>& freeBlocks) const
+{
+  for (uint32_t i = 0; i < frameRegions.size(); ++i)
+  {
+    VkDeviceSize regionBegin = i * regionSize;
+    VkDeviceSize freeBegin   = isRetired(frameRegions[i]) ? regionBegin : frameRegions[i].head;
+    if (freeBegin < regionBegin + regionSize)
+      freeBlocks.push_back(FreeBlock(freeBegin, regionBegin + regionSize - freeBegin));
+  }
+  // memory left after dividing it into regions
+  VkDeviceSize regionsEnd = frameRegions.size() * regionSize;
+  if (regionsEnd < size)
+    freeBlocks.push_back(FreeBlock(regionsEnd, size - regionsEnd));
+}
+
+void RingAllocationStrategy::beginFrame(unsigned long long frameNumber)
+{
+  currentFrame = frameNumber;
+}
+
+void RingAllocationStrategy::retireFrame(unsigned long long frameNumber)
+{
+  retiredFrames = std::max(retiredFrames, (frameNumber == std::numeric_limits<unsigned long long>::max()) ? frameNumber : frameNumber + 1);
+}
+
+void RingAllocationStrategy::setFrameSlot(uint32_t fs, uint32_t fsc)
+{
+  frameSlotCount = std::max(fsc, 1u);
+  frameSlot      = fs % frameSlotCount;
+  // number of frames in flight changed - memory is divided again when all regions are free
+  if (frameRegions.size() != frameSlotCount && std::all_of(begin(frameRegions), end(frameRegions), [this](const FrameRegion& region) { return isRetired(region); }))
+  {
+    frameRegions.assign(frameSlotCount, FrameRegion());
+    regionSize = size / frameSlotCount;
+  }
+}
+
+static inline uint32_t bitScanForward(uint64_t value)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return index;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+static inline uint32_t bitScanReverse(uint64_t value)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return index;
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+TLSFAllocationStrategy::TLSFAllocationStrategy(VkDeviceSize size)
+{
+  std::fill(slBitmap, slBitmap + FL_INDEX_COUNT, 0);
+  for (uint32_t i = 0; i < FL_INDEX_COUNT; ++i)
+    std::fill(freeLists[i], freeLists[i] + SL_INDEX_COUNT, nullptr);
+  Block* block  = acquireBlock();
+  block->offset = 0;
+  block->size   = size;
+  insertFreeBlock(block);
+}
+
+TLSFAllocationStrategy::~TLSFAllocationStrategy()
+{
+}
+
+DeviceMemoryBlock TLSFAllocationStrategy::allocate(VkDeviceMemory storageMemory, VkMemoryRequirements memoryRequirements)
+{
+  VkDeviceSize alignment = std::max<VkDeviceSize>(1, memoryRequirements.alignment);
+  auto alignUp = [alignment](VkDeviceSize offset) { return ((offset + alignment - 1) / alignment) * alignment; };
+
+  // first try to find a block that fits requested size. If its offset is not aligned and block is too small to apply alignment
+  // - look for a block that will fit the data regardless of its offset
+  Block* block = findFreeBlock(memoryRequirements.size);
+  if (block != nullptr && alignUp(block->offset) + memoryRequirements.size > block->offset + block->size)
+    block = nullptr;
+  if (block == nullptr)
+    block = findFreeBlock(memoryRequirements.size + alignment - 1);
+  if (block == nullptr)
+    return DeviceMemoryBlock();
+  removeFreeBlock(block);
+
+  // alignment padding is returned to free blocks
+  VkDeviceSize alignedOffset = alignUp(block->offset);
+  if (alignedOffset > block->offset)
+  {
+    Block* padding        = acquireBlock();
+    padding->offset       = block->offset;
+    padding->size         = alignedOffset - block->offset;
+    padding->prevPhysical = block->prevPhysical;
+    padding->nextPhysical = block;
+    if (block->prevPhysical != nullptr)
+      block->prevPhysical->nextPhysical = padding;
+    block->prevPhysical = padding;
+    block->offset       = alignedOffset;
+    block->size        -= padding->size;
+    insertFreeBlock(padding);
+  }
+  // the rest of the block is also returned to free blocks
+  if (block->size > memoryRequirements.size)
+  {
+    Block* rest        = acquireBlock();
+    rest->offset       = block->offset + memoryRequirements.size;
+    rest->size         = block->size - memoryRequirements.size;
+    rest->prevPhysical = block;
+    rest->nextPhysical = block->nextPhysical;
+    if (block->nextPhysical != nullptr)
+      block->nextPhysical->prevPhysical = rest;
+    block->nextPhysical = rest;
+    block->size         = memoryRequirements.size;
+    insertFreeBlock(rest);
+  }
+  usedBlocks.insert({ block->offset, block });
+  return DeviceMemoryBlock(storageMemory, block->offset, block->offset, block->size, block->size);
+}
+
+void TLSFAllocationStrategy::deallocate(const DeviceMemoryBlock& block)
+{
+  auto it = usedBlocks.find(block.realOffset);
+  CHECK_LOG_THROW(it == end(usedBlocks), "TLSFAllocationStrategy::deallocate() : block was not allocated by this strategy");
+  Block* fBlock = it->second;
+  usedBlocks.erase(it);
+
+  // coalesce with previous block
+  if (fBlock->prevPhysical != nullptr && fBlock->prevPhysical->free)
+  {
+    Block* prev = fBlock->prevPhysical;
+    removeFreeBlock(prev);
+    prev->size        += fBlock->size;
+    prev->nextPhysical = fBlock->nextPhysical;
+    if (fBlock->nextPhysical != nullptr)
+      fBlock->nextPhysical->prevPhysical = prev;
+    releaseBlock(fBlock);
+    fBlock = prev;
+  }
+  // coalesce with next block
+  if (fBlock->nextPhysical != nullptr && fBlock->nextPhysical->free)
+  {
+    Block* next = fBlock->nextPhysical;
+    removeFreeBlock(next);
+    fBlock->size        += next->size;
+    fBlock->nextPhysical = next->nextPhysical;
+    if (next->nextPhysical != nullptr)
+      next->nextPhysical->prevPhysical = fBlock;
+    releaseBlock(next);
+  }
+  insertFreeBlock(fBlock);
+}
+
+void TLSFAllocationStrategy::getFreeBlocks(std::vector<FreeBlock>& freeBlocks) const
+{
+  for (uint32_t fl = 0; fl < FL_INDEX_COUNT; ++fl)
+    for (uint32_t sl = 0; sl < SL_INDEX_COUNT; ++sl)
+      for (Block* block = freeLists[fl][sl]; block != nullptr; block = block->nextFree)
+        freeBlocks.push_back(FreeBlock(block->offset, block->size));
+}
+
+void TLSFAllocationStrategy::mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl) const
+{
+  if (size < SMALL_BLOCK_SIZE)
+  {
+    fl = 0;
+    sl = static_cast<uint32_t>(size) / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+  }
+  else
+  {
+    uint32_t f = bitScanReverse(size);
+    sl = static_cast<uint32_t>(size >> (f - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+    fl = f - (FL_INDEX_SHIFT - 1);
+  }
+}
+
+TLSFAllocationStrategy::Block* TLSFAllocationStrategy::findFreeBlock(VkDeviceSize size)
+{
+  // round size up to the next list, so that every block found in that list is big enough
+  VkDeviceSize granularity = (size < SMALL_BLOCK_SIZE) ? (SMALL_BLOCK_SIZE / SL_INDEX_COUNT) : (VkDeviceSize(1) << (bitScanReverse(size) - SL_INDEX_COUNT_LOG2));
+  uint32_t fl, sl;
+  mapping(size + granularity - 1, fl, sl);
+  if (fl >= FL_INDEX_COUNT)
+    return nullptr;
+
+  uint32_t slMap = slBitmap[fl] & (~0u << sl);
+  if (slMap == 0)
+  {
+    uint64_t flMap = (fl + 1 < 64) ? (flBitmap & (~0ull << (fl + 1))) : 0;
+    if (flMap == 0)
+      return nullptr;
+    fl    = bitScanForward(flMap);
+    slMap = slBitmap[fl];
+  }
+  sl = bitScanForward(slMap);
+  return freeLists[fl][sl];
+}
+
+void TLSFAllocationStrategy::insertFreeBlock(Block* block)
+{
+  uint32_t fl, sl;
+  mapping(block->size, fl, sl);
+  block->free     = true;
+  block->prevFree = nullptr;
+  block->nextFree = freeLists[fl][sl];
+  if (block->nextFree != nullptr)
+    block->nextFree->prevFree = block;
+  freeLists[fl][sl] = block;
+  flBitmap     |= (1ull << fl);
+  slBitmap[fl] |= (1u << sl);
+}
+
+void TLSFAllocationStrategy::removeFreeBlock(Block* block)
+{
+  uint32_t fl, sl;
+  mapping(block->size, fl, sl);
+  if (block->prevFree != nullptr)
+    block->prevFree->nextFree = block->nextFree;
+  if (block->nextFree != nullptr)
+    block->nextFree->prevFree = block->prevFree;
+  if (freeLists[fl][sl] == block)
+  {
+    freeLists[fl][sl] = block->nextFree;
+    if (freeLists[fl][sl] == nullptr)
+    {
+      slBitmap[fl] &= ~(1u << sl);
+      if (slBitmap[fl] == 0)
+        flBitmap &= ~(1ull << fl);
+    }
+  }
+  block->free     = false;
+  block->prevFree = nullptr;
+  block->nextFree = nullptr;
+}
+
+TLSFAllocationStrategy::Block* TLSFAllocationStrategy::acquireBlock()
+{
+  Block* block;
+  if (!unusedBlocks.empty())
+  {
+    block = unusedBlocks.back();
+    unusedBlocks.pop_back();
+    *block = Block();
+  }
+  else
+  {
+    blockStorage.emplace_back();
+    block = &blockStorage.back();
+  }
+  return block;
+}
+
+void TLSFAllocationStrategy::releaseBlock(Block* block)
+{
+  unusedBlocks.push_back(block);
+}
@@ -92,9 +92,9 @@ void DrawVerticesNode::cmdDraw(const RenderContext& renderContext, CommandBuffer
   commandBuffer->addSource(this);
   VkBuffer vBuffer = vertexBuffer->getHandleBuffer(renderContext);
   VkBuffer iBuffer = indexBuffer->getHandleBuffer(renderContext);
-  VkDeviceSize offsets = 0;
+  VkDeviceSize offsets = vertexBuffer->getBufferOffset(renderContext);
   vkCmdBindVertexBuffers(commandBuffer->getHandle(), vertexBinding, 1, &vBuffer, &offsets);
-  vkCmdBindIndexBuffer(commandBuffer->getHandle(), iBuffer, 0, VK_INDEX_TYPE_UINT32);
+  vkCmdBindIndexBuffer(commandBuffer->getHandle(), iBuffer, indexBuffer->getBufferOffset(renderContext), VK_INDEX_TYPE_UINT32);
   uint32_t currentIndexCount = 0;
   if (vertexBuffer->getPerObjectBehaviour() == pbPerSurface)
   {
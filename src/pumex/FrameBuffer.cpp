@@ -75,6 +75,7 @@ void FrameBuffer::validate(const RenderContext& renderContext)
   rp->validate(renderContext);
 
   std::lock_guard<std::mutex> lock(mutex);
+  // frame buffers use swap chain images, so there's one frame buffer per swap chain image
   if (renderContext.imageCount > activeCount)
   {
     activeCount = renderContext.imageCount;
@@ -83,8 +84,8 @@ void FrameBuffer::validate(const RenderContext& renderContext)
   }
   auto pddit = perObjectData.find(renderContext.vkSurface);
   if (pddit == end(perObjectData))
-    pddit = perObjectData.insert({ renderContext.vkSurface, FrameBufferData(renderContext.vkDevice, renderContext.vkSurface, activeCount, swForEachImage) }).first;
-  uint32_t activeIndex = renderContext.activeIndex % activeCount;
+    pddit = perObjectData.insert({ renderContext.vkSurface, FrameBufferData(renderContext.vkDevice, renderContext.vkSurface, activeCount, swForEachSwapChainImage) }).first;
+  uint32_t activeIndex = renderContext.imageIndex % activeCount;
   if (pddit->second.valid[activeIndex])
     return;
 
@@ -142,7 +143,7 @@ void FrameBuffer::invalidate(const RenderContext& renderContext)
   std::lock_guard<std::mutex> lock(mutex);
   auto pddit = perObjectData.find(renderContext.vkSurface);
   if (pddit == end(perObjectData))
-    pddit = perObjectData.insert({ renderContext.vkSurface, FrameBufferData(renderContext.vkDevice, renderContext.vkSurface, activeCount, swForEachImage) }).first;
+    pddit = perObjectData.insert({ renderContext.vkSurface, FrameBufferData(renderContext.vkDevice, renderContext.vkSurface, activeCount, swForEachSwapChainImage) }).first;
   pddit->second.invalidate();
 }
 
@@ -247,5 +248,5 @@ VkFramebuffer FrameBuffer::getHandleFrameBuffer(const RenderContext& renderConte
   auto pddit = perObjectData.find(renderContext.vkSurface);
   if (pddit == end(perObjectData))
     return VK_NULL_HANDLE;
-  return pddit->second.data[renderContext.activeIndex % activeCount].frameBuffer;
+  return pddit->second.data[renderContext.imageIndex % activeCount].frameBuffer;
 }
@@ -23,9 +23,30 @@
 #include <pumex/Image.h>
 #include <pumex/Device.h>
 #include <pumex/utils/Log.h>
+#include <algorithm>
 
 using namespace pumex;
 
+static VkImageCreateInfo getImageCreateInfo(const ImageTraits& imageTraits)
+{
+  VkImageCreateInfo imageCI{};
+    imageCI.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCI.flags         = imageTraits.imageCreate;
+    imageCI.imageType     = imageTraits.imageType;
+    imageCI.format        = imageTraits.format;
+    imageCI.extent        = imageTraits.extent;
+    imageCI.mipLevels     = imageTraits.mipLevels;
+    imageCI.arrayLayers   = imageTraits.arrayLayers;
+    imageCI.samples       = imageTraits.samples;
+    imageCI.tiling        = imageTraits.linearTiling ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage         = imageTraits.usage;
+    imageCI.sharingMode   = imageTraits.sharingMode;
+//    imageCI.queueFamilyIndexCount;
+//    imageCI.pQueueFamilyIndices;
+    imageCI.initialLayout = imageTraits.initialLayout;
+  return imageCI;
+}
+
 ImageTraits::ImageTraits(VkImageUsageFlags u, VkFormat f, const VkExtent3D& e, uint32_t m, uint32_t l, VkSampleCountFlagBits s, bool lt, VkImageLayout il,
   VkImageCreateFlags ic, VkImageType it, VkSharingMode sm)
   : usage{ u }, format{ f }, extent( e ), mipLevels{ m }, arrayLayers{ l }, samples{ s }, linearTiling{ lt }, initialLayout{ il }, imageCreate{ ic }, imageType{ it }, sharingMode{ sm }
@@ -57,34 +78,43 @@ ImageTraits& ImageTraits::operator=(const ImageTraits& traits)
   return *this;
 }
 
-Image::Image(Device* d, const ImageTraits& it, std::shared_ptr<DeviceMemoryAllocator> a)
+Image::Image(Device* d, const ImageTraits& it, std::shared_ptr<DeviceMemoryAllocator> a, const std::string& name)
   : imageTraits{ it }, device(d->device), allocator{ a }, ownsImage{ true }
 {
-  VkImageCreateInfo imageCI{};
-    imageCI.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageCI.flags         = imageTraits.imageCreate;
-    imageCI.imageType     = imageTraits.imageType;
-    imageCI.format        = imageTraits.format;
-    imageCI.extent        = imageTraits.extent;
-    imageCI.mipLevels     = imageTraits.mipLevels;
-    imageCI.arrayLayers   = imageTraits.arrayLayers;
-    imageCI.samples       = imageTraits.samples;
-    imageCI.tiling        = imageTraits.linearTiling ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL;
-    imageCI.usage         = imageTraits.usage;
-    imageCI.sharingMode   = imageTraits.sharingMode;
-//    imageCI.queueFamilyIndexCount;
-//    imageCI.pQueueFamilyIndices;
-    imageCI.initialLayout = imageTraits.initialLayout;
-  VK_CHECK_LOG_THROW(vkCreateImage(device, &imageCI, nullptr, &image), "failed vkCreateImage");
+  createImage();
 
   VkMemoryRequirements memReqs;
   vkGetImageMemoryRequirements(device, image, &memReqs);
 
-  memoryBlock = allocator->allocate(d, memReqs);
+  memoryBlock = allocator->allocate(d, memReqs, name);
   CHECK_LOG_THROW(memoryBlock.alignedSize == 0, "Cannot allocate memory for Image");
   VK_CHECK_LOG_THROW(vkBindImageMemory(device, image, memoryBlock.memory, memoryBlock.alignedOffset), "failed vkBindImageMemory");
 }
 
+Image::Image(Device* d, const ImageTraits& it, std::shared_ptr<DeviceMemoryAllocator> a, const DeviceMemoryBlock& mb)
+  : imageTraits{ it }, device(d->device), allocator{ a }, memoryBlock{ mb }, ownsImage{ true }
+{
+  createImage();
+  VK_CHECK_LOG_THROW(vkBindImageMemory(device, image, memoryBlock.memory, memoryBlock.alignedOffset), "failed vkBindImageMemory");
+}
+
+Image::Image(Device* d, const ImageTraits& it, std::shared_ptr<DeviceMemoryBlock> smb)
+  : imageTraits{ it }, device(d->device), memoryBlock{ *smb }, sharedMemoryBlock{ smb }, ownsImage{ true }
+{
+  createImage();
+
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(device, image, &memReqs);
+  CHECK_LOG_THROW(memReqs.size > memoryBlock.alignedSize || (memoryBlock.alignedOffset % memReqs.alignment) != 0, "Shared memory block does not meet image memory requirements");
+  VK_CHECK_LOG_THROW(vkBindImageMemory(device, image, memoryBlock.memory, memoryBlock.alignedOffset), "failed vkBindImageMemory");
+}
+
+void Image::createImage()
+{
+  VkImageCreateInfo imageCI = getImageCreateInfo(imageTraits);
+  VK_CHECK_LOG_THROW(vkCreateImage(device, &imageCI, nullptr, &image), "failed vkCreateImage");
+}
+
 Image::Image(Device* d, VkImage i, VkFormat format, const VkExtent3D& extent, uint32_t mipLevels, uint32_t arrayLayers)
   : device(d->device), image{ i }, ownsImage{  false }
 {
@@ -101,7 +131,9 @@ Image::~Image()
   {
     if (image != VK_NULL_HANDLE)
       vkDestroyImage(device, image, nullptr);
-    allocator->deallocate(device, memoryBlock);
+    // shared memory is released by the last owner of sharedMemoryBlock
+    if (sharedMemoryBlock == nullptr)
+      allocator->deallocate(device, memoryBlock);
   }
 }
 
@@ -113,14 +145,17 @@ void Image::getImageSubresourceLayout(VkImageSubresource& subRes, VkSubresourceL
 
 void* Image::mapMemory(size_t offset, size_t range, VkMemoryMapFlags flags)
 {
-  void* data;
-  VK_CHECK_LOG_THROW(vkMapMemory(device, memoryBlock.memory, memoryBlock.alignedSize + offset, range, flags, &data), "Cannot map memory to image");
-  return data;
+  // memory is persistently mapped by allocator - calling vkMapMemory() again on the same VkDeviceMemory is not allowed
+  CHECK_LOG_THROW(memoryBlock.mappedPointer == nullptr, "Cannot map memory to image : memory is not host visible");
+  mappedOffset = offset;
+  mappedRange  = (range == VK_WHOLE_SIZE) ? memoryBlock.alignedSize - offset : range;
+  return static_cast<uint8_t*>(memoryBlock.mappedPointer) + offset;
 }
 
 void Image::unmapMemory()
 {
-  vkUnmapMemory(device, memoryBlock.memory);
+  allocator->addRangeToFlush(device, memoryBlock, mappedOffset, std::min(mappedRange, memoryBlock.alignedSize - mappedOffset));
+  allocator->flushMappedMemory(device);
 }
 
 namespace pumex
@@ -133,12 +168,121 @@ ImageTraits getImageTraitsFromTexture(const gli::texture& texture, VkImageUsageF
     texture.levels(), texture.layers(), VK_SAMPLE_COUNT_1_BIT, false, VK_IMAGE_LAYOUT_UNDEFINED, 0, vulkanImageTypeFromTextureExtents(t), VK_SHARING_MODE_EXCLUSIVE);
 }
 
+VkMemoryRequirements getImageMemoryRequirements(VkDevice device, const ImageTraits& imageTraits)
+{
+  VkImageCreateInfo imageCI = getImageCreateInfo(imageTraits);
+  VkImage image;
+  VK_CHECK_LOG_THROW(vkCreateImage(device, &imageCI, nullptr, &image), "failed vkCreateImage");
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(device, image, &memReqs);
+  vkDestroyImage(device, image, nullptr);
+  return memReqs;
+}
+
 VkFormat vulkanFormatFromGliFormat(gli::texture::format_type format)
 {
   // Formats are almost identical. Looks like someone implemented GLI and Vulkan at the same time
   return (VkFormat)format;
 }
 
+uint32_t getFormatTexelSize(VkFormat format)
+{
+  switch (format)
+  {
+  case VK_FORMAT_R8_UNORM:
+  case VK_FORMAT_R8_SNORM:
+  case VK_FORMAT_R8_UINT:
+  case VK_FORMAT_R8_SINT:
+  case VK_FORMAT_R8_SRGB:
+  case VK_FORMAT_S8_UINT:
+    return 1;
+  case VK_FORMAT_R4G4B4A4_UNORM_PACK16:
+  case VK_FORMAT_B4G4R4A4_UNORM_PACK16:
+  case VK_FORMAT_R5G6B5_UNORM_PACK16:
+  case VK_FORMAT_B5G6R5_UNORM_PACK16:
+  case VK_FORMAT_R5G5B5A1_UNORM_PACK16:
+  case VK_FORMAT_B5G5R5A1_UNORM_PACK16:
+  case VK_FORMAT_A1R5G5B5_UNORM_PACK16:
+  case VK_FORMAT_R8G8_UNORM:
+  case VK_FORMAT_R8G8_SNORM:
+  case VK_FORMAT_R8G8_UINT:
+  case VK_FORMAT_R8G8_SINT:
+  case VK_FORMAT_R8G8_SRGB:
+  case VK_FORMAT_R16_UNORM:
+  case VK_FORMAT_R16_SNORM:
+  case VK_FORMAT_R16_UINT:
+  case VK_FORMAT_R16_SINT:
+  case VK_FORMAT_R16_SFLOAT:
+  case VK_FORMAT_D16_UNORM:
+    return 2;
+  case VK_FORMAT_R8G8B8_UNORM:
+  case VK_FORMAT_R8G8B8_SRGB:
+  case VK_FORMAT_B8G8R8_UNORM:
+  case VK_FORMAT_B8G8R8_SRGB:
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+    return 3;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SNORM:
+  case VK_FORMAT_R8G8B8A8_UINT:
+  case VK_FORMAT_R8G8B8A8_SINT:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SNORM:
+  case VK_FORMAT_B8G8R8A8_UINT:
+  case VK_FORMAT_B8G8R8A8_SINT:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+  case VK_FORMAT_A8B8G8R8_UNORM_PACK32:
+  case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+  case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+  case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+  case VK_FORMAT_A2B10G10R10_UINT_PACK32:
+  case VK_FORMAT_R16G16_UNORM:
+  case VK_FORMAT_R16G16_SNORM:
+  case VK_FORMAT_R16G16_UINT:
+  case VK_FORMAT_R16G16_SINT:
+  case VK_FORMAT_R16G16_SFLOAT:
+  case VK_FORMAT_R32_UINT:
+  case VK_FORMAT_R32_SINT:
+  case VK_FORMAT_R32_SFLOAT:
+  case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+  case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+  case VK_FORMAT_X8_D24_UNORM_PACK32:
+  case VK_FORMAT_D32_SFLOAT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+    return 4;
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return 5;
+  case VK_FORMAT_R16G16B16_UNORM:
+  case VK_FORMAT_R16G16B16_SNORM:
+  case VK_FORMAT_R16G16B16_UINT:
+  case VK_FORMAT_R16G16B16_SINT:
+  case VK_FORMAT_R16G16B16_SFLOAT:
+    return 6;
+  case VK_FORMAT_R16G16B16A16_UNORM:
+  case VK_FORMAT_R16G16B16A16_SNORM:
+  case VK_FORMAT_R16G16B16A16_UINT:
+  case VK_FORMAT_R16G16B16A16_SINT:
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+  case VK_FORMAT_R32G32_UINT:
+  case VK_FORMAT_R32G32_SINT:
+  case VK_FORMAT_R32G32_SFLOAT:
+  case VK_FORMAT_R64_SFLOAT:
+    return 8;
+  case VK_FORMAT_R32G32B32_UINT:
+  case VK_FORMAT_R32G32B32_SINT:
+  case VK_FORMAT_R32G32B32_SFLOAT:
+    return 12;
+  case VK_FORMAT_R32G32B32A32_UINT:
+  case VK_FORMAT_R32G32B32A32_SINT:
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+  case VK_FORMAT_R64G64_SFLOAT:
+    return 16;
+  default:
+    break;
+  }
+  return 0;
+}
+
 VkImageViewType vulkanViewTypeFromGliTarget(gli::texture::target_type target)
 {
 
@@ -22,10 +22,13 @@
 
 #include <pumex/MemoryBuffer.h>
 #include <pumex/Surface.h>
+#include <pumex/PhysicalDevice.h>
 #include <pumex/Command.h>
 #include <pumex/RenderContext.h>
 #include <pumex/Resource.h>
+#include <pumex/RenderWorkflow.h>
 #include <algorithm>
+#include <cstring>
 
 using namespace pumex;
 
@@ -44,11 +47,26 @@ bool BufferSubresourceRange::contains(const BufferSubresourceRange& subRange) co
   return (offset <= subRange.offset) && (offset + range >= subRange.offset + subRange.range);
 }
 
+bool BufferSubresourceRange::touches(const BufferSubresourceRange& subRange) const
+{
+  return (offset <= subRange.offset + subRange.range) && (subRange.offset <= offset + range);
+}
+
+BufferSubresourceRange BufferSubresourceRange::merge(const BufferSubresourceRange& subRange) const
+{
+  VkDeviceSize mergedOffset = std::min(offset, subRange.offset);
+  VkDeviceSize mergedEnd    = std::max(offset + range, subRange.offset + subRange.range);
+  return BufferSubresourceRange(mergedOffset, mergedEnd - mergedOffset);
+}
+
 MemoryBuffer::MemoryBuffer(std::shared_ptr<DeviceMemoryAllocator> a, VkBufferUsageFlags bu, PerObjectBehaviour pob, SwapChainImageBehaviour scib, bool sdpo, bool usdm)
   : MemoryObject(MemoryObject::moBuffer), perObjectBehaviour{ pob }, swapChainImageBehaviour{ scib }, sameDataPerObject{ sdpo }, allocator{ a }, bufferUsage{ bu }, activeCount{ 1 }
 {
+  // buffer that may be written to may also be copied to a new place during defragmentation
   if (usdm)
-    bufferUsage = bufferUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferUsage = bufferUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  // memory from RING allocator lives only for one frame, so buffer must be able to recreate its data for each swapchain image
+  CHECK_LOG_THROW(allocator->getStrategy() == DeviceMemoryAllocator::RING && (scib != swForEachImage || !sdpo), "Only buffers with swForEachImage behaviour and the same data on all objects may use allocator with RING strategy");
 }
 
 MemoryBuffer::~MemoryBuffer()
@@ -58,10 +76,22 @@ MemoryBuffer::~MemoryBuffer()
   {
     for (uint32_t i = 0; i < pdd.second.data.size(); ++i)
     {
-      vkDestroyBuffer(pdd.second.device, pdd.second.data[i].buffer, nullptr);
+      // buffers covering memory blocks of RING allocator belong to allocator
+      if (allocator->getStrategy() != DeviceMemoryAllocator::RING)
+        vkDestroyBuffer(pdd.second.device, pdd.second.data[i].buffer, nullptr);
       allocator->deallocate(pdd.second.device, pdd.second.data[i].memoryBlock);
     }
   }
+  for (auto& rb : relocatedBuffers)
+  {
+    vkDestroyBuffer(rb.device, rb.internals.buffer, nullptr);
+    allocator->deallocate(rb.device, rb.internals.memoryBlock);
+  }
+  for (auto& sb : streamedBuffers)
+  {
+    vkDestroyBuffer(sb.device, sb.internals.buffer, nullptr);
+    allocator->deallocate(sb.device, sb.internals.memoryBlock);
+  }
 }
 
 MemoryBuffer* MemoryBuffer::asMemoryBuffer()
@@ -78,6 +108,15 @@ VkBuffer MemoryBuffer::getHandleBuffer(const RenderContext& renderContext) const
   return pddit->second.data[renderContext.activeIndex % activeCount].buffer;
 }
 
+VkDeviceSize MemoryBuffer::getBufferOffset(const RenderContext& renderContext) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perObjectData.find(getKeyID(renderContext, perObjectBehaviour));
+  if (pddit == end(perObjectData))
+    return 0;
+  return pddit->second.data[renderContext.activeIndex % activeCount].bufferOffset;
+}
+
 size_t MemoryBuffer::getDataSizeRC(const RenderContext& renderContext) const
 {
   std::lock_guard<std::mutex> lock(mutex);
@@ -90,9 +129,9 @@ size_t MemoryBuffer::getDataSizeRC(const RenderContext& renderContext) const
 void MemoryBuffer::validate(const RenderContext& renderContext)
 {
   std::lock_guard<std::mutex> lock(mutex);
-  if (swapChainImageBehaviour == swForEachImage && renderContext.imageCount > activeCount)
+  if (swapChainImageBehaviour == swForEachImage && renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perObjectData)
     {
       pdd.second.resize(activeCount);
@@ -105,6 +144,21 @@ void MemoryBuffer::validate(const RenderContext& renderContext)
   if (pddit == end(perObjectData))
     pddit = perObjectData.insert({ keyValue, MemoryBufferData(renderContext, swapChainImageBehaviour) }).first;
   uint32_t activeIndex = renderContext.activeIndex % activeCount;
+  // memory allocated from RING allocator in one of the previous frames is already reused - data must be placed in the ring region of current frame and sent again.
+  // Uploads of the previous frame were already submitted, so there's nothing to cancel
+  auto& internals = pddit->second.data[activeIndex];
+  if (allocator->getStrategy() == DeviceMemoryAllocator::RING && internals.buffer != VK_NULL_HANDLE && internals.frameNumber != renderContext.frameNumber)
+  {
+    allocateRingMemory(renderContext, internals, std::max<VkDeviceSize>(1, getDataSize()));
+    sendDataToBuffer(keyValue, renderContext.vkDevice, renderContext.vkSurface);
+  }
+  // allocator may ask to move the data during defragmentation. Data in RING allocator lives only for one frame, so it is never moved
+  if (!relocatedBuffers.empty())
+    releaseRelocatedBuffers(renderContext);
+  if (allocator->isDefragmenting() && allocator->getStrategy() != DeviceMemoryAllocator::RING && internals.buffer != VK_NULL_HANDLE)
+    relocateBuffer(renderContext, internals);
+  // data streamed through transfer queue replaces current buffer when frame acquires it
+  bool streamPending = !streamedBuffers.empty() && replaceStreamedBuffer(renderContext, keyValue, activeIndex);
   if (pddit->second.valid[activeIndex])
     return;
 
@@ -116,7 +170,12 @@ void MemoryBuffer::validate(const RenderContext& renderContext)
     pddit->second.device = renderContext.vkDevice;
 
   // images are created here, when Texture uses sameTraitsPerObject - otherwise it's a reponsibility of the user to create them through setImageTraits() call
-  if (pddit->second.data[activeIndex].buffer == nullptr && sameDataPerObject)
+  if (pddit->second.data[activeIndex].buffer == nullptr && sameDataPerObject && allocator->getStrategy() == DeviceMemoryAllocator::RING)
+  {
+    allocateRingMemory(renderContext, pddit->second.data[activeIndex], std::max<VkDeviceSize>(1, getDataSize()));
+    sendDataToBuffer(keyValue, renderContext.vkDevice, renderContext.vkSurface);
+  }
+  else if (pddit->second.data[activeIndex].buffer == nullptr && sameDataPerObject)
   {
     VkBufferCreateInfo bufferCreateInfo{};
       bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -126,9 +185,10 @@ void MemoryBuffer::validate(const RenderContext& renderContext)
     VkMemoryRequirements memReqs;
     vkGetBufferMemoryRequirements(pddit->second.device, pddit->second.data[activeIndex].buffer, &memReqs);
     pddit->second.data[activeIndex].dataSize    = bufferCreateInfo.size;
-    pddit->second.data[activeIndex].memoryBlock = allocator->allocate(renderContext.device, memReqs);
+    pddit->second.data[activeIndex].memoryBlock = allocator->allocate(renderContext.device, memReqs, getName());
+    pddit->second.data[activeIndex].frameNumber = renderContext.frameNumber;
     CHECK_LOG_THROW(pddit->second.data[activeIndex].memoryBlock.alignedSize == 0, "Cannot create a bufer");
-    allocator->bindBufferMemory(renderContext.device, pddit->second.data[activeIndex].buffer, pddit->second.data[activeIndex].memoryBlock.alignedOffset);
+    allocator->bindBufferMemory(renderContext.device, pddit->second.data[activeIndex].buffer, pddit->second.data[activeIndex].memoryBlock);
 
     BufferSubresourceRange allBufferRange(0, getDataSize());
     notifyCommandBufferSources(renderContext);
@@ -145,11 +205,15 @@ void MemoryBuffer::validate(const RenderContext& renderContext)
     bool submit = false;
     for (auto& bufop : pddit->second.commonData.bufferOperations)
     {
+      // operations following streamed data wait until it replaces current buffer
+      if (streamPending)
+        break;
       if (!bufop->updated[activeIndex])
       {
         submit |= bufop->perform(renderContext, pddit->second.data[activeIndex], cmdBuffer);
         // mark operation as done for this activeIndex
         bufop->updated[activeIndex] = true;
+        streamPending = std::any_of(begin(streamedBuffers), end(streamedBuffers), [keyValue, activeIndex](const StreamedBuffer& sb) { return sb.key == keyValue && sb.activeIndex == activeIndex; });
       }
     }
     renderContext.device->endSingleTimeCommands(cmdBuffer, renderContext.queue, submit);
@@ -158,7 +222,270 @@ void MemoryBuffer::validate(const RenderContext& renderContext)
     // if all operations are done for each index - remove them from list
     pddit->second.commonData.bufferOperations.remove_if(([](std::shared_ptr<Operation> bufop) { return bufop->allUpdated(); }));
   }
-  pddit->second.valid[activeIndex] = true;
+  // buffer waiting for streamed data must be validated again in next frames
+  pddit->second.valid[activeIndex] = !streamPending;
+}
+
+void* MemoryBuffer::mapBufferMemory(const RenderContext& renderContext, size_t size)
+{
+  CHECK_LOG_THROW(sameDataPerObject, "Cannot map buffer - data on all surfaces was declared as the same");
+  CHECK_LOG_THROW(swapChainImageBehaviour != swForEachImage, "Cannot map buffer - only buffers with swForEachImage behaviour may be written while other frames are in flight");
+  if (size == 0)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (renderContext.activeCount > activeCount)
+  {
+    activeCount = renderContext.activeCount;
+    for (auto& pdd : perObjectData)
+    {
+      pdd.second.resize(activeCount);
+      for (auto& op : pdd.second.commonData.bufferOperations)
+        op->resize(activeCount);
+    }
+  }
+  auto keyValue = getKeyID(renderContext, perObjectBehaviour);
+  auto pddit = perObjectData.find(keyValue);
+  if (pddit == end(perObjectData))
+    pddit = perObjectData.insert({ keyValue, MemoryBufferData(renderContext, swapChainImageBehaviour) }).first;
+  if (pddit->second.surface == VK_NULL_HANDLE)
+    pddit->second.surface = renderContext.vkSurface;
+  if (pddit->second.device == VK_NULL_HANDLE)
+    pddit->second.device = renderContext.vkDevice;
+  auto& internals = pddit->second.data[renderContext.activeIndex % activeCount];
+  CHECK_LOG_THROW(internals.mappedSize > 0, "Cannot map buffer - it is already mapped");
+
+  // buffer using RING allocator places its data in the ring region of current frame
+  if (allocator->getStrategy() == DeviceMemoryAllocator::RING)
+  {
+    if (internals.buffer == VK_NULL_HANDLE || internals.dataSize < size || internals.frameNumber != renderContext.frameNumber)
+      allocateRingMemory(renderContext, internals, size);
+  }
+  // buffer used by current frame is not used by any frame in flight, so it may be safely recreated
+  else if (internals.buffer == VK_NULL_HANDLE || internals.dataSize < size)
+  {
+    if (internals.buffer != VK_NULL_HANDLE)
+    {
+      renderContext.uploadBatch->cancelBufferUploads(renderContext.device, internals.buffer);
+      vkDestroyBuffer(renderContext.vkDevice, internals.buffer, nullptr);
+      allocator->deallocate(renderContext.vkDevice, internals.memoryBlock);
+      internals = MemoryBufferInternal();
+    }
+    VkBufferCreateInfo bufferCreateInfo{};
+      bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      bufferCreateInfo.usage = bufferUsage;
+      bufferCreateInfo.size  = size;
+    VK_CHECK_LOG_THROW(vkCreateBuffer(renderContext.vkDevice, &bufferCreateInfo, nullptr, &internals.buffer), "Cannot create a buffer");
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(renderContext.vkDevice, internals.buffer, &memReqs);
+    internals.dataSize    = bufferCreateInfo.size;
+    internals.memoryBlock = allocator->allocate(renderContext.device, memReqs, getName());
+    internals.frameNumber = renderContext.frameNumber;
+    CHECK_LOG_THROW(internals.memoryBlock.alignedSize == 0, "Cannot create a buffer");
+    allocator->bindBufferMemory(renderContext.device, internals.buffer, internals.memoryBlock);
+
+    BufferSubresourceRange allBufferRange(0, internals.dataSize);
+    notifyCommandBufferSources(renderContext);
+    notifyBufferViews(renderContext, allBufferRange);
+    notifyResources(renderContext);
+  }
+
+  internals.mappedSize = size;
+  // host visible memory is written directly
+  if (internals.memoryBlock.mappedPointer != nullptr)
+    return internals.memoryBlock.mappedPointer;
+  // device local memory is written through staging memory that is copied to the buffer by UploadBatch
+  CHECK_LOG_THROW((bufferUsage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) == 0, "Cannot map buffer - user declared it as not writeable");
+  internals.mappedStaging = renderContext.device->acquireStagingBuffer(nullptr, size);
+  return internals.mappedStaging->mapMemory(size);
+}
+
+void* MemoryBuffer::mapBufferMemory(Surface* surface, size_t size)
+{
+  RenderContext renderContext(surface, surface->workflowResults->presentationQueueIndex);
+  return mapBufferMemory(renderContext, size);
+}
+
+void MemoryBuffer::unmapBufferMemory(const RenderContext& renderContext)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perObjectData.find(getKeyID(renderContext, perObjectBehaviour));
+  if (pddit == end(perObjectData))
+    return;
+  auto& internals = pddit->second.data[renderContext.activeIndex % activeCount];
+  if (internals.mappedSize == 0)
+    return;
+  if (internals.mappedStaging.get() != nullptr)
+  {
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = internals.mappedStaging->bufferOffset();
+    copyRegion.dstOffset = internals.bufferOffset;
+    copyRegion.size      = internals.mappedSize;
+    // mapped buffers are never used by frames in flight ( swForEachImage )
+    renderContext.uploadBatch->addBufferUpload(internals.mappedStaging, internals.buffer, copyRegion);
+    internals.mappedStaging = nullptr;
+  }
+  else if (!allocator->isHostCoherent())
+  {
+    allocator->addRangeToFlush(renderContext.vkDevice, internals.memoryBlock, 0, internals.mappedSize);
+    renderContext.device->addAllocatorToFlush(allocator);
+  }
+  internals.mappedSize = 0;
+}
+
+void MemoryBuffer::unmapBufferMemory(Surface* surface)
+{
+  RenderContext renderContext(surface, surface->workflowResults->presentationQueueIndex);
+  unmapBufferMemory(renderContext);
+}
+
+void MemoryBuffer::allocateRingMemory(const RenderContext& renderContext, MemoryBufferInternal& internals, VkDeviceSize size)
+{
+  // memory requirements of the buffer are checked only once - creating a buffer in each frame is what we want to avoid
+  auto& commonData = perObjectData.at(getKeyID(renderContext, perObjectBehaviour)).commonData;
+  if (commonData.ringMemoryRequirements.memoryTypeBits == 0)
+  {
+    VkBufferCreateInfo bufferCreateInfo{};
+      bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      bufferCreateInfo.usage = bufferUsage;
+      bufferCreateInfo.size  = size;
+    VkBuffer buffer;
+    VK_CHECK_LOG_THROW(vkCreateBuffer(renderContext.vkDevice, &bufferCreateInfo, nullptr, &buffer), "Cannot create a buffer");
+    vkGetBufferMemoryRequirements(renderContext.vkDevice, buffer, &commonData.ringMemoryRequirements);
+    vkDestroyBuffer(renderContext.vkDevice, buffer, nullptr);
+    // data is accessed through an offset in a bigger buffer, so offset must satisfy descriptor alignment too
+    const auto& limits = renderContext.device->physical.lock()->properties.limits;
+    VkDeviceSize alignment = commonData.ringMemoryRequirements.alignment;
+    if (bufferUsage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+      alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+    if (bufferUsage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+      alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+    commonData.ringMemoryRequirements.alignment = alignment;
+  }
+  VkMemoryRequirements memReqs = commonData.ringMemoryRequirements;
+  memReqs.size = size;
+
+  VkBuffer     previousBuffer = internals.buffer;
+  VkDeviceSize previousOffset = internals.bufferOffset;
+  allocator->deallocate(renderContext.vkDevice, internals.memoryBlock);
+  // each frame in flight has its own ring region, so the data gets the same offset every time the frame slot is used
+  internals.memoryBlock  = allocator->allocate(renderContext.device, memReqs, getName(), renderContext.activeIndex % renderContext.activeCount, renderContext.activeCount);
+  CHECK_LOG_THROW(internals.memoryBlock.alignedSize == 0, "Cannot create a buffer");
+  internals.buffer       = allocator->getMemoryBlockBuffer(renderContext.device, internals.memoryBlock, bufferUsage);
+  internals.bufferOffset = internals.memoryBlock.alignedOffset;
+  internals.dataSize     = size;
+  internals.frameNumber  = renderContext.frameNumber;
+
+  // descriptors and command buffers store the offset of the data, so they must be updated when it changes ( i.e. when data size changes or the
+  // region is still used by the device and the data lands in other memory block ). Buffer views are not used with RING allocator
+  if (internals.buffer != previousBuffer || internals.bufferOffset != previousOffset)
+  {
+    notifyCommandBufferSources(renderContext);
+    notifyResources(renderContext);
+  }
+}
+
+void MemoryBuffer::streamData(const RenderContext& renderContext, std::shared_ptr<StagingBuffer> stagingBuffer, VkDeviceSize size)
+{
+  MemoryBufferInternal streamed;
+  VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.usage = bufferUsage;
+    bufferCreateInfo.size  = size;
+  VK_CHECK_LOG_THROW(vkCreateBuffer(renderContext.vkDevice, &bufferCreateInfo, nullptr, &streamed.buffer), "Cannot create a buffer");
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(renderContext.vkDevice, streamed.buffer, &memReqs);
+  streamed.dataSize    = bufferCreateInfo.size;
+  streamed.memoryBlock = allocator->allocate(renderContext.device, memReqs, getName());
+  streamed.frameNumber = renderContext.frameNumber;
+  CHECK_LOG_THROW(streamed.memoryBlock.alignedSize == 0, "Cannot create a buffer");
+  allocator->bindBufferMemory(renderContext.device, streamed.buffer, streamed.memoryBlock);
+
+  VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = stagingBuffer->bufferOffset();
+    copyRegion.size      = size;
+  renderContext.uploadBatch->addBufferUpload(stagingBuffer, streamed.buffer, copyRegion, true);
+  uint32_t activeIndex = renderContext.activeIndex % activeCount;
+  streamedBuffers.push_back({ renderContext.vkDevice, getKeyID(renderContext, perObjectBehaviour), activeIndex, renderContext.frameNumber + renderContext.uploadBatch->getStreamLatency(), streamed });
+}
+
+bool MemoryBuffer::replaceStreamedBuffer(const RenderContext& renderContext, uint32_t key, uint32_t activeIndex)
+{
+  auto it = std::find_if(begin(streamedBuffers), end(streamedBuffers), [key, activeIndex](const StreamedBuffer& sb) { return sb.key == key && sb.activeIndex == activeIndex; });
+  if (it == end(streamedBuffers))
+    return false;
+  if (it->readyFrame > renderContext.frameNumber)
+    return true;
+  // old buffer may still be used by frames in flight
+  auto& internals = perObjectData.at(key).data[activeIndex];
+  relocatedBuffers.push_back({ it->device, renderContext.frameNumber, internals });
+  internals = it->internals;
+  streamedBuffers.erase(it);
+
+  BufferSubresourceRange allBufferRange(0, internals.dataSize);
+  notifyCommandBufferSources(renderContext);
+  notifyBufferViews(renderContext, allBufferRange);
+  notifyResources(renderContext);
+  return false;
+}
+
+void MemoryBuffer::relocateBuffer(const RenderContext& renderContext, MemoryBufferInternal& internals)
+{
+  // data stored in device local memory is copied by GPU
+  const VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if (internals.memoryBlock.mappedPointer == nullptr && (bufferUsage & transferUsage) != transferUsage)
+    return;
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(renderContext.vkDevice, internals.buffer, &memReqs);
+  DeviceMemoryBlock memoryBlock = allocator->relocate(renderContext.device, renderContext.frameNumber, internals.memoryBlock, memReqs);
+  if (memoryBlock.alignedSize == 0)
+    return;
+
+  MemoryBufferInternal relocated;
+  VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.usage = bufferUsage;
+    bufferCreateInfo.size  = internals.dataSize;
+  VK_CHECK_LOG_THROW(vkCreateBuffer(renderContext.vkDevice, &bufferCreateInfo, nullptr, &relocated.buffer), "Cannot create a buffer");
+  relocated.dataSize    = internals.dataSize;
+  relocated.memoryBlock = memoryBlock;
+  relocated.frameNumber = internals.frameNumber;
+  allocator->bindBufferMemory(renderContext.device, relocated.buffer, relocated.memoryBlock);
+
+  if (internals.memoryBlock.mappedPointer != nullptr)
+  {
+    // host visible memory is copied without GPU
+    allocator->copyToDeviceMemory(renderContext.device, relocated.memoryBlock, 0, internals.memoryBlock.mappedPointer, internals.dataSize, 0);
+  }
+  else
+  {
+    // copy is recorded by UploadBatch before the frame. Old buffer lives until all frames that could use it are finished ( see releaseRelocatedBuffers() )
+    VkBufferCopy copyRegion{};
+      copyRegion.size = internals.dataSize;
+    renderContext.uploadBatch->addBufferCopy(internals.buffer, relocated.buffer, copyRegion);
+  }
+  relocatedBuffers.push_back({ renderContext.vkDevice, renderContext.frameNumber, internals });
+  internals = relocated;
+
+  BufferSubresourceRange allBufferRange(0, internals.dataSize);
+  notifyCommandBufferSources(renderContext);
+  notifyBufferViews(renderContext, allBufferRange);
+  notifyResources(renderContext);
+}
+
+void MemoryBuffer::releaseRelocatedBuffers(const RenderContext& renderContext)
+{
+  for (auto it = begin(relocatedBuffers); it != end(relocatedBuffers); )
+  {
+    // all frames that could use the old buffer are finished
+    if (it->frameNumber + renderContext.activeCount < renderContext.frameNumber)
+    {
+      vkDestroyBuffer(it->device, it->internals.buffer, nullptr);
+      allocator->deallocate(it->device, it->internals.memoryBlock);
+      it = relocatedBuffers.erase(it);
+    }
+    else
+      ++it;
+  }
 }
 
 void MemoryBuffer::addCommandBufferSource(std::shared_ptr<CommandBufferSource> cbSource)
@@ -200,6 +527,8 @@ void MemoryBuffer::notifyResources(const RenderContext& renderContext)
 
 void MemoryBuffer::addBufferView(std::shared_ptr<BufferView> bufferView)
 {
+  // data of buffer using RING allocator moves in every frame
+  CHECK_LOG_THROW(allocator->getStrategy() == DeviceMemoryAllocator::RING, "Buffer views cannot be created for buffers using allocator with RING strategy");
   std::lock_guard<std::mutex> lock(mutex);
   if (std::find_if(begin(bufferViews), end(bufferViews), [&bufferView](std::weak_ptr<BufferView> bv) { return !bv.expired() && bv.lock().get() == bufferView.get(); }) == end(bufferViews))
     bufferViews.push_back(bufferView);
@@ -251,9 +580,9 @@ void BufferView::validate(const RenderContext& renderContext)
   }
   memBuffer->validate(renderContext);
   std::lock_guard<std::mutex> lock(mutex);
-  if (memBuffer->getSwapChainImageBehaviour() == swForEachImage && renderContext.imageCount > activeCount)
+  if (memBuffer->getSwapChainImageBehaviour() == swForEachImage && renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perObjectData)
       pdd.second.resize(activeCount);
   }
@@ -26,9 +26,11 @@
 #include <pumex/Command.h>
 #include <pumex/RenderContext.h>
 #include <pumex/Resource.h>
+#include <pumex/UploadBatch.h>
 #include <pumex/utils/Buffer.h>
 #include <pumex/utils/Log.h>
 #include <algorithm>
+#include <tuple>
 
 using namespace pumex;
 
@@ -72,7 +74,16 @@ struct SetImageTraitsOperation : public MemoryImage::Operation
   bool perform(const RenderContext& renderContext, MemoryImage::MemoryImageInternal& internals, std::shared_ptr<CommandBuffer> commandBuffer) override
   {
     internals.image = nullptr; // release image before creating a new one
-    internals.image = std::make_shared<Image>(renderContext.device, imageTraits, owner->getAllocator());
+    auto sharedMemory      = owner->getSharedMemory();
+    auto sharedMemoryBlock = (sharedMemory != nullptr) ? sharedMemory->getMemoryBlock(renderContext, getKeyID(renderContext, owner->getPerObjectBehaviour())) : nullptr;
+    auto memoryPool        = owner->getAttachmentMemoryPool();
+    if (sharedMemoryBlock != nullptr)
+      internals.image     = std::make_shared<Image>(renderContext.device, imageTraits, sharedMemoryBlock);
+    else if (memoryPool != nullptr)
+      internals.image     = std::make_shared<Image>(renderContext.device, imageTraits, memoryPool->acquire(renderContext.device, imageTraits));
+    else
+      internals.image     = std::make_shared<Image>(renderContext.device, imageTraits, owner->getAllocator(), owner->getName());
+    internals.frameNumber = renderContext.frameNumber;
     owner->notifyCommandBufferSources(renderContext);
     owner->notifyImageViews(renderContext, imageRange);
     // no operations sent to command buffer
@@ -101,7 +112,7 @@ struct SetImageOperation : public MemoryImage::Operation
     if (memoryIsLocal)
     {
       // copy texture data to staging buffer manually
-      auto stagingBuffer = renderContext.device->acquireStagingBuffer(nullptr, texture->size());
+      auto stagingBuffer = renderContext.device->acquireStagingBuffer(nullptr, texture->size(), gli::block_size(texture->format()));
       unsigned char* mapAddress = (unsigned char*)stagingBuffer->mapMemory(texture->size());
       size_t offset = 0;
       for (uint32_t layer = sourceRange.baseArrayLayer; layer < sourceRange.baseArrayLayer + sourceRange.layerCount; ++layer)
@@ -116,7 +127,7 @@ struct SetImageOperation : public MemoryImage::Operation
 
       // we have to copy a texture to local device memory using staging buffers
       std::vector<VkBufferImageCopy> bufferCopyRegions;
-      offset = 0;
+      offset = stagingBuffer->bufferOffset();
       for (uint32_t layer = imageRange.baseArrayLayer ; layer < imageRange.baseArrayLayer + imageRange.layerCount; ++layer)
       {
         for (uint32_t level = imageRange.baseMipLevel; level < imageRange.baseMipLevel + imageRange.levelCount; ++level)
@@ -137,17 +148,15 @@ struct SetImageOperation : public MemoryImage::Operation
           offset += texture->size(level);
         }
       }
-      // Image barrier for optimal image (target)
-      // Optimal image will be used as destination for the copy
-      commandBuffer->setImageLayout( *(internals.image), aspectMask, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-      // Copy mip levels from staging buffer
-      commandBuffer->cmdCopyBufferToImage(stagingBuffer->buffer, *(internals.image), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyRegions);
-
-      // Change texture image layout to shader read after all mip levels have been copied
-      commandBuffer->setImageLayout( *(internals.image), aspectMask, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-
-      stagingBuffers.push_back(stagingBuffer);
+      // UploadBatch changes image layout to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies mip levels from staging buffer
+      // and then changes image layout to VK_IMAGE_LAYOUT_GENERAL, together with all other uploads of this frame.
+      // Whole image created in previous frames from owner's allocator may be streamed through transfer queue into a new image. New images have nothing
+      // to show in the meantime, so they are written by the frame
+      bool wholeImage = (imageRange.baseMipLevel == 0) && (imageRange.levelCount >= imageTraits.mipLevels) && (imageRange.baseArrayLayer == 0) && (imageRange.layerCount >= imageTraits.arrayLayers);
+      if (wholeImage && renderContext.uploadBatch->getStreamLatency() > 0 && internals.frameNumber != renderContext.frameNumber && owner->getSharedMemory() == nullptr && owner->getAttachmentMemoryPool() == nullptr)
+        owner->streamImage(renderContext, imageTraits, stagingBuffer, aspectMask, bufferCopyRegions);
+      else
+        renderContext.uploadBatch->addImageUpload(stagingBuffer, internals.image, aspectMask, bufferCopyRegions);
     }
     else
     {
@@ -174,19 +183,12 @@ struct SetImageOperation : public MemoryImage::Operation
       commandBuffer->setImageLayout(*(internals.image), aspectMask, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
     }
 
-    // if memory is accessible from host ( is not local ) - we generated no commands to command buffer
-    return memoryIsLocal;
-  }
-  void releaseResources(const RenderContext& renderContext) override
-  {
-    for (auto& s : stagingBuffers)
-      renderContext.device->releaseStagingBuffer(s);
-    stagingBuffers.clear();
+    // if memory is local - copies are recorded by UploadBatch. Otherwise layout change must be submitted
+    return !memoryIsLocal;
   }
 
-  std::shared_ptr<gli::texture>               texture;
-  ImageSubresourceRange                       sourceRange;
-  std::vector<std::shared_ptr<StagingBuffer>> stagingBuffers;
+  std::shared_ptr<gli::texture> texture;
+  ImageSubresourceRange         sourceRange;
 };
 
 struct NotifyImageViewsOperation : public MemoryImage::Operation
@@ -227,8 +229,9 @@ struct ClearImageOperation : public MemoryImage::Operation
 MemoryImage::MemoryImage(const ImageTraits& it, std::shared_ptr<DeviceMemoryAllocator> a, VkImageAspectFlags am, PerObjectBehaviour pob, SwapChainImageBehaviour scib, bool stpo, bool useSetImageMethods)
   : MemoryObject(MemoryObject::moImage), perObjectBehaviour{ pob }, swapChainImageBehaviour{ scib }, sameTraitsPerObject{ stpo }, imageTraits{ it }, allocator { a }, aspectMask{ am }, activeCount{ 1 }
 {
+  // image that may be written to may also be copied to a new place during defragmentation
   if(useSetImageMethods)
-    imageTraits.usage = imageTraits.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageTraits.usage = imageTraits.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 }
 
 MemoryImage::MemoryImage(std::shared_ptr<gli::texture> tex, std::shared_ptr<DeviceMemoryAllocator> a, VkImageAspectFlags am, VkImageUsageFlags iu, PerObjectBehaviour pob)
@@ -241,14 +244,15 @@ MemoryImage::MemoryImage(std::shared_ptr<gli::texture> tex, std::shared_ptr<Devi
 
   texture     = tex;
   imageTraits = getImageTraitsFromTexture(*texture, iu);
-  // flag VK_IMAGE_USAGE_TRANSFER_DST_BIT because user wants to send gli::texture to GPU memory
-  imageTraits.usage = imageTraits.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  // flag VK_IMAGE_USAGE_TRANSFER_DST_BIT because user wants to send gli::texture to GPU memory. VK_IMAGE_USAGE_TRANSFER_SRC_BIT enables defragmentation
+  imageTraits.usage = imageTraits.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 }
 
 MemoryImage::~MemoryImage()
 {
   std::lock_guard<std::mutex> lock(mutex);
   perObjectData.clear();
+  streamedImages.clear();
 }
 
 MemoryImage* MemoryImage::asMemoryImage()
@@ -282,6 +286,20 @@ void MemoryImage::setImageTraits(Surface* surface, const ImageTraits& traits)
   internalSetImageTraits(surface->getID(), surface->device.lock()->device, surface->surface, traits, aspectMask);
 }
 
+void MemoryImage::setSharedMemory(std::shared_ptr<SharedImageMemory> sm)
+{
+  CHECK_LOG_THROW(sameTraitsPerObject, "Cannot use shared memory - MemoryImage uses the same traits per each surface");
+  std::lock_guard<std::mutex> lock(mutex);
+  sharedMemory = sm;
+}
+
+void MemoryImage::setAttachmentMemoryPool(std::shared_ptr<AttachmentMemoryPool> mp)
+{
+  CHECK_LOG_THROW(sameTraitsPerObject, "Cannot use attachment memory pool - MemoryImage uses the same traits per each surface");
+  std::lock_guard<std::mutex> lock(mutex);
+  attachmentMemoryPool = mp;
+}
+
 void MemoryImage::setImageTraits(Device* device, const ImageTraits& traits)
 {
   CHECK_LOG_THROW(perObjectBehaviour != pbPerDevice, "Cannot set image traits per device for this texture");
@@ -413,15 +431,15 @@ Image* MemoryImage::getImage(const RenderContext& renderContext) const
   auto pddit = perObjectData.find(getKeyID(renderContext, perObjectBehaviour));
   if (pddit == end(perObjectData))
     return nullptr;
-  return pddit->second.data[renderContext.activeIndex % activeCount].image.get();
+  return pddit->second.data[getActiveIndex(renderContext, swapChainImageBehaviour) % activeCount].image.get();
 }
 
 void MemoryImage::validate(const RenderContext& renderContext)
 {
   std::lock_guard<std::mutex> lock(mutex);
-  if (swapChainImageBehaviour == swForEachImage && renderContext.imageCount > activeCount)
+  if (getActiveCount(renderContext, swapChainImageBehaviour) > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = getActiveCount(renderContext, swapChainImageBehaviour);
     for (auto& pdd : perObjectData)
     {
       pdd.second.resize(activeCount);
@@ -433,7 +451,14 @@ void MemoryImage::validate(const RenderContext& renderContext)
   auto pddit = perObjectData.find(keyValue);
   if (pddit == end(perObjectData))
     pddit = perObjectData.insert({ keyValue, MemoryImageData(renderContext, swapChainImageBehaviour) }).first;
-  uint32_t activeIndex = renderContext.activeIndex % activeCount;
+  uint32_t activeIndex = getActiveIndex(renderContext, swapChainImageBehaviour) % activeCount;
+  // allocator may ask to move the data during defragmentation
+  if (!relocatedImages.empty())
+    releaseRelocatedImages(renderContext);
+  if (allocator->isDefragmenting() && pddit->second.data[activeIndex].image != nullptr)
+    relocateImage(renderContext, pddit->second.data[activeIndex]);
+  // data streamed through transfer queue replaces current image when frame acquires it
+  bool streamPending = !streamedImages.empty() && replaceStreamedImage(renderContext, keyValue, activeIndex);
   if (pddit->second.valid[activeIndex])
     return;
 
@@ -447,7 +472,8 @@ void MemoryImage::validate(const RenderContext& renderContext)
   // images are created here, when MemoryImage uses sameTraitsPerObject - otherwise it's a reponsibility of the user to create them through setImageTraits() call
   if (pddit->second.data[activeIndex].image == nullptr && sameTraitsPerObject)
   {
-    pddit->second.data[activeIndex].image = std::make_shared<Image>(renderContext.device, imageTraits, allocator);
+    pddit->second.data[activeIndex].image       = std::make_shared<Image>(renderContext.device, imageTraits, allocator, getName());
+    pddit->second.data[activeIndex].frameNumber = renderContext.frameNumber;
     notifyCommandBufferSources(renderContext);
     notifyImageViews(renderContext, ImageSubresourceRange(aspectMask, 0, imageTraits.mipLevels, 0, imageTraits.arrayLayers));
     // if there's a texture - it must be sent now
@@ -462,11 +488,15 @@ void MemoryImage::validate(const RenderContext& renderContext)
     bool submit = false;
     for (auto& texop : pddit->second.commonData.imageOperations)
     {
+      // operations following streamed data wait until it replaces current image
+      if (streamPending)
+        break;
       if (!texop->updated[activeIndex])
       {
         submit |= texop->perform(renderContext, pddit->second.data[activeIndex], cmdBuffer);
         // mark operation as done for this activeIndex
         texop->updated[activeIndex] = true;
+        streamPending = std::any_of(begin(streamedImages), end(streamedImages), [keyValue, activeIndex](const StreamedImage& si) { return si.key == keyValue && si.activeIndex == activeIndex; });
       }
     }
     renderContext.device->endSingleTimeCommands(cmdBuffer, renderContext.queue, submit);
@@ -475,7 +505,82 @@ void MemoryImage::validate(const RenderContext& renderContext)
     // if all operations are done for each index - remove them from list
     pddit->second.commonData.imageOperations.remove_if(([](std::shared_ptr<Operation> texop) { return texop->allUpdated(); }));
   }
-  pddit->second.valid[activeIndex] = true;
+  // image waiting for streamed data must be validated again in next frames
+  pddit->second.valid[activeIndex] = !streamPending;
+}
+
+void MemoryImage::streamImage(const RenderContext& renderContext, const ImageTraits& traits, std::shared_ptr<StagingBuffer> stagingBuffer, VkImageAspectFlags aspectMask, const std::vector<VkBufferImageCopy>& regions)
+{
+  auto image = std::make_shared<Image>(renderContext.device, traits, allocator, getName());
+  renderContext.uploadBatch->addImageUpload(stagingBuffer, image, aspectMask, regions, true);
+  uint32_t activeIndex = getActiveIndex(renderContext, swapChainImageBehaviour) % activeCount;
+  streamedImages.push_back({ getKeyID(renderContext, perObjectBehaviour), activeIndex, renderContext.frameNumber + renderContext.uploadBatch->getStreamLatency(), image });
+}
+
+bool MemoryImage::replaceStreamedImage(const RenderContext& renderContext, uint32_t key, uint32_t activeIndex)
+{
+  auto it = std::find_if(begin(streamedImages), end(streamedImages), [key, activeIndex](const StreamedImage& si) { return si.key == key && si.activeIndex == activeIndex; });
+  if (it == end(streamedImages))
+    return false;
+  if (it->readyFrame > renderContext.frameNumber)
+    return true;
+  // old image may still be used by frames in flight
+  auto& internals = perObjectData.at(key).data[activeIndex];
+  relocatedImages.push_back({ renderContext.frameNumber, internals.image });
+  internals.image       = it->image;
+  internals.frameNumber = renderContext.frameNumber;
+  streamedImages.erase(it);
+  notifyCommandBufferSources(renderContext);
+  notifyImageViews(renderContext, getFullImageRange());
+  return false;
+}
+
+void MemoryImage::relocateImage(const RenderContext& renderContext, MemoryImageInternal& internals)
+{
+  // only images that are copyable and that stay in VK_IMAGE_LAYOUT_GENERAL between frames may be moved. Attachment layouts are controlled by render passes
+  const ImageTraits& traits               = internals.image->getImageTraits();
+  const VkImageUsageFlags transferUsage   = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+  if ((traits.usage & transferUsage) != transferUsage || (traits.usage & attachmentUsage) != 0)
+    return;
+  // image waiting for its uploads is not in VK_IMAGE_LAYOUT_GENERAL during the copies - it will be moved in one of the next frames
+  if (renderContext.uploadBatch->hasImageUploads(internals.image->getHandleImage()))
+    return;
+
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(renderContext.vkDevice, internals.image->getHandleImage(), &memReqs);
+  DeviceMemoryBlock memoryBlock = allocator->relocate(renderContext.device, renderContext.frameNumber, internals.image->getMemoryBlock(), memReqs);
+  if (memoryBlock.alignedSize == 0)
+    return;
+  auto relocated = std::make_shared<Image>(renderContext.device, traits, allocator, memoryBlock);
+
+  std::vector<VkImageCopy> regions;
+  for (uint32_t level = 0; level < traits.mipLevels; ++level)
+  {
+    VkImageCopy region{};
+      region.srcSubresource.aspectMask     = aspectMask;
+      region.srcSubresource.mipLevel       = level;
+      region.srcSubresource.baseArrayLayer = 0;
+      region.srcSubresource.layerCount     = traits.arrayLayers;
+      region.dstSubresource                = region.srcSubresource;
+      region.extent.width                  = std::max(1u, traits.extent.width >> level);
+      region.extent.height                 = std::max(1u, traits.extent.height >> level);
+      region.extent.depth                  = std::max(1u, traits.extent.depth >> level);
+    regions.push_back(region);
+  }
+  // copy is recorded by UploadBatch before the frame. Old image lives until all frames that could use it are finished ( see releaseRelocatedImages() )
+  renderContext.uploadBatch->addImageCopy(internals.image, relocated, aspectMask, regions);
+
+  relocatedImages.push_back({ renderContext.frameNumber, internals.image });
+  internals.image = relocated;
+  notifyCommandBufferSources(renderContext);
+  notifyImageViews(renderContext, getFullImageRange());
+}
+
+void MemoryImage::releaseRelocatedImages(const RenderContext& renderContext)
+{
+  // all frames that could use the old image are finished
+  relocatedImages.remove_if([&renderContext](const RelocatedImage& ri) { return ri.frameNumber + renderContext.activeCount < renderContext.frameNumber; });
 }
 
 ImageSubresourceRange MemoryImage::getFullImageRange()
@@ -533,6 +638,9 @@ void MemoryImage::internalSetImageTraits(uint32_t key, VkDevice device, VkSurfac
   pddit->second.commonData.imageOperations.push_back(std::make_shared<SetImageTraitsOperation>(this, traits, aMask, activeCount));
   pddit->second.invalidate();
   invalidateImageViews();
+  // shared memory must know traits of all images before first of them is created
+  if (sharedMemory != nullptr)
+    sharedMemory->setImageTraits(key, this, traits);
 }
 
 // caution : mutex lock must be called prior to this method
@@ -566,7 +674,7 @@ void MemoryImage::internalSetImages(uint32_t key, VkDevice device, VkSurfaceKHR
     CHECK_LOG_THROW(images[i]->getDevice() != device, "Cannot set foreign images for this texture - mismatched devices");
   }
 
-  if (swapChainImageBehaviour == swForEachImage && images.size() > activeCount)
+  if (swapChainImageBehaviour != swOnce && images.size() > activeCount)
   {
     activeCount = images.size();
     for (auto& pdd : perObjectData)
@@ -610,6 +718,153 @@ void MemoryImage::internalClearImage(uint32_t key, VkDevice device, VkSurfaceKHR
   pddit->second.invalidate();
 }
 
+SharedImageMemory::SharedImageMemory(std::shared_ptr<DeviceMemoryAllocator> a)
+  : allocator{ a }
+{
+}
+
+void SharedImageMemory::setImageTraits(uint32_t key, const MemoryImage* memoryImage, const ImageTraits& traits)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& data = perObjectData[key];
+  data.imageTraits[memoryImage] = traits;
+  // images created from now on will use new memory block. Old block is released when last image using it is destroyed
+  data.valid = false;
+}
+
+std::shared_ptr<DeviceMemoryBlock> SharedImageMemory::getMemoryBlock(const RenderContext& renderContext, uint32_t key)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = perObjectData.find(key);
+  if (pddit == end(perObjectData))
+    return nullptr;
+  if (pddit->second.valid)
+    return pddit->second.memoryBlock;
+
+  // memory must be big enough and properly aligned for each image
+  VkMemoryRequirements memReqs{ 0, 1, ~0u };
+  for (const auto& traits : pddit->second.imageTraits)
+  {
+    VkMemoryRequirements imageMemReqs = getImageMemoryRequirements(renderContext.vkDevice, traits.second);
+    memReqs.size            = std::max(memReqs.size, imageMemReqs.size);
+    memReqs.alignment       = std::max(memReqs.alignment, imageMemReqs.alignment);
+    memReqs.memoryTypeBits &= imageMemReqs.memoryTypeBits;
+  }
+  pddit->second.memoryBlock = nullptr;
+  pddit->second.valid       = true;
+  if (memReqs.memoryTypeBits == 0)
+    return nullptr;
+
+  DeviceMemoryBlock block = allocator->allocate(renderContext.device, memReqs, "shared image memory");
+  CHECK_LOG_THROW(block.alignedSize == 0, "Cannot allocate shared memory for images");
+  auto alloc  = allocator;
+  auto device = renderContext.vkDevice;
+  pddit->second.memoryBlock = std::shared_ptr<DeviceMemoryBlock>(new DeviceMemoryBlock(block), [alloc, device](DeviceMemoryBlock* mb) { alloc->deallocate(device, *mb); delete mb; });
+  return pddit->second.memoryBlock;
+}
+
+bool AttachmentMemoryPool::PoolKey::operator<(const PoolKey& rhs) const
+{
+  return std::tie(format, usage, samples, linearTiling, imageCreate) < std::tie(rhs.format, rhs.usage, rhs.samples, rhs.linearTiling, rhs.imageCreate);
+}
+
+AttachmentMemoryPool::AttachmentMemoryPool(std::shared_ptr<DeviceMemoryAllocator> a, float sr)
+  : allocator{ a }, sizeReserve{ sr }
+{
+  CHECK_LOG_THROW(sizeReserve < 1.0f, "AttachmentMemoryPool : size reserve must not be lower than 1.0");
+}
+
+AttachmentMemoryPool::~AttachmentMemoryPool()
+{
+  for (auto& pdd : unusedBlocks)
+    for (auto& blocks : pdd.second)
+      for (auto& block : blocks.second)
+        allocator->deallocate(pdd.first, block);
+}
+
+std::shared_ptr<DeviceMemoryBlock> AttachmentMemoryPool::acquire(Device* device, const ImageTraits& traits)
+{
+  VkMemoryRequirements memReqs = getImageMemoryRequirements(device->device, traits);
+  PoolKey key{ traits.format, traits.usage, traits.samples, traits.linearTiling, traits.imageCreate };
+  DeviceMemoryBlock block;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& blocks = unusedBlocks[device->device][key];
+    // find the smallest unused block that is able to hold the image
+    auto bit = end(blocks);
+    for (auto it = begin(blocks); it != end(blocks); ++it)
+    {
+      if (it->alignedSize < memReqs.size || (it->alignedOffset % memReqs.alignment) != 0)
+        continue;
+      if (bit == end(blocks) || it->alignedSize < bit->alignedSize)
+        bit = it;
+    }
+    if (bit != end(blocks))
+    {
+      block = *bit;
+      blocks.erase(bit);
+    }
+    else
+    {
+      // images have outgrown unused blocks ( e.g. window was enlarged ) - these blocks will not be needed anymore
+      for (auto& b : blocks)
+        allocator->deallocate(device->device, b);
+      blocks.clear();
+    }
+  }
+  if (block.alignedSize == 0)
+  {
+    VkMemoryRequirements reservedReqs = memReqs;
+    reservedReqs.size = static_cast<VkDeviceSize>(memReqs.size * sizeReserve);
+    block = allocator->allocate(device, reservedReqs, "attachment memory pool");
+    CHECK_LOG_THROW(block.alignedSize == 0, "Cannot allocate memory for attachment");
+  }
+
+  std::weak_ptr<AttachmentMemoryPool> pool = shared_from_this();
+  auto alloc    = allocator;
+  auto vkDevice = device->device;
+  return std::shared_ptr<DeviceMemoryBlock>(new DeviceMemoryBlock(block), [pool, alloc, vkDevice, key](DeviceMemoryBlock* mb)
+  {
+    auto poolSh = pool.lock();
+    if (poolSh != nullptr)
+      poolSh->release(vkDevice, key, *mb);
+    else
+      alloc->deallocate(vkDevice, *mb);
+    delete mb;
+  });
+}
+
+void AttachmentMemoryPool::release(VkDevice device, const PoolKey& key, const DeviceMemoryBlock& block)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  unusedBlocks[device][key].push_back(block);
+}
+
+void AttachmentMemoryPool::releaseUnusedMemory(VkDevice device)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto pddit = unusedBlocks.find(device);
+  if (pddit == end(unusedBlocks))
+    return;
+  for (auto& blocks : pddit->second)
+    for (auto& block : blocks.second)
+      allocator->deallocate(device, block);
+  unusedBlocks.erase(pddit);
+}
+
+VkDeviceSize AttachmentMemoryPool::getUnusedSize(VkDevice device) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  VkDeviceSize result = 0;
+  auto pddit = unusedBlocks.find(device);
+  if (pddit == end(unusedBlocks))
+    return result;
+  for (auto& blocks : pddit->second)
+    for (auto& block : blocks.second)
+      result += block.alignedSize;
+  return result;
+}
+
 ImageView::ImageView(std::shared_ptr<MemoryImage> mi, const ImageSubresourceRange& sr, VkImageViewType vt, VkFormat f, const gli::swizzles& sw)
   : std::enable_shared_from_this<ImageView>(), memoryImage{ mi }, subresourceRange{ sr }, viewType{ vt }, swizzles{ sw }, activeCount{ 1 }
 {
@@ -636,7 +891,7 @@ VkImageView ImageView::getImageView(const RenderContext& renderContext) const
   auto pddit = perObjectData.find(keyValue);
   if (pddit == perObjectData.end())
     return VK_NULL_HANDLE;
-  uint32_t activeIndex = renderContext.activeIndex % activeCount;
+  uint32_t activeIndex = getActiveIndex(renderContext, memoryImage->getSwapChainImageBehaviour()) % activeCount;
   return pddit->second.data[activeIndex].imageView;
 }
 
@@ -649,9 +904,9 @@ void ImageView::validate(const RenderContext& renderContext)
   }
   memoryImage->validate(renderContext);
   std::lock_guard<std::mutex> lock(mutex);
-  if (memoryImage->getSwapChainImageBehaviour() == swForEachImage && renderContext.imageCount > activeCount)
+  if (getActiveCount(renderContext, memoryImage->getSwapChainImageBehaviour()) > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = getActiveCount(renderContext, memoryImage->getSwapChainImageBehaviour());
     for (auto& pdd : perObjectData)
       pdd.second.resize(activeCount);
   }
@@ -659,7 +914,7 @@ void ImageView::validate(const RenderContext& renderContext)
   auto pddit = perObjectData.find(keyValue);
   if (pddit == end(perObjectData))
     pddit = perObjectData.insert({ keyValue, ImageViewData(renderContext, memoryImage->getSwapChainImageBehaviour()) }).first;
-  uint32_t activeIndex = renderContext.activeIndex % activeCount;
+  uint32_t activeIndex = getActiveIndex(renderContext, memoryImage->getSwapChainImageBehaviour()) % activeCount;
   if (pddit->second.valid[activeIndex])
     return;
 
@@ -25,22 +25,22 @@
 using namespace pumex;
 
 MemoryObjectBarrier::MemoryObjectBarrier()
-: objectType(MemoryObject::moUndefined), srcAccessMask{ 0 }, dstAccessMask{ 0 }, srcQueueFamilyIndex{ 0 }, dstQueueFamilyIndex{ 0 }
+: objectType(MemoryObject::moUndefined), srcAccessMask{ 0 }, dstAccessMask{ 0 }, srcQueueIndex{ VK_QUEUE_FAMILY_IGNORED }, dstQueueIndex{ VK_QUEUE_FAMILY_IGNORED }
 {
 }
 
-MemoryObjectBarrier::MemoryObjectBarrier(VkAccessFlags sam, VkAccessFlags dam, uint32_t sqfi, uint32_t dqfi, std::shared_ptr<MemoryObject> mo, VkImageLayout ol, VkImageLayout nl, const ImageSubresourceRange& ir)
-  : objectType(MemoryObject::moImage), srcAccessMask{ sam }, dstAccessMask{ dam }, srcQueueFamilyIndex{ sqfi }, dstQueueFamilyIndex{ dqfi }, memoryObject{ mo }, oldLayout{ ol }, newLayout{ nl }, imageRange{ ir }, bufferRange{}
+MemoryObjectBarrier::MemoryObjectBarrier(VkAccessFlags sam, VkAccessFlags dam, uint32_t sqi, uint32_t dqi, std::shared_ptr<MemoryObject> mo, VkImageLayout ol, VkImageLayout nl, const ImageSubresourceRange& ir)
+  : objectType(MemoryObject::moImage), srcAccessMask{ sam }, dstAccessMask{ dam }, srcQueueIndex{ sqi }, dstQueueIndex{ dqi }, memoryObject{ mo }, oldLayout{ ol }, newLayout{ nl }, imageRange{ ir }, bufferRange{}
 {
 }
 
-MemoryObjectBarrier::MemoryObjectBarrier(VkAccessFlags sam, VkAccessFlags dam, uint32_t sqfi, uint32_t dqfi, std::shared_ptr<MemoryObject> mo, const BufferSubresourceRange& br)
-  : objectType(MemoryObject::moBuffer), srcAccessMask{ sam }, dstAccessMask{ dam }, srcQueueFamilyIndex{ sqfi }, dstQueueFamilyIndex{ dqfi }, memoryObject{ mo }, oldLayout{ VK_IMAGE_LAYOUT_UNDEFINED }, newLayout{ VK_IMAGE_LAYOUT_UNDEFINED }, imageRange{}, bufferRange{ br }
+MemoryObjectBarrier::MemoryObjectBarrier(VkAccessFlags sam, VkAccessFlags dam, uint32_t sqi, uint32_t dqi, std::shared_ptr<MemoryObject> mo, const BufferSubresourceRange& br)
+  : objectType(MemoryObject::moBuffer), srcAccessMask{ sam }, dstAccessMask{ dam }, srcQueueIndex{ sqi }, dstQueueIndex{ dqi }, memoryObject{ mo }, oldLayout{ VK_IMAGE_LAYOUT_UNDEFINED }, newLayout{ VK_IMAGE_LAYOUT_UNDEFINED }, imageRange{}, bufferRange{ br }
 {
 }
 
 MemoryObjectBarrier::MemoryObjectBarrier(const MemoryObjectBarrier& rhs)
-  : objectType(rhs.objectType), srcAccessMask{ rhs.srcAccessMask }, dstAccessMask{ rhs.dstAccessMask }, srcQueueFamilyIndex{ rhs.srcQueueFamilyIndex }, dstQueueFamilyIndex{ rhs.dstQueueFamilyIndex }, memoryObject{ rhs.memoryObject },
+  : objectType(rhs.objectType), srcAccessMask{ rhs.srcAccessMask }, dstAccessMask{ rhs.dstAccessMask }, srcQueueIndex{ rhs.srcQueueIndex }, dstQueueIndex{ rhs.dstQueueIndex }, memoryObject{ rhs.memoryObject },
     oldLayout{ rhs.oldLayout }, newLayout{ rhs.newLayout }, imageRange{ rhs.imageRange }, bufferRange{ rhs.bufferRange }
 {
 }
@@ -52,8 +52,8 @@ MemoryObjectBarrier& MemoryObjectBarrier::operator=(const MemoryObjectBarrier& r
     objectType            = rhs.objectType;
     srcAccessMask         = rhs.srcAccessMask;
     dstAccessMask         = rhs.dstAccessMask;
-    srcQueueFamilyIndex   = rhs.srcQueueFamilyIndex;
-    dstQueueFamilyIndex   = rhs.dstQueueFamilyIndex;
+    srcQueueIndex         = rhs.srcQueueIndex;
+    dstQueueIndex         = rhs.dstQueueIndex;
     memoryObject          = rhs.memoryObject;
     oldLayout             = rhs.oldLayout;
     newLayout             = rhs.newLayout;
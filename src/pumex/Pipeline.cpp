@@ -227,9 +227,9 @@ void GraphicsPipeline::validate(const RenderContext& renderContext)
   pipelineCache->validate(renderContext);
   pipelineLayout->validate(renderContext);
 
-  if (renderContext.imageCount > activeCount)
+  if (renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perDeviceData)
       pdd.second.resize(activeCount);
   }
@@ -450,9 +450,9 @@ void ComputePipeline::validate(const RenderContext& renderContext)
   pipelineCache->validate(renderContext);
   pipelineLayout->validate(renderContext);
 
-  if (renderContext.imageCount > activeCount)
+  if (renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perDeviceData)
       pdd.second.resize(activeCount);
   }
@@ -22,6 +22,7 @@
 
 #include <pumex/RenderContext.h>
 #include <pumex/Device.h>
+#include <pumex/Viewer.h>
 #include <pumex/Surface.h>
 #include <pumex/Command.h>
 #include <pumex/FrameBuffer.h>
@@ -32,8 +33,9 @@ using namespace pumex;
 
 RenderContext::RenderContext(Surface* s, uint32_t queueNumber)
   : surface { s }, vkSurface{ s->surface }, commandPool{ s->commandPools[queueNumber] }, queue{s->queues[queueNumber]->queue},
-    device{ s->device.lock().get() }, vkDevice{ device->device }, descriptorPool{ device->getDescriptorPool().get() },
-    activeIndex{ s->getImageIndex() }, imageCount{ s->getImageCount() }
+    device{ s->device.lock().get() }, vkDevice{ device->device }, descriptorPool{ device->getDescriptorPool().get() }, uploadBatch{ s->uploadBatch.get() },
+    activeIndex{ s->getFrameIndex() }, activeCount{ s->getFrameCount() }, imageIndex{ s->getImageIndex() }, imageCount{ s->getImageCount() },
+    frameNumber{ s->viewer.lock()->getFrameNumber() }
 {
 }
 
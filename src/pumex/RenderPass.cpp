@@ -183,9 +183,9 @@ void RenderPass::invalidate(const RenderContext& renderContext)
 void RenderPass::validate(const RenderContext& renderContext)
 {
   std::lock_guard<std::mutex> lock(mutex);
-  if (renderContext.imageCount > activeCount)
+  if (renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perObjectData)
       pdd.second.resize(activeCount);
   }
@@ -284,8 +284,21 @@ void RenderSubPass::applyRenderContextVisitor(RenderContextVisitor& visitor)
   visitor.renderContext.setFrameBuffer(nullptr);
 }
 
+static bool rendersToSurface(const RenderPass* renderPass)
+{
+  if (renderPass->frameBuffer == nullptr)
+    return false;
+  for (uint32_t i = 0; i < renderPass->frameBuffer->getNumImageDefinitions(); ++i)
+    if (renderPass->frameBuffer->getImageDefinition(i).attachmentType == atSurface)
+      return true;
+  return false;
+}
+
 void RenderSubPass::buildCommandBuffer(BuildCommandBufferVisitor& commandVisitor)
 {
+  // rate limited operation is skipped completely ( with its render pass and barriers ) in frames when it's not updated
+  if (!commandVisitor.renderContext.surface->isOperationUpdated(operation.get()))
+    return;
   commandVisitor.renderContext.setFrameBuffer(renderPass->frameBuffer);
   commandVisitor.renderContext.setRenderPass(renderPass);
   commandVisitor.renderContext.setSubpassIndex(subpassIndex);
@@ -302,9 +315,13 @@ void RenderSubPass::buildCommandBuffer(BuildCommandBufferVisitor& commandVisitor
     switch (operation->attachmentSize.attachmentSize)
     {
     case AttachmentSize::SurfaceDependent:
-      rectangle = makeVkRect2D(0, 0, commandVisitor.renderContext.surface->swapChainSize.width * operation->attachmentSize.imageSize.x, commandVisitor.renderContext.surface->swapChainSize.height * operation->attachmentSize.imageSize.y);
-      viewport  = makeViewport(0, 0, commandVisitor.renderContext.surface->swapChainSize.width * operation->attachmentSize.imageSize.x, commandVisitor.renderContext.surface->swapChainSize.height * operation->attachmentSize.imageSize.y, 0.0f, 1.0f);
+    {
+      // dynamic resolution : render passes that do not render to swapchain images use only a part of their attachments
+      float scale = rendersToSurface(renderPass.get()) ? 1.0f : commandVisitor.renderContext.surface->getRenderResolutionScale();
+      rectangle = makeVkRect2D(0, 0, commandVisitor.renderContext.surface->swapChainSize.width * operation->attachmentSize.imageSize.x * scale, commandVisitor.renderContext.surface->swapChainSize.height * operation->attachmentSize.imageSize.y * scale);
+      viewport  = makeViewport(0, 0, commandVisitor.renderContext.surface->swapChainSize.width * operation->attachmentSize.imageSize.x * scale, commandVisitor.renderContext.surface->swapChainSize.height * operation->attachmentSize.imageSize.y * scale, 0.0f, 1.0f);
       break;
+    }
     case AttachmentSize::Absolute:
       rectangle = makeVkRect2D(0, 0, operation->attachmentSize.imageSize.x, operation->attachmentSize.imageSize.y);
       viewport  = makeViewport(0, 0, operation->attachmentSize.imageSize.x, operation->attachmentSize.imageSize.y, 0.0f, 1.0f);
@@ -324,10 +341,14 @@ void RenderSubPass::buildCommandBuffer(BuildCommandBufferVisitor& commandVisitor
     commandVisitor.commandBuffer->cmdNextSubPass(this, subpassContents);
   }
 
-  if (subpassContents == VK_SUBPASS_CONTENTS_INLINE)
-    operation->node->accept(commandVisitor);
-  else
-    commandVisitor.commandBuffer->executeCommandBuffer(commandVisitor.renderContext, operation->node->getSecondaryBuffer(commandVisitor.renderContext).get());
+  // disabled operation still performs load operations and layout transitions of its subpass
+  if (operation->enabled)
+  {
+    if (subpassContents == VK_SUBPASS_CONTENTS_INLINE)
+      operation->node->accept(commandVisitor);
+    else
+      commandVisitor.commandBuffer->executeCommandBuffer(commandVisitor.renderContext, operation->node->getSecondaryBuffer(commandVisitor.renderContext).get());
+  }
 
   if (renderPass->subPasses.size() == subpassIndex + 1)
     commandVisitor.commandBuffer->cmdEndRenderPass();
@@ -373,16 +394,22 @@ void ComputePass::applyRenderContextVisitor(RenderContextVisitor& visitor)
 
 void ComputePass::buildCommandBuffer(BuildCommandBufferVisitor& commandVisitor)
 {
+  if (!commandVisitor.renderContext.surface->isOperationUpdated(operation.get()))
+    return;
   commandVisitor.renderContext.setRenderOperation(operation);
 
   for (auto& barrierGroup : barriersBeforeOp)
     commandVisitor.commandBuffer->cmdPipelineBarrier(commandVisitor.renderContext, barrierGroup.first, barrierGroup.second);
 
-  VkSubpassContents subpassContents = operation->node->hasSecondaryBuffer() ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
-  if (subpassContents == VK_SUBPASS_CONTENTS_INLINE)
-    operation->node->accept(commandVisitor);
-  else
-    commandVisitor.commandBuffer->executeCommandBuffer(commandVisitor.renderContext, operation->node->getSecondaryBuffer(commandVisitor.renderContext).get());
+  // disabled operation still records its barriers, so the following operations see resources in expected layouts
+  if (operation->enabled)
+  {
+    VkSubpassContents subpassContents = operation->node->hasSecondaryBuffer() ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+    if (subpassContents == VK_SUBPASS_CONTENTS_INLINE)
+      operation->node->accept(commandVisitor);
+    else
+      commandVisitor.commandBuffer->executeCommandBuffer(commandVisitor.renderContext, operation->node->getSecondaryBuffer(commandVisitor.renderContext).get());
+  }
 
   for (auto& barrierGroup : barriersAfterOp)
     commandVisitor.commandBuffer->cmdPipelineBarrier(commandVisitor.renderContext, barrierGroup.first, barrierGroup.second);
@@ -24,10 +24,14 @@
 #include <algorithm>
 #include <sstream>
 #include <iterator>
+#include <limits>
+#include <utility>
 #include <pumex/Device.h>
 #include <pumex/DeviceMemoryAllocator.h>
 #include <pumex/FrameBuffer.h>
+#include <pumex/Image.h>
 #include <pumex/RenderPass.h>
+#include <pumex/utils/HashCombine.h>
 #include <pumex/utils/Log.h>
 
 using namespace pumex;
@@ -80,7 +84,7 @@ WorkflowResource::WorkflowResource(const std::string& n, std::shared_ptr<RenderW
 }
 
 RenderOperation::RenderOperation(const std::string& n, RenderOperation::Type t, uint32_t mvm, AttachmentSize at )
-  : name{ n }, operationType{ t }, multiViewMask{ mvm }, attachmentSize{ at }
+  : name{ n }, operationType{ t }, multiViewMask{ mvm }, attachmentSize{ at }, enabled{ true }, updatePeriod{ 1 }, updatePhase{ 0 }
 {
 }
 
@@ -147,8 +151,8 @@ FrameBufferImageDefinition RenderWorkflowResults::getSwapChainImageDefinition()
   return FrameBufferImageDefinition();
 }
 
-RenderWorkflow::RenderWorkflow(const std::string& n, std::shared_ptr<DeviceMemoryAllocator> fba, const std::vector<QueueTraits>& qt)
-  : name{ n }, frameBufferAllocator{ fba }, queueTraits{ qt }
+RenderWorkflow::RenderWorkflow(const std::string& n, std::shared_ptr<DeviceMemoryAllocator> fba, const std::vector<QueueTraits>& qt, std::shared_ptr<DeviceMemoryAllocator> taa)
+  : frameBufferAllocator{ fba }, transientAttachmentAllocator{ taa }, name{ n }, queueTraits{ qt }
 {
 }
 
@@ -222,6 +226,33 @@ std::shared_ptr<Node> RenderWorkflow::getRenderOperationNode(const std::string&
   return getRenderOperation(opName)->node;
 }
 
+void RenderWorkflow::setRenderOperationEnabled(const std::string& opName, bool enabled)
+{
+  auto operation = getRenderOperation(opName);
+  if (operation->enabled == enabled)
+    return;
+  // workflow does not need recompilation - surfaces rebuild their primary command buffers
+  operation->enabled = enabled;
+  operationStateNumber++;
+}
+
+bool RenderWorkflow::isRenderOperationEnabled(const std::string& opName) const
+{
+  return getRenderOperation(opName)->enabled;
+}
+
+void RenderWorkflow::setRenderOperationUpdatePeriod(const std::string& opName, uint32_t updatePeriod, uint32_t updatePhase)
+{
+  CHECK_LOG_THROW(updatePeriod == 0, "Update period of operation " << opName << " must be greater than 0");
+  CHECK_LOG_THROW(updatePhase >= updatePeriod, "Update phase of operation " << opName << " must be lower than its update period");
+  auto operation = getRenderOperation(opName);
+  if (operation->updatePeriod == updatePeriod && operation->updatePhase == updatePhase)
+    return;
+  operation->updatePeriod = updatePeriod;
+  operation->updatePhase  = updatePhase;
+  valid = false;
+}
+
 void RenderWorkflow::addAttachmentInput(const std::string& opName, const std::string& resourceType, const std::string& resourceName, VkImageLayout layout)
 {
   auto operation = getRenderOperation(opName);
@@ -530,12 +561,433 @@ bool RenderWorkflow::compile(std::shared_ptr<RenderWorkflowCompiler> compiler)
   std::lock_guard<std::mutex> lock(compileMutex);
   if (valid)
     return true;
-  workflowResults = compiler->compile(*this);
+  // workflow may return to structure it had before ( e.g. MSAA switched on and off ) - results compiled then may be reused.
+  // Hash only speeds up the search, the whole structure must be the same
+  StructureKey structureKey  = calculateStructureKey();
+  std::size_t  structureHash = structureKey.hash();
+  auto it = std::find_if(begin(resultsCache), end(resultsCache), [&](const CachedResults& cr) { return cr.structureHash == structureHash && cr.compiler == compiler && cr.structureKey == structureKey; });
+  if (it != end(resultsCache))
+  {
+    workflowResults = it->results;
+    resultsCache.splice(begin(resultsCache), resultsCache, it);
+  }
+  else
+  {
+    workflowResults = compiler->compile(*this);
+    if (resultsCacheSize > 0)
+    {
+      resultsCache.push_front(CachedResults{ structureHash, std::move(structureKey), compiler, workflowResults });
+      while (resultsCache.size() > resultsCacheSize)
+        resultsCache.pop_back();
+    }
+  }
+  compilationNumber++;
   valid = true;
   return true;
 };
 
-void StandardRenderWorkflowCostCalculator::tagOperationByAttachmentType(const RenderWorkflow& workflow)
+RenderWorkflow::StructureKey RenderWorkflow::calculateStructureKey() const
+{
+  StructureKey key;
+  for (const auto& op : renderOperations)
+    key.operations.emplace_back(op.second.get(), op.second->name, static_cast<uint32_t>(op.second->operationType), op.second->multiViewMask,
+      static_cast<uint32_t>(op.second->attachmentSize.attachmentSize), op.second->attachmentSize.imageSize.x, op.second->attachmentSize.imageSize.y, op.second->attachmentSize.imageSize.z,
+      op.second->updatePeriod, op.second->updatePhase);
+  std::set<const RenderWorkflowResourceType*> usedResourceTypes;
+  for (const auto& transition : transitions)
+  {
+    key.transitions.emplace_back(transition->operation->name, transition->resource->name, transition->resource->resourceType->typeName,
+      static_cast<uint32_t>(transition->transitionType), static_cast<uint32_t>(transition->layout),
+      static_cast<uint32_t>(transition->load.loadType), transition->load.clearColor.r, transition->load.clearColor.g, transition->load.clearColor.b, transition->load.clearColor.a,
+      (transition->resolveResource != nullptr) ? transition->resolveResource->name : std::string(),
+      transition->imageSubresourceRange.aspectMask, transition->imageSubresourceRange.baseMipLevel, transition->imageSubresourceRange.levelCount,
+      transition->imageSubresourceRange.baseArrayLayer, transition->imageSubresourceRange.layerCount,
+      transition->pipelineStage, transition->accessFlags, transition->bufferSubresourceRange.offset, transition->bufferSubresourceRange.range);
+    usedResourceTypes.insert(transition->resource->resourceType.get());
+  }
+  // only resource types that are in use affect the results
+  for (auto resourceType : usedResourceTypes)
+  {
+    if (resourceType->metaType == RenderWorkflowResourceType::Attachment)
+    {
+      const auto& attachment = resourceType->attachment;
+      key.resourceTypes.emplace_back(resourceType->typeName, static_cast<uint32_t>(resourceType->metaType), resourceType->persistent,
+        static_cast<uint32_t>(attachment.format), static_cast<uint32_t>(attachment.samples), static_cast<uint32_t>(attachment.attachmentType),
+        static_cast<uint32_t>(attachment.attachmentSize.attachmentSize), attachment.attachmentSize.imageSize.x, attachment.attachmentSize.imageSize.y, attachment.attachmentSize.imageSize.z,
+        attachment.imageUsage, static_cast<uint32_t>(attachment.swizzles.r), static_cast<uint32_t>(attachment.swizzles.g), static_cast<uint32_t>(attachment.swizzles.b), static_cast<uint32_t>(attachment.swizzles.a));
+    }
+    else
+      key.resourceTypes.emplace_back(resourceType->typeName, static_cast<uint32_t>(resourceType->metaType), resourceType->persistent, 0, 0, 0, 0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0);
+  }
+  // operations and transitions are stored in unordered containers, so the key must not depend on their order
+  std::sort(begin(key.operations), end(key.operations));
+  std::sort(begin(key.transitions), end(key.transitions));
+  std::sort(begin(key.resourceTypes), end(key.resourceTypes));
+  // associated memory objects are registered in the results, so the results depend on their identity
+  for (const auto& mo : associatedMemoryObjects)
+    key.memoryObjects.emplace_back(mo.first, mo.second.get());
+  for (const auto& iv : associatedMemoryImageViews)
+    key.memoryImageViews.emplace_back(iv.first, iv.second.get());
+  for (const auto& qt : queueTraits)
+    key.queues.emplace_back(qt.mustHave, qt.mustNotHave, qt.priority);
+  return key;
+}
+
+std::size_t RenderWorkflow::calculateStructureHash() const
+{
+  return calculateStructureKey().hash();
+}
+
+bool RenderWorkflow::StructureKey::operator==(const StructureKey& rhs) const
+{
+  return operations == rhs.operations && transitions == rhs.transitions && resourceTypes == rhs.resourceTypes &&
+    memoryObjects == rhs.memoryObjects && memoryImageViews == rhs.memoryImageViews && queues == rhs.queues;
+}
+
+template <typename Tuple, std::size_t... I>
+static void hashTuple(std::size_t& seed, const Tuple& t, std::index_sequence<I...>)
+{
+  hash_value(seed, std::get<I>(t)...);
+}
+
+template <typename... Types>
+static void hashTuples(std::size_t& seed, const std::vector<std::tuple<Types...>>& tuples)
+{
+  hash_value(seed, tuples.size());
+  for (const auto& t : tuples)
+    hashTuple(seed, t, std::index_sequence_for<Types...>{});
+}
+
+std::size_t RenderWorkflow::StructureKey::hash() const
+{
+  std::size_t result = 0;
+  hashTuples(result, operations);
+  hashTuples(result, transitions);
+  hashTuples(result, resourceTypes);
+  hashTuples(result, memoryObjects);
+  hashTuples(result, memoryImageViews);
+  hashTuples(result, queues);
+  return result;
+}
+
+void RenderWorkflow::setResultsCacheSize(uint32_t cacheSize)
+{
+  std::lock_guard<std::mutex> lock(compileMutex);
+  resultsCacheSize = cacheSize;
+  while (resultsCache.size() > resultsCacheSize)
+    resultsCache.pop_back();
+}
+
+void RenderWorkflow::clearResultsCache()
+{
+  std::lock_guard<std::mutex> lock(compileMutex);
+  resultsCache.clear();
+}
+
+static const char* getTransitionTypeName(ResourceTransitionTypeFlags transitionType)
+{
+  switch (transitionType)
+  {
+  case rttAttachmentInput:         return "attachmentInput";
+  case rttAttachmentOutput:        return "attachmentOutput";
+  case rttAttachmentResolveOutput: return "attachmentResolveOutput";
+  case rttAttachmentDepthOutput:   return "attachmentDepthOutput";
+  case rttAttachmentDepthInput:    return "attachmentDepthInput";
+  case rttBufferInput:             return "bufferInput";
+  case rttBufferOutput:            return "bufferOutput";
+  case rttImageInput:              return "imageInput";
+  case rttImageOutput:             return "imageOutput";
+  default:                         return "unknown";
+  }
+}
+
+// collects data from compilation results that is shared by dumpDOT() and dumpJSON()
+struct WorkflowDumpData
+{
+  explicit WorkflowDumpData(const RenderWorkflowResults* workflowResults)
+  {
+    if (workflowResults == nullptr)
+      return;
+    for (uint32_t i = 0; i < workflowResults->commands.size(); ++i)
+    {
+      for (uint32_t j = 0; j < workflowResults->commands[i].size(); ++j)
+      {
+        auto& command = workflowResults->commands[i][j];
+        commandPosition.insert({ command->operation->name, { i, j } });
+        if (command->commandType != RenderCommand::ctRenderSubPass)
+          continue;
+        auto renderPass = command->asRenderSubPass()->renderPass;
+        auto rpit       = std::find(begin(renderPasses), end(renderPasses), renderPass);
+        if (rpit == end(renderPasses))
+        {
+          rpit = renderPasses.insert(end(renderPasses), renderPass);
+          renderPassQueue.push_back(i);
+        }
+        renderPassIndex.insert({ command->operation->name, static_cast<uint32_t>(std::distance(begin(renderPasses), rpit)) });
+      }
+    }
+    for (auto& mi : workflowResults->registeredMemoryImages)
+      memoryObjectNames.insert({ mi.second.get(), mi.first });
+    for (auto& mb : workflowResults->registeredMemoryBuffers)
+      memoryObjectNames.insert({ mb.second.get(), mb.first });
+  }
+
+  std::string getMemoryObjectName(MemoryObject* memoryObject) const
+  {
+    auto it = memoryObjectNames.find(memoryObject);
+    return (it != end(memoryObjectNames)) ? it->second : std::string();
+  }
+
+  std::map<std::string, std::pair<uint32_t, uint32_t>> commandPosition;
+  std::map<std::string, uint32_t>                      renderPassIndex;
+  std::vector<std::shared_ptr<RenderPass>>             renderPasses;
+  std::vector<uint32_t>                                renderPassQueue;
+  std::map<MemoryObject*, std::string>                 memoryObjectNames;
+};
+
+static uint32_t getBarrierCount(const std::map<MemoryObjectBarrierGroup, std::vector<MemoryObjectBarrier>>& barriers)
+{
+  uint32_t result = 0;
+  for (auto& bg : barriers)
+    result += static_cast<uint32_t>(bg.second.size());
+  return result;
+}
+
+static void dumpBarriersJSON(std::ostream& stream, const std::map<MemoryObjectBarrierGroup, std::vector<MemoryObjectBarrier>>& barriers, const WorkflowDumpData& dumpData)
+{
+  stream << "[";
+  bool firstGroup = true;
+  for (auto& bg : barriers)
+  {
+    stream << (firstGroup ? "\n" : ",\n");
+    firstGroup = false;
+    stream << "            { \"srcStageMask\": " << bg.first.srcStageMask << ", \"dstStageMask\": " << bg.first.dstStageMask << ", \"dependencyFlags\": " << bg.first.dependencyFlags << ", \"barriers\": [";
+    bool firstBarrier = true;
+    for (auto& barrier : bg.second)
+    {
+      stream << (firstBarrier ? "\n" : ",\n");
+      firstBarrier = false;
+      stream << "              { \"resource\": \"" << jsonEscape(dumpData.getMemoryObjectName(barrier.memoryObject.get())) << "\", \"srcAccessMask\": " << barrier.srcAccessMask << ", \"dstAccessMask\": " << barrier.dstAccessMask
+        << ", \"srcQueueIndex\": " << static_cast<int64_t>(barrier.srcQueueIndex == VK_QUEUE_FAMILY_IGNORED ? -1 : barrier.srcQueueIndex) << ", \"dstQueueIndex\": " << static_cast<int64_t>(barrier.dstQueueIndex == VK_QUEUE_FAMILY_IGNORED ? -1 : barrier.dstQueueIndex);
+      if (barrier.objectType == MemoryObject::moImage)
+        stream << ", \"oldLayout\": " << barrier.oldLayout << ", \"newLayout\": " << barrier.newLayout;
+      stream << " }";
+    }
+    stream << (firstBarrier ? "] }" : "\n            ] }");
+  }
+  stream << (firstGroup ? "]" : "\n          ]");
+}
+
+void RenderWorkflow::dumpDOT(std::ostream& stream) const
+{
+  std::lock_guard<std::mutex> lock(compileMutex);
+  WorkflowDumpData dumpData(workflowResults.get());
+
+  auto operationNames = getRenderOperationNames();
+  std::sort(begin(operationNames), end(operationNames));
+  auto resourceNames = getResourceNames();
+  std::sort(begin(resourceNames), end(resourceNames));
+
+  stream << "digraph \"" << jsonEscape(name) << "\"\n{\n";
+  stream << "  rankdir=LR;\n";
+  stream << "  node [fontsize=10];\n";
+
+  // resources with their aliases
+  for (auto& resourceName : resourceNames)
+  {
+    auto resource = resources.at(resourceName);
+    stream << "  \"r:" << jsonEscape(resourceName) << "\" [shape=ellipse, label=\"" << jsonEscape(resourceName) << "\\n" << jsonEscape(resource->resourceType->typeName);
+    bool transient = false;
+    if (workflowResults != nullptr)
+    {
+      auto ait = workflowResults->resourceAlias.find(resourceName);
+      if (ait != end(workflowResults->resourceAlias) && ait->second != resourceName)
+        stream << "\\nalias : " << jsonEscape(ait->second);
+      transient = workflowResults->transientAttachments.find(resourceName) != end(workflowResults->transientAttachments);
+      if (transient)
+        stream << "\\ntransient";
+    }
+    stream << "\"" << (transient ? ", style=dashed" : "") << "];\n";
+  }
+
+  // operations - subpasses of the same render pass are placed in one cluster
+  auto writeOperation = [&](const std::string& operationName, const std::string& indent)
+  {
+    auto operation = renderOperations.at(operationName);
+    stream << indent << "\"o:" << jsonEscape(operationName) << "\" [shape=box, label=\"" << jsonEscape(operationName) << "\\n" << (operation->operationType == RenderOperation::Graphics ? "graphics" : "compute");
+    auto cit = dumpData.commandPosition.find(operationName);
+    if (cit != end(dumpData.commandPosition))
+    {
+      auto& command = workflowResults->commands[cit->second.first][cit->second.second];
+      stream << "\\nqueue " << cit->second.first << " : " << cit->second.second;
+      stream << "\\nbarriers " << getBarrierCount(command->barriersBeforeOp) << " / " << getBarrierCount(command->barriersAfterOp);
+    }
+    stream << "\"" << (operation->enabled ? "" : ", style=dotted") << "];\n";
+  };
+  for (uint32_t i = 0; i < dumpData.renderPasses.size(); ++i)
+  {
+    stream << "  subgraph cluster_" << i << "\n  {\n";
+    stream << "    label=\"render pass " << i << " ( queue " << dumpData.renderPassQueue[i] << " )\";\n";
+    for (auto& sb : dumpData.renderPasses[i]->subPasses)
+      writeOperation(sb.lock()->operation->name, "    ");
+    stream << "  }\n";
+  }
+  for (auto& operationName : operationNames)
+    if (dumpData.renderPassIndex.find(operationName) == end(dumpData.renderPassIndex))
+      writeOperation(operationName, "  ");
+
+  // transitions
+  for (auto& transition : transitions)
+  {
+    std::string operationNode = "\"o:" + jsonEscape(transition->operation->name) + "\"";
+    std::string resourceNode  = "\"r:" + jsonEscape(transition->resource->name) + "\"";
+    if ((transition->transitionType & rttAllOutputs) != 0)
+      stream << "  " << operationNode << " -> " << resourceNode;
+    else
+      stream << "  " << resourceNode << " -> " << operationNode;
+    stream << " [label=\"" << getTransitionTypeName(transition->transitionType) << "\"];\n";
+  }
+
+  // operation sequence chosen by the compiler
+  if (workflowResults != nullptr)
+  {
+    for (auto& commandSequence : workflowResults->commands)
+      for (uint32_t i = 1; i < commandSequence.size(); ++i)
+        stream << "  \"o:" << jsonEscape(commandSequence[i - 1]->operation->name) << "\" -> \"o:" << jsonEscape(commandSequence[i]->operation->name) << "\" [style=dotted, color=gray, constraint=false];\n";
+  }
+  stream << "}\n";
+}
+
+void RenderWorkflow::dumpJSON(std::ostream& stream) const
+{
+  std::lock_guard<std::mutex> lock(compileMutex);
+  WorkflowDumpData dumpData(workflowResults.get());
+
+  auto operationNames = getRenderOperationNames();
+  std::sort(begin(operationNames), end(operationNames));
+  auto resourceNames = getResourceNames();
+  std::sort(begin(resourceNames), end(resourceNames));
+
+  stream << "{\n";
+  stream << "  \"name\": \"" << jsonEscape(name) << "\",\n";
+  stream << "  \"structureHash\": " << calculateStructureHash() << ",\n";
+
+  stream << "  \"operations\": [";
+  for (uint32_t i = 0; i < operationNames.size(); ++i)
+  {
+    auto operation = renderOperations.at(operationNames[i]);
+    stream << (i == 0 ? "\n" : ",\n");
+    stream << "    { \"name\": \"" << jsonEscape(operation->name) << "\", \"type\": \"" << (operation->operationType == RenderOperation::Graphics ? "graphics" : "compute") << "\", \"enabled\": " << (operation->enabled ? "true" : "false") << " }";
+  }
+  stream << "\n  ],\n";
+
+  stream << "  \"resources\": [";
+  for (uint32_t i = 0; i < resourceNames.size(); ++i)
+  {
+    auto resource = resources.at(resourceNames[i]);
+    stream << (i == 0 ? "\n" : ",\n");
+    stream << "    { \"name\": \"" << jsonEscape(resource->name) << "\", \"type\": \"" << jsonEscape(resource->resourceType->typeName) << "\", \"persistent\": " << (resource->resourceType->persistent ? "true" : "false");
+    if (workflowResults != nullptr)
+    {
+      auto ait = workflowResults->resourceAlias.find(resource->name);
+      if (ait != end(workflowResults->resourceAlias))
+        stream << ", \"alias\": \"" << jsonEscape(ait->second) << "\"";
+      stream << ", \"transient\": " << (workflowResults->transientAttachments.find(resource->name) != end(workflowResults->transientAttachments) ? "true" : "false");
+    }
+    stream << " }";
+  }
+  stream << "\n  ],\n";
+
+  stream << "  \"transitions\": [";
+  for (uint32_t i = 0; i < transitions.size(); ++i)
+  {
+    stream << (i == 0 ? "\n" : ",\n");
+    stream << "    { \"operation\": \"" << jsonEscape(transitions[i]->operation->name) << "\", \"resource\": \"" << jsonEscape(transitions[i]->resource->name) << "\", \"type\": \"" << getTransitionTypeName(transitions[i]->transitionType) << "\"";
+    if (transitions[i]->resource->resourceType->isImageOrAttachment())
+      stream << ", \"layout\": " << transitions[i]->layout << ", \"loadOp\": " << static_cast<int>(transitions[i]->load.loadType);
+    stream << " }";
+  }
+  stream << "\n  ]";
+
+  if (workflowResults == nullptr)
+  {
+    stream << "\n}\n";
+    return;
+  }
+
+  // operation sequences with pipeline barriers
+  stream << ",\n  \"queues\": [";
+  for (uint32_t i = 0; i < workflowResults->commands.size(); ++i)
+  {
+    stream << (i == 0 ? "\n" : ",\n");
+    stream << "    { \"index\": " << i << ", \"commands\": [";
+    for (uint32_t j = 0; j < workflowResults->commands[i].size(); ++j)
+    {
+      auto& command = workflowResults->commands[i][j];
+      stream << (j == 0 ? "\n" : ",\n");
+      stream << "        { \"operation\": \"" << jsonEscape(command->operation->name) << "\"";
+      if (command->commandType == RenderCommand::ctRenderSubPass)
+        stream << ", \"renderPass\": " << dumpData.renderPassIndex.at(command->operation->name) << ", \"subpass\": " << command->asRenderSubPass()->subpassIndex;
+      stream << ",\n          \"barriersBeforeOp\": ";
+      dumpBarriersJSON(stream, command->barriersBeforeOp, dumpData);
+      stream << ",\n          \"barriersAfterOp\": ";
+      dumpBarriersJSON(stream, command->barriersAfterOp, dumpData);
+      stream << " }";
+    }
+    stream << "\n      ] }";
+  }
+  stream << "\n  ],\n";
+
+  stream << "  \"renderPasses\": [";
+  for (uint32_t i = 0; i < dumpData.renderPasses.size(); ++i)
+  {
+    auto& renderPass = dumpData.renderPasses[i];
+    stream << (i == 0 ? "\n" : ",\n");
+    stream << "    { \"index\": " << i << ", \"queue\": " << dumpData.renderPassQueue[i] << ", \"dependencies\": " << renderPass->dependencies.size() << ", \"attachments\": [";
+    for (uint32_t j = 0; j < renderPass->attachments.size(); ++j)
+    {
+      auto& attachment = renderPass->attachments[j];
+      std::string attachmentName = (renderPass->frameBuffer != nullptr) ? renderPass->frameBuffer->getImageDefinition(attachment.imageDefinitionIndex).name : std::string();
+      stream << (j == 0 ? "\n" : ",\n");
+      stream << "        { \"name\": \"" << jsonEscape(attachmentName) << "\", \"loadOp\": " << attachment.loadOp << ", \"storeOp\": " << attachment.storeOp << ", \"stencilLoadOp\": " << attachment.stencilLoadOp
+        << ", \"stencilStoreOp\": " << attachment.stencilStoreOp << ", \"initialLayout\": " << attachment.initialLayout << ", \"finalLayout\": " << attachment.finalLayout << " }";
+    }
+    stream << "\n      ] }";
+  }
+  stream << "\n  ],\n";
+
+  // images sharing memory
+  std::map<SharedImageMemory*, std::vector<std::string>> memoryGroups;
+  for (auto& sim : workflowResults->sharedImageMemory)
+    memoryGroups[sim.second.get()].push_back(sim.first);
+  std::vector<std::vector<std::string>> sortedMemoryGroups;
+  for (auto& mg : memoryGroups)
+    sortedMemoryGroups.push_back(mg.second);
+  std::sort(begin(sortedMemoryGroups), end(sortedMemoryGroups));
+  stream << "  \"sharedImageMemory\": [";
+  for (uint32_t i = 0; i < sortedMemoryGroups.size(); ++i)
+  {
+    stream << (i == 0 ? " [" : ", [");
+    for (uint32_t j = 0; j < sortedMemoryGroups[i].size(); ++j)
+      stream << (j == 0 ? " \"" : ", \"") << jsonEscape(sortedMemoryGroups[i][j]) << "\"";
+    stream << " ]";
+  }
+  stream << " ],\n";
+
+  stream << "  \"queueSubmissionOrder\": [";
+  for (uint32_t i = 0; i < workflowResults->queueSubmissionOrder.size(); ++i)
+    stream << (i == 0 ? " " : ", ") << workflowResults->queueSubmissionOrder[i];
+  stream << " ],\n";
+  stream << "  \"barrierStatistics\": { \"barrierCountBeforeOptimization\": " << workflowResults->barrierCountBeforeOptimization << ", \"barrierCountAfterOptimization\": " << workflowResults->barrierCountAfterOptimization
+    << ", \"barrierGroupCountBeforeOptimization\": " << workflowResults->barrierGroupCountBeforeOptimization << ", \"barrierGroupCountAfterOptimization\": " << workflowResults->barrierGroupCountAfterOptimization << " }\n";
+  stream << "}\n";
+}
+
+RenderWorkflowCostCalculator::~RenderWorkflowCostCalculator()
+{
+}
+
+void RenderWorkflowCostCalculator::tagOperationByAttachmentType(const RenderWorkflow& workflow)
 {
   std::unordered_map<int, AttachmentSize> tags;
   attachmentTag.clear();
@@ -568,79 +1020,173 @@ void StandardRenderWorkflowCostCalculator::tagOperationByAttachmentType(const Re
   }
 }
 
-float StandardRenderWorkflowCostCalculator::calculateWorkflowCost(const RenderWorkflow& workflow, const std::vector<std::shared_ptr<RenderOperation>>& operationSchedule) const
+float RenderWorkflowCostCalculator::calculateWorkflowCost(const RenderWorkflow& workflow, const std::vector<std::shared_ptr<RenderOperation>>& operationSchedule) const
 {
-  if (operationSchedule.empty())
-    return 0.0f;
   float result = 0.0f;
+  for (uint32_t i = 1; i < operationSchedule.size(); ++i)
+    result += calculateTransitionCost(workflow, operationSchedule[i - 1], operationSchedule[i]);
+  return result;
+}
+
+bool RenderWorkflowCostCalculator::canShareRenderPass(const RenderOperation& lhs, const RenderOperation& rhs) const
+{
+  // operations with the same tag have the same attachment size. Multiview render pass must use multiview in all subpasses.
+  // Render pass is skipped as a whole, so its subpasses must be updated in the same frames
+  return lhs.operationType == RenderOperation::Graphics && rhs.operationType == RenderOperation::Graphics &&
+    attachmentTag.at(lhs.name) == attachmentTag.at(rhs.name) &&
+    (lhs.multiViewMask != 0) == (rhs.multiViewMask != 0) &&
+    lhs.hasSameUpdatePeriod(rhs);
+}
 
+float StandardRenderWorkflowCostCalculator::calculateTransitionCost(const RenderWorkflow& workflow, const std::shared_ptr<RenderOperation>& previousOperation, const std::shared_ptr<RenderOperation>& nextOperation) const
+{
   // first preference : prefer operations with the same tags ( render pass grouping )
-  int tag = attachmentTag.at(operationSchedule[0]->name);
-  for (int i = 1; i < operationSchedule.size(); ++i)
+  if (attachmentTag.at(previousOperation->name) != attachmentTag.at(nextOperation->name))
+    return 10.0f;
+  return 0.0f;
+}
+
+BandwidthRenderWorkflowCostCalculator::BandwidthRenderWorkflowCostCalculator(const VkExtent2D& re, float rpc, float ltf)
+  : referenceExtent{ re }, renderPassCost{ rpc }, layoutTransitionFactor{ ltf }
+{
+}
+
+float BandwidthRenderWorkflowCostCalculator::calculateTransitionCost(const RenderWorkflow& workflow, const std::shared_ptr<RenderOperation>& previousOperation, const std::shared_ptr<RenderOperation>& nextOperation) const
+{
+  float result = 0.0f;
+  // operations that do not share a render pass : attachments written by previous operation are stored to memory,
+  // attachments used by next operation are loaded from memory
+  if (!canShareRenderPass(*previousOperation, *nextOperation))
   {
-    int newTag = attachmentTag.at(operationSchedule[i]->name);
-    if (newTag != tag)
-      result += 10.0f;
-    tag = newTag;
+    result += renderPassCost;
+    for (auto& transition : workflow.getOperationIO(previousOperation->name, rttAllAttachmentOutputs))
+      result += getAttachmentSize(*transition->resource->resourceType);
+    for (auto& transition : workflow.getOperationIO(nextOperation->name, rttAllAttachments))
+      if ((transition->transitionType & rttAllAttachmentInputs) != 0 || transition->load.loadType == LoadOp::Load)
+        result += getAttachmentSize(*transition->resource->resourceType);
+  }
+  // attachments passed from previous to next operation in a different layout must be transitioned
+  auto nextInputs = workflow.getOperationIO(nextOperation->name, rttAllAttachmentInputs);
+  for (auto& output : workflow.getOperationIO(previousOperation->name, rttAllAttachmentOutputs))
+  {
+    for (auto& input : nextInputs)
+    {
+      if (output->resource == input->resource && output->layout != input->layout)
+        result += layoutTransitionFactor * getAttachmentSize(*output->resource->resourceType);
+    }
   }
-
   return result;
 }
 
-std::vector<std::shared_ptr<RenderOperation>> recursiveScheduleOperations(const RenderWorkflow& workflow, const std::set<std::shared_ptr<RenderOperation>>& doneOperations, StandardRenderWorkflowCostCalculator* costCalculator)
+float BandwidthRenderWorkflowCostCalculator::getAttachmentSize(const RenderWorkflowResourceType& resourceType) const
+{
+  if (resourceType.metaType != RenderWorkflowResourceType::Attachment)
+    return 0.0f;
+  const AttachmentSize& attachmentSize = resourceType.attachment.attachmentSize;
+  float width  = attachmentSize.imageSize.x;
+  float height = attachmentSize.imageSize.y;
+  if (attachmentSize.attachmentSize == AttachmentSize::SurfaceDependent)
+  {
+    width  *= referenceExtent.width;
+    height *= referenceExtent.height;
+  }
+  // formats without known texel size are estimated as 4 bytes per texel
+  uint32_t texelSize = getFormatTexelSize(resourceType.attachment.format);
+  if (texelSize == 0)
+    texelSize = 4;
+  return width * height * std::max(attachmentSize.imageSize.z, 1.0f) * static_cast<float>(resourceType.attachment.samples) * texelSize / (1024.0f * 1024.0f);
+}
+
+// List scheduler : operations are scheduled one after another, beginning with operations that have no predecessors.
+// From all operations that are ready to be scheduled we choose the one with the lowest transition cost from the last scheduled operation.
+// When costs are equal, we choose the operation whose tag is shared by most of ready operations, so that operations with the same tag may be grouped.
+// Complexity is O(n^2) with respect to the number of operations ( previous version checked all permutations of ready operations )
+std::vector<std::shared_ptr<RenderOperation>> pumex::scheduleOperations(const RenderWorkflow& workflow, const RenderWorkflowCostCalculator& costCalculator)
 {
-  std::set<std::shared_ptr<RenderOperation>> newDoneOperations;
   auto operationNames = workflow.getRenderOperationNames();
-  if (doneOperations.empty())
+  std::vector<std::shared_ptr<RenderOperation>> operations;
+  std::unordered_map<RenderOperation*, uint32_t> operationIndices;
+  std::vector<int> operationTags;
+  for (auto& operationName : operationNames)
+  {
+    operationIndices.insert({ workflow.getRenderOperation(operationName).get(), static_cast<uint32_t>(operations.size()) });
+    operations.push_back(workflow.getRenderOperation(operationName));
+    operationTags.push_back(costCalculator.attachmentTag.at(operationName));
+  }
+
+  // operation is followed by all operations reading its outputs. Transitions are visited once ( getNextOperations() would visit them for each operation )
+  std::unordered_map<WorkflowResource*, std::pair<std::vector<uint32_t>, std::vector<uint32_t>>> resourceIO;
+  for (auto& transition : workflow.getTransitions())
+  {
+    auto& io = resourceIO[transition->resource.get()];
+    if (transition->transitionType & rttAllOutputs)
+      io.first.push_back(operationIndices.at(transition->operation.get()));
+    if (transition->transitionType & rttAllInputs)
+      io.second.push_back(operationIndices.at(transition->operation.get()));
+  }
+  std::vector<std::vector<uint32_t>> nextOperations(operations.size());
+  for (auto& io : resourceIO)
+    for (auto output : io.second.first)
+      nextOperations[output].insert(end(nextOperations[output]), begin(io.second.second), end(io.second.second));
+
+  // count unscheduled predecessors of each operation
+  std::vector<uint32_t> predecessorCount(operations.size(), 0);
+  for (auto& next : nextOperations)
   {
-    for (auto& operationName : operationNames)
+    std::sort(begin(next), end(next));
+    next.erase(std::unique(begin(next), end(next)), end(next));
+    for (auto nextIndex : next)
+      predecessorCount[nextIndex]++;
+  }
+  std::vector<uint32_t> readyOperations;
+  std::unordered_map<int, uint32_t> readyTagCount;
+  for (uint32_t i = 0; i < operations.size(); ++i)
+  {
+    if (predecessorCount[i] == 0)
     {
-      auto operation = workflow.getRenderOperation(operationName);
-      auto nextOperations = workflow.getNextOperations(operationName);
-      if (nextOperations.empty())
-        newDoneOperations.insert(operation);
+      readyOperations.push_back(i);
+      readyTagCount[operationTags[i]]++;
     }
   }
-  else
+
+  std::vector<std::shared_ptr<RenderOperation>> results;
+  while (!readyOperations.empty())
   {
-    for (auto& operationName : operationNames)
+    uint32_t bestReady     = 0;
+    float    bestCost      = std::numeric_limits<float>::max();
+    uint32_t bestGroupSize = 0;
+    for (uint32_t r = 0; r < readyOperations.size(); ++r)
     {
-      auto operation = workflow.getRenderOperation(operationName);
-      if (doneOperations.find(operation) != end(doneOperations))
-        continue;
-      auto nextOperations = workflow.getNextOperations(operationName);
-      bool final = true;
-      // check if ALL outputs point at operations in doneOperations
-      for (auto& nextOp : nextOperations)
+      float cost = results.empty() ? 0.0f : costCalculator.calculateTransitionCost(workflow, results.back(), operations[readyOperations[r]]);
+      uint32_t groupSize = readyTagCount[operationTags[readyOperations[r]]];
+      if (cost < bestCost || (cost == bestCost && groupSize > bestGroupSize))
       {
-        if (doneOperations.find(nextOp) == end(doneOperations))
-        {
-          final = false;
-          break;
-        }
+        bestReady     = r;
+        bestCost      = cost;
+        bestGroupSize = groupSize;
+      }
+    }
+    uint32_t opIndex = readyOperations[bestReady];
+    readyOperations.erase(begin(readyOperations) + bestReady);
+    readyTagCount[operationTags[opIndex]]--;
+    results.push_back(operations[opIndex]);
+    for (auto nextIndex : nextOperations[opIndex])
+    {
+      if (--predecessorCount[nextIndex] == 0)
+      {
+        readyOperations.push_back(nextIndex);
+        readyTagCount[operationTags[nextIndex]]++;
       }
-      if (final)
-        newDoneOperations.insert(operation);
     }
   }
-  if (newDoneOperations.empty())
-    return std::vector<std::shared_ptr<RenderOperation>>();
+  return results;
+}
 
-  std::vector<std::vector<std::shared_ptr<RenderOperation>>> results;
-  std::vector<float> cost;
-  for (const auto& x : newDoneOperations)
-  {
-    auto a = doneOperations;
-    a.insert(x);
-    auto xx = recursiveScheduleOperations(workflow, a, costCalculator);
-    xx.push_back(x);
-    cost.push_back(costCalculator->calculateWorkflowCost(workflow, xx));
-    results.push_back(xx);
-  }
-  // return a result with lowest cost
-  auto minit = std::min_element(begin(cost), end(cost));
-  auto i = std::distance(begin(cost), minit);
-  return results[i];
+SingleQueueWorkflowCompiler::SingleQueueWorkflowCompiler(std::shared_ptr<RenderWorkflowCostCalculator> cc)
+  : costCalculator{ cc }
+{
+  if (costCalculator == nullptr)
+    costCalculator = std::make_shared<StandardRenderWorkflowCostCalculator>();
 }
 
 std::shared_ptr<RenderWorkflowResults> SingleQueueWorkflowCompiler::compile(RenderWorkflow& workflow)
@@ -665,18 +1211,17 @@ std::shared_ptr<RenderWorkflowResults> SingleQueueWorkflowCompiler::compile(Rend
   // - each compute operation gets its own tag
   // - all graphics operations with the same attachment size get the same tag
   // - two graphics operations with different attachment size get different tag
-  costCalculator.tagOperationByAttachmentType(workflow);
+  costCalculator->tagOperationByAttachmentType(workflow);
 
-  // Build a vector storing proper sequence of operations - FIXME : IT ONLY WORKS FOR ONE QUEUE NOW.
-  // TARGET FOR THE FUTURE  : build as many operation sequences as there is queues, take VkQueueFlags into consideration
-  // ( be aware that scheduling algorithms may be NP-complete ).
+  // Build a vector storing proper sequence of operations for each queue
   std::vector<std::vector<std::shared_ptr<RenderOperation>>> operationSequences;
-  {
-    // FIXME : IT ONLY GENERATES ONE SEQUENCE NOW, ALSO IGNORES TYPE OF THE QUEUE
-    std::set<std::shared_ptr<RenderOperation>> doneOperations;
-    auto operationSequence = recursiveScheduleOperations(workflow, doneOperations, &costCalculator);
-    operationSequences.push_back(operationSequence);
-  }
+  scheduleOperationSequences(workflow, operationSequences);
+
+  // move graphics operations next to compatible operations, so that they become subpasses of the same render pass
+  mergeRenderPasses(workflow, operationSequences);
+
+  // find attachments that live only inside one render pass
+  findTransientAttachments(workflow, operationSequences, workflowResults);
 
   // find resources that may be reused
   findAliasedResources(workflow, operationSequences, workflowResults);
@@ -693,7 +1238,6 @@ std::shared_ptr<RenderWorkflowResults> SingleQueueWorkflowCompiler::compile(Rend
   workflowResults->commands = commands;
 
   // Build framebuffer for each render pass
-  // TODO : specification is not clear what compatible render passes are. Neither are debug layers. One day I will decrease the number of frame buffers
   buildFrameBuffersAndRenderPasses(workflow, partialOrdering, resourceMap, operationMap, allLayouts, workflowResults);// resourceAlias, renderPasses, attachmentImages, attachmentImageViews, imageInitialLayouts, frameBuffers);
 
   // copy RenderWorkflow associated resources to RenderWorkflowResults registered resources
@@ -716,12 +1260,53 @@ std::shared_ptr<RenderWorkflowResults> SingleQueueWorkflowCompiler::compile(Rend
   for (const auto& iv : workflow.getAssociatedImageViews())
     workflowResults->registeredImageViews.insert({ iv.first, iv.second });
 
-  // create pipeline barriers
+  // create pipeline barriers and find dependencies between queues
+  workflowResults->queueDependencies.resize(commands.size());
   createPipelineBarriers(workflow, commands, workflowResults);
+  calculateQueueSubmissionOrder(workflowResults);
+
+  // images generated by rate limited operations must return to the same layout at the end of each frame
+  createRateLimitedBarriers(workflow, workflowResults);
+
+  // merge and remove redundant pipeline barriers
+  optimizePipelineBarriers(workflow, workflowResults);
+
+  // compatible render passes may use the same frame buffer ( subpass dependencies must be known at this point )
+  shareFrameBuffers(workflowResults);
 
   return workflowResults;
 }
 
+void SingleQueueWorkflowCompiler::scheduleOperationSequences(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences)
+{
+  CHECK_LOG_THROW(workflow.getQueueTraits().empty(), "Workflow does not define any queue");
+  operationSequences.assign(workflow.getQueueTraits().size(), std::vector<std::shared_ptr<RenderOperation>>());
+  operationSequences[0] = scheduleOperations(workflow, *costCalculator);
+}
+
+void SingleQueueWorkflowCompiler::calculateQueueSubmissionOrder(std::shared_ptr<RenderWorkflowResults> workflowResults)
+{
+  // topological sort of queue dependencies. Binary semaphore must be signaled by a submission that was sent before the submission that waits for it
+  workflowResults->queueSubmissionOrder.clear();
+  std::vector<char> submitted(workflowResults->queueDependencies.size(), false);
+  while (workflowResults->queueSubmissionOrder.size() < workflowResults->queueDependencies.size())
+  {
+    bool found = false;
+    for (uint32_t i = 0; i < workflowResults->queueDependencies.size(); ++i)
+    {
+      if (submitted[i])
+        continue;
+      bool ready = std::all_of(begin(workflowResults->queueDependencies[i]), end(workflowResults->queueDependencies[i]), [&submitted](const std::pair<const uint32_t, VkPipelineStageFlags>& dep) { return submitted[dep.first] != 0; });
+      if (!ready)
+        continue;
+      workflowResults->queueSubmissionOrder.push_back(i);
+      submitted[i] = true;
+      found        = true;
+    }
+    CHECK_LOG_THROW(!found, "Cannot find queue submission order - queues depend on each other");
+  }
+}
+
 void SingleQueueWorkflowCompiler::verifyOperations(const RenderWorkflow& workflow)
 {
   std::ostringstream os;
@@ -847,162 +1432,205 @@ void SingleQueueWorkflowCompiler::calculateAttachmentLayouts(const RenderWorkflo
   }
 }
 
-std::vector<std::string> recursiveLongestPath(const std::vector<std::pair<std::string, std::string>>& resourcePairs, const std::set<std::string>& doneVertices = std::set<std::string>())
+// outputs of rate limited operations must be kept between frames
+static bool isGeneratedByRateLimitedOperation(const RenderWorkflow& workflow, const std::string& resourceName)
 {
-  std::set<std::string> vertices;
-  if (doneVertices.empty())
-  {
-    for (auto& rp : resourcePairs)
-      vertices.insert(rp.first);
-    for (auto& rp : resourcePairs)
-      vertices.erase(rp.second);
-  }
-  else
+  auto outTransitions = workflow.getResourceIO(resourceName, rttAllOutputs);
+  return std::any_of(begin(outTransitions), end(outTransitions), [](const std::shared_ptr<ResourceTransition>& transition) { return transition->operation->isRateLimited(); });
+}
+
+void SingleQueueWorkflowCompiler::findTransientAttachments(const RenderWorkflow& workflow, const std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences, std::shared_ptr<RenderWorkflowResults> workflowResults)
+{
+  workflowResults->transientAttachments.clear();
+
+  std::map<std::string, std::pair<uint32_t, uint32_t>> operationIndex;
+  std::map<std::string, std::pair<uint32_t, int>>      renderPassIndex;
+  for (uint32_t i = 0; i < operationSequences.size(); ++i)
   {
-    for (auto& rp : resourcePairs)
+    int rpIndex = -1;
+    for (uint32_t j = 0; j < operationSequences[i].size(); ++j)
     {
-      if (doneVertices.find(rp.first) == end(doneVertices))
-        continue;
-      if (doneVertices.find(rp.second) != end(doneVertices))
-        continue;
-      vertices.insert(rp.second);
+      operationIndex.insert({ operationSequences[i][j]->name, { i,j } });
+      if (j == 0 || !canShareRenderPass(operationSequences[i][j - 1], operationSequences[i][j]))
+        rpIndex++;
+      renderPassIndex.insert({ operationSequences[i][j]->name, { i, rpIndex } });
     }
   }
-  if (vertices.empty())
-    return std::vector<std::string>();
 
-
-  std::vector<std::vector<std::string>> results;
-  for (const auto& x : vertices)
-  {
-    auto a = doneVertices;
-    a.insert(x);
-    auto xx = recursiveLongestPath(resourcePairs, a);
-    xx.push_back(x);
-    results.push_back(xx);
-  }
-  uint32_t maxSize = 0;
-  int maxElt = -1;
-  for (uint32_t i = 0; i<results.size(); ++i)
+  // Attachment is transient when :
+  // - it is not persistent, it is not a swapchain image and it is not generated by rate limited operation
+  // - it is used only as an attachment ( user did not request other usage, like sampling or transfer )
+  // - it is generated and consumed in the same render pass, and its first use does not load previous content
+  const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  for (auto& resourceName : workflow.getResourceNames())
   {
-    if (results[i].size() > maxSize)
+    auto resource = workflow.getResource(resourceName);
+    if (resource->resourceType->metaType != RenderWorkflowResourceType::Attachment || resource->resourceType->persistent)
+      continue;
+    if (resource->resourceType->attachment.attachmentType == atSurface)
+      continue;
+    if ((resource->resourceType->attachment.imageUsage & ~attachmentUsage) != 0)
+      continue;
+    if (isGeneratedByRateLimitedOperation(workflow, resourceName))
+      continue;
+    auto transitions = workflow.getResourceIO(resourceName, rttAllInputsOutputs);
+    if (transitions.empty())
+      continue;
+    bool transient = true;
+    auto rpIndex   = renderPassIndex.at(transitions[0]->operation->name);
+    auto first     = transitions[0];
+    for (auto& transition : transitions)
     {
-      maxSize = results[i].size();
-      maxElt = i;
+      transient &= ((transition->transitionType & rttAllAttachments) != 0);
+      transient &= (transition->load.loadType != LoadOp::Load);
+      transient &= (renderPassIndex.at(transition->operation->name) == rpIndex);
+      if (operationIndex.at(transition->operation->name).second < operationIndex.at(first->operation->name).second)
+        first = transition;
     }
+    transient &= ((first->transitionType & rttAllOutputs) != 0);
+    if (transient)
+      workflowResults->transientAttachments.insert(resourceName);
   }
-  return results[maxElt];
 }
 
 void SingleQueueWorkflowCompiler::findAliasedResources(const RenderWorkflow& workflow, const std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences, std::shared_ptr<RenderWorkflowResults> workflowResults)
 {
   workflowResults->resourceAlias.clear();
+  workflowResults->sharedImageMemory.clear();
 
+  // compatible operations performed one after another are placed in the same render pass ( look at createCommandSequence() )
   std::map<std::string, std::pair<uint32_t,uint32_t>> operationIndex;
+  std::map<std::string, int>                          renderPassIndex;
   for (uint32_t i = 0; i < operationSequences.size(); ++i)
+  {
+    int rpIndex = -1;
     for (uint32_t j = 0; j < operationSequences[i].size(); ++j)
+    {
       operationIndex.insert({ operationSequences[i][j]->name, {i,j} });
+      if (j == 0 || !canShareRenderPass(operationSequences[i][j - 1], operationSequences[i][j]))
+        rpIndex++;
+      renderPassIndex.insert({ operationSequences[i][j]->name, rpIndex });
+    }
+  }
 
-  // collect resources that may be used again
+  // collect lifetimes of resources that may be used again
   // Resource may be used again when :
-  // - all of its inputs are used in the same queue
-  // - it is an attachment or has no associated resource
+  // - it is an attachment that is not persistent
   // - it is not a swapchain image
-  // aliasingPossible stores queue index in which resource is created and queue index in which resource is consumed ( -1 if there's no generation/consumption )
-  // also it stores operation indices
-  std::map<std::string,std::tuple<int,int,int,int,int>> aliasingPossible;
+  // - it is generated and consumed in the same queue
+  // Lifetime is an interval of operation indices in a queue : from generating operation to last consuming operation
+  struct ResourceLifetime
+  {
+    std::string name;
+    uint32_t    queueIndex;
+    int         first;
+    int         last;
+  };
+  std::vector<ResourceLifetime> lifetimes;
   auto resourceNames = workflow.getResourceNames();
   for (auto& resourceName : resourceNames)
   {
     workflowResults->resourceAlias.insert({ resourceName , resourceName });
     auto resource = workflow.getResource(resourceName);
-    if (resource->resourceType->metaType != RenderWorkflowResourceType::Attachment && workflow.getAssociatedMemoryObject(resourceName) != nullptr)
+    if (resource->resourceType->metaType != RenderWorkflowResourceType::Attachment || resource->resourceType->persistent)
       continue;
     if (resource->resourceType->attachment.attachmentType == atSurface)
       continue;
-    auto inputTransitions = workflow.getResourceIO(resourceName, rttAllInputs);
-    std::set<uint32_t> consumedInQueue;
-    std::set<int> inOpIndices;
-    for (auto& inputTransition : inputTransitions)
-    {
-      consumedInQueue.insert(operationIndex.at(inputTransition->operation->name).first);
-      inOpIndices.insert(operationIndex.at(inputTransition->operation->name).second);
-    }
-    if (consumedInQueue.size() > 1)
+    // transient attachments do not occupy memory outside of their render pass
+    if (workflowResults->transientAttachments.find(resourceName) != end(workflowResults->transientAttachments))
       continue;
-
-    int inQueueIndex = consumedInQueue.empty() ? -1 : *begin(consumedInQueue);
-    int inOpFirst    = inOpIndices.empty() ? -1 : *begin(inOpIndices);
-    int inOpLast     = inOpIndices.empty() ? -1 : *rbegin(inOpIndices);
-
-    auto outTransitions = workflow.getResourceIO(resourceName, rttAllOutputs);
-    int outQueueIndex = outTransitions.empty() ? -1 : operationIndex.at(outTransitions[0]->operation->name).first;
-    int outOpIndex    = outTransitions.empty() ? -1 : operationIndex.at(outTransitions[0]->operation->name).second;
-
-    aliasingPossible.insert( { resourceName,std::make_tuple( outQueueIndex, outOpIndex, inQueueIndex, inOpFirst, inOpLast ) } );
-  }
-
-  // OK, so we have a group of resources where resource reuse is possible. First - we build pairs of resources that may be reused
-  // Remark : algorithm complexity is n^2
-  std::vector<std::pair<std::string, std::string>> resourcePairs;
-  for (auto it0 = begin(aliasingPossible); it0 != end(aliasingPossible); ++it0)
-  {
-    auto resource0 = workflow.getResource(it0->first);
-    // cannot overwrite a resource marked as persistent
-    if (resource0->resourceType->persistent)
+    // outputs of rate limited operations are kept between frames
+    if (isGeneratedByRateLimitedOperation(workflow, resourceName))
       continue;
-    int r0oq, r0op, r0iq, r0ip0, r0ip1;
-    std::tie(r0oq, r0op, r0iq, r0ip0, r0ip1) = it0->second;
-    // let's skip some empty resources ( this shouldnt happen, but... )
-    if (r0oq == -1 && r0iq == -1)
+    // resources that are not generated are sent from outside the workflow
+    auto outTransitions = workflow.getResourceIO(resourceName, rttAllOutputs);
+    if (outTransitions.empty())
       continue;
-    // Question : what to do with resources that are generated but are not persistent and are not used later (r0iq==-1) ?
-    // For now we will assume that this resource may be used later in the same queue
-    if (r0iq == -1)
+    auto outIndex = operationIndex.at(outTransitions[0]->operation->name);
+
+    // resources that are generated but are not used later live only during generating operation
+    ResourceLifetime lifetime{ resourceName, outIndex.first, static_cast<int>(outIndex.second), static_cast<int>(outIndex.second) };
+    bool sameQueue = true;
+    for (auto& inputTransition : workflow.getResourceIO(resourceName, rttAllInputs))
     {
-      r0iq  = r0oq;
-      r0ip0 = r0ip1 = r0op;
+      auto inIndex = operationIndex.at(inputTransition->operation->name);
+      sameQueue     &= (inIndex.first == outIndex.first);
+      lifetime.last  = std::max(lifetime.last, static_cast<int>(inIndex.second));
     }
-    for (auto it1 = begin(aliasingPossible); it1 != end(aliasingPossible); ++it1)
+    if (sameQueue)
+      lifetimes.push_back(lifetime);
+  }
+  std::sort(begin(lifetimes), end(lifetimes), [](const ResourceLifetime& lhs, const ResourceLifetime& rhs)
+  {
+    if (lhs.queueIndex != rhs.queueIndex)
+      return lhs.queueIndex < rhs.queueIndex;
+    return lhs.first < rhs.first;
+  });
+
+  // Greedy interval coloring : each resource goes to a memory slot that is free when resource is generated.
+  // Resource reuses an image from the slot when its type is equal to the type of that image. Otherwise it gets a new image bound
+  // to the memory shared by all images in a slot. Such images must not be used in one render pass, because
+  // render pass attachments sharing memory require VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT
+  struct MemorySlot
+  {
+    uint32_t                 queueIndex;
+    int                      last;
+    int                      lastRenderPass;
+    bool                     colorImages;
+    std::string              lastImage;
+    std::vector<std::string> images;
+  };
+  std::vector<MemorySlot> slots;
+  for (auto& lifetime : lifetimes)
+  {
+    auto resource        = workflow.getResource(lifetime.name);
+    int  firstRenderPass = renderPassIndex.at(operationSequences[lifetime.queueIndex][lifetime.first]->name);
+    bool colorImage      = (getAspectMask(resource->resourceType->attachment.attachmentType) & VK_IMAGE_ASPECT_COLOR_BIT) != 0;
+
+    // among free slots choose the one that was released most recently ( best fit )
+    MemorySlot* bestSlot = nullptr;
+    std::string bestImage;
+    for (auto& slot : slots)
     {
-      // cannot merge resource with itself
-      if (it0 == it1) continue;
-      auto resource1 = workflow.getResource(it1->first);
-      if (!resource0->resourceType->isEqual(*(resource1->resourceType)))
+      if (slot.queueIndex != lifetime.queueIndex || slot.last >= lifetime.first || slot.colorImages != colorImage)
         continue;
-      int r1oq, r1op, r1iq, r1ip0, r1ip1;
-      std::tie(r1oq, r1op, r1iq, r1ip0, r1ip1) = it1->second;
-      // if resource r1 is not generated ( r1oq==-1 ) then it is sent from outside the workflow and we should not try to merge r0->r1
-      if (r1oq == -1)
+      if (bestSlot != nullptr && bestSlot->last >= slot.last)
         continue;
-
-      // skip it if last use of r0 is in other queue than creation of r1
-      if (r0iq != r1oq)
+      // image used directly before may be reused without further conditions
+      if (workflow.getResource(slot.lastImage)->resourceType->isEqual(*(resource->resourceType)))
+      {
+        bestSlot  = &slot;
+        bestImage = slot.lastImage;
         continue;
-      // if last consumption of r0 happens after generation of r1
-      if (r0ip1 >= r1op) continue;
-
-      resourcePairs.push_back({ it0->first , it1->first });
+      }
+      if (slot.lastRenderPass == firstRenderPass)
+        continue;
+      auto iit = std::find_if(begin(slot.images), end(slot.images), [&workflow, &resource](const std::string& image) { return workflow.getResource(image)->resourceType->isEqual(*(resource->resourceType)); });
+      bestSlot  = &slot;
+      bestImage = (iit != end(slot.images)) ? *iit : lifetime.name;
     }
-  }
-  // we can find reuse schema having graph from resource pairs that can be reused. This algorithm should minimize the number of output elements
-  while (!resourcePairs.empty())
-  {
-    auto longestPath = recursiveLongestPath(resourcePairs);
-
-    std::vector<std::pair<std::string, std::string>> rp;
-    std::copy_if(begin(resourcePairs), end(resourcePairs), std::back_inserter(rp),
-      [&longestPath](const std::pair<std::string, std::string>& thisPair) { return std::find(begin(longestPath), end(longestPath), thisPair.first) == end(longestPath) && std::find(begin(longestPath), end(longestPath), thisPair.second) == end(longestPath); });
-    resourcePairs = rp;
 
-    if (longestPath.size() > 1)
+    if (bestSlot == nullptr)
     {
-      auto target = longestPath.back();
-      longestPath.pop_back();
-      for (auto& p : longestPath)
-        workflowResults->resourceAlias[p] = target;
+      slots.push_back(MemorySlot{ lifetime.queueIndex, lifetime.last, renderPassIndex.at(operationSequences[lifetime.queueIndex][lifetime.last]->name), colorImage, lifetime.name, { lifetime.name } });
+      continue;
     }
-    else break;
+    workflowResults->resourceAlias[lifetime.name] = bestImage;
+    if (bestImage == lifetime.name)
+      bestSlot->images.push_back(lifetime.name);
+    bestSlot->last           = lifetime.last;
+    bestSlot->lastRenderPass = renderPassIndex.at(operationSequences[lifetime.queueIndex][lifetime.last]->name);
+    bestSlot->lastImage      = bestImage;
+  }
+
+  // images from the same slot share memory
+  for (auto& slot : slots)
+  {
+    if (slot.images.size() < 2)
+      continue;
+    auto sharedMemory = std::make_shared<SharedImageMemory>(workflow.frameBufferAllocator);
+    for (auto& image : slot.images)
+      workflowResults->sharedImageMemory.insert({ image, sharedMemory });
   }
 }
 
@@ -1010,19 +1638,17 @@ void SingleQueueWorkflowCompiler::createCommandSequence(const std::vector<std::s
 {
   commands.clear();
 
-  int                                      lastTag = -1;
+  std::shared_ptr<RenderOperation>         lastOperation;
   std::shared_ptr<RenderPass>              lastRenderPass;
 
   for( auto& operation : operationSequence )
   {
-    int tag = costCalculator.attachmentTag.at(operation->name);
-
     // we have a new set of operations from bit to it
     switch (operation->operationType)
     {
     case RenderOperation::Graphics:
     {
-      if (lastTag != tag)
+      if (lastOperation == nullptr || !canShareRenderPass(lastOperation, operation))
       {
         lastRenderPass = std::make_shared<RenderPass>();
       }
@@ -1048,7 +1674,118 @@ void SingleQueueWorkflowCompiler::createCommandSequence(const std::vector<std::s
       break;
     }
 
-    lastTag = tag;
+    lastOperation = operation;
+  }
+}
+
+bool SingleQueueWorkflowCompiler::canShareRenderPass(std::shared_ptr<RenderOperation> lhs, std::shared_ptr<RenderOperation> rhs) const
+{
+  return costCalculator->canShareRenderPass(*lhs, *rhs);
+}
+
+void SingleQueueWorkflowCompiler::mergeRenderPasses(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences)
+{
+  // graphics operation may be moved back to the last compatible operation if it does not depend on any operation between them.
+  // Operations that were skipped do not depend on moved operation, because they were scheduled before it
+  for (auto& sequence : operationSequences)
+  {
+    for (uint32_t i = 1; i < sequence.size(); ++i)
+    {
+      auto operation = sequence[i];
+      if (operation->operationType != RenderOperation::Graphics || canShareRenderPass(sequence[i - 1], operation))
+        continue;
+      auto previousOperations = workflow.getPreviousOperations(operation->name);
+      uint32_t target = 0;
+      // operation cannot be moved in front of any of its predecessors
+      for (uint32_t j = i - 1; j > 0; --j)
+      {
+        if (previousOperations.find(sequence[j]) != end(previousOperations))
+          break;
+        if (canShareRenderPass(sequence[j - 1], operation))
+        {
+          target = j;
+          break;
+        }
+      }
+      if (target > 0)
+        std::rotate(begin(sequence) + target, begin(sequence) + i, begin(sequence) + i + 1);
+    }
+  }
+}
+
+// render passes are compatible when they differ only in load/store operations and image layouts. Frame buffer may be used with all compatible render passes
+static bool renderPassesCompatible(const RenderPass& lhs, const RenderPass& rhs)
+{
+  if (lhs.frameBuffer == nullptr || rhs.frameBuffer == nullptr || lhs.multiViewRenderPass != rhs.multiViewRenderPass)
+    return false;
+  if (lhs.attachments.size() != rhs.attachments.size() || lhs.subPasses.size() != rhs.subPasses.size() || lhs.dependencies.size() != rhs.dependencies.size())
+    return false;
+  if (lhs.frameBuffer->getNumImageDefinitions() != rhs.frameBuffer->getNumImageDefinitions())
+    return false;
+  for (uint32_t i = 0; i < lhs.frameBuffer->getNumImageDefinitions(); ++i)
+  {
+    const auto& ld = lhs.frameBuffer->getImageDefinition(i);
+    const auto& rd = rhs.frameBuffer->getImageDefinition(i);
+    if (ld.name != rd.name || ld.format != rd.format || ld.samples != rd.samples || ld.attachmentSize != rd.attachmentSize)
+      return false;
+  }
+  for (uint32_t i = 0; i < lhs.attachments.size(); ++i)
+  {
+    if (lhs.attachments[i].format != rhs.attachments[i].format || lhs.attachments[i].samples != rhs.attachments[i].samples || lhs.attachments[i].flags != rhs.attachments[i].flags)
+      return false;
+  }
+  auto sameReferences = [](const std::vector<VkAttachmentReference>& l, const std::vector<VkAttachmentReference>& r) -> bool
+  {
+    return l.size() == r.size() && std::equal(begin(l), end(l), begin(r), [](const VkAttachmentReference& a, const VkAttachmentReference& b) { return a.attachment == b.attachment; });
+  };
+  for (uint32_t i = 0; i < lhs.subPasses.size(); ++i)
+  {
+    const auto& ls = lhs.subPasses[i].lock()->definition;
+    const auto& rs = rhs.subPasses[i].lock()->definition;
+    if (ls.pipelineBindPoint != rs.pipelineBindPoint || ls.flags != rs.flags || ls.multiViewMask != rs.multiViewMask || ls.preserveAttachments != rs.preserveAttachments)
+      return false;
+    if (!sameReferences(ls.inputAttachments, rs.inputAttachments) || !sameReferences(ls.colorAttachments, rs.colorAttachments) || !sameReferences(ls.resolveAttachments, rs.resolveAttachments))
+      return false;
+    if (ls.depthStencilAttachment.attachment != rs.depthStencilAttachment.attachment)
+      return false;
+  }
+  for (uint32_t i = 0; i < lhs.dependencies.size(); ++i)
+  {
+    const auto& ld = lhs.dependencies[i];
+    const auto& rd = rhs.dependencies[i];
+    if (ld.srcSubpass != rd.srcSubpass || ld.dstSubpass != rd.dstSubpass || ld.srcStageMask != rd.srcStageMask || ld.dstStageMask != rd.dstStageMask ||
+      ld.srcAccessMask != rd.srcAccessMask || ld.dstAccessMask != rd.dstAccessMask || ld.dependencyFlags != rd.dependencyFlags)
+      return false;
+  }
+  return true;
+}
+
+void SingleQueueWorkflowCompiler::shareFrameBuffers(std::shared_ptr<RenderWorkflowResults> workflowResults)
+{
+  std::vector<std::shared_ptr<RenderPass>> renderPasses;
+  for (auto& commandSequence : workflowResults->commands)
+  {
+    for (auto& command : commandSequence)
+    {
+      if (command->commandType != RenderCommand::ctRenderSubPass)
+        continue;
+      auto subpass = std::dynamic_pointer_cast<RenderSubPass>(command);
+      if (subpass->renderPass != nullptr && std::find(begin(renderPasses), end(renderPasses), subpass->renderPass) == end(renderPasses))
+        renderPasses.push_back(subpass->renderPass);
+    }
+  }
+  for (uint32_t i = 1; i < renderPasses.size(); ++i)
+  {
+    for (uint32_t j = 0; j < i; ++j)
+    {
+      if (!renderPassesCompatible(*renderPasses[j], *renderPasses[i]))
+        continue;
+      auto fbit = std::find(begin(workflowResults->frameBuffers), end(workflowResults->frameBuffers), renderPasses[i]->frameBuffer);
+      if (fbit != end(workflowResults->frameBuffers))
+        workflowResults->frameBuffers.erase(fbit);
+      renderPasses[i]->frameBuffer = renderPasses[j]->frameBuffer;
+      break;
+    }
   }
 }
 
@@ -1098,12 +1835,21 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
         auto resourceType   = transition->resource->resourceType;
         auto aspectMask     = getAspectMask(resourceType->attachment.attachmentType);
         uint32_t layerCount = static_cast<uint32_t>(resourceType->attachment.attachmentSize.imageSize.z);
+        bool transient      = workflowResults->transientAttachments.find(resourceName) != end(workflowResults->transientAttachments);
+        auto imageUsage     = resourceType->attachment.imageUsage | (transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
         auto ait            = workflowResults->registeredMemoryImages.find(resourceName);
         if (ait == end(workflowResults->registeredMemoryImages))
         {
-          ImageTraits imageTraits(resourceType->attachment.imageUsage, resourceType->attachment.format, imSize, 1, layerCount, resourceType->attachment.samples, false, VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_IMAGE_TYPE_2D, VK_SHARING_MODE_EXCLUSIVE);
-          SwapChainImageBehaviour scib = (resourceType->attachment.attachmentType == atSurface) ? swForEachImage : swOnce;
-          ait = workflowResults->registeredMemoryImages.insert({ resourceName, std::make_shared<MemoryImage>(imageTraits, workflow.frameBufferAllocator, aspectMask, pbPerSurface, scib, false, false) }).first;
+          ImageTraits imageTraits(imageUsage, resourceType->attachment.format, imSize, 1, layerCount, resourceType->attachment.samples, false, VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_IMAGE_TYPE_2D, VK_SHARING_MODE_EXCLUSIVE);
+          SwapChainImageBehaviour scib = (resourceType->attachment.attachmentType == atSurface) ? swForEachSwapChainImage : swOnce;
+          auto allocator = (transient && workflow.transientAttachmentAllocator != nullptr) ? workflow.transientAttachmentAllocator : workflow.frameBufferAllocator;
+          ait = workflowResults->registeredMemoryImages.insert({ resourceName, std::make_shared<MemoryImage>(imageTraits, allocator, aspectMask, pbPerSurface, scib, false, false) }).first;
+          auto smit = workflowResults->sharedImageMemory.find(resourceName);
+          if (smit != end(workflowResults->sharedImageMemory))
+            ait->second->setSharedMemory(smit->second);
+          // transient attachments stay in their own ( possibly lazily allocated ) memory
+          else if (workflow.attachmentMemoryPool != nullptr && allocator == workflow.frameBufferAllocator && resourceType->attachment.attachmentType != atSurface)
+            ait->second->setAttachmentMemoryPool(workflow.attachmentMemoryPool);
         }
         auto aiv = workflowResults->registeredImageViews.find(resourceName);
         if (aiv == end(workflowResults->registeredImageViews))
@@ -1111,7 +1857,11 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
           ImageSubresourceRange range(aspectMask, 0, 1, 0, layerCount);
           VkImageViewType imageViewType = (layerCount > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
           aiv = workflowResults->registeredImageViews.insert({ resourceName, std::make_shared<ImageView>(ait->second, range, imageViewType) }).first;
-          workflowResults->initialImageLayouts.insert({ resourceName, std::make_tuple(opLayouts[resid], resourceType->attachment.attachmentType , aspectMask) });
+          // content of images sharing memory ( and of transient images ) is undefined at the beginning of a frame - render pass that generates it will transition the layout.
+          // Outputs of rate limited operations keep their content and layout between frames
+          bool keepLayout = transient || isGeneratedByRateLimitedOperation(workflow, resourceName) || workflowResults->sharedImageMemory.find(resourceName) != end(workflowResults->sharedImageMemory);
+          VkImageLayout initialLayout = keepLayout ? VK_IMAGE_LAYOUT_UNDEFINED : opLayouts[resid];
+          workflowResults->initialImageLayouts.insert({ resourceName, std::make_tuple(initialLayout, resourceType->attachment.attachmentType , aspectMask) });
         }
         if (definedImages.find(resourceName) == end(definedImages))
         {
@@ -1120,7 +1870,7 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
           frameBufferDefinitions.push_back(FrameBufferImageDefinition(
             resourceType->attachment.attachmentType,
             resourceType->attachment.format,
-            resourceType->attachment.imageUsage,
+            imageUsage,
             aspectMask,
             resourceType->attachment.samples,
             resourceName,
@@ -1141,6 +1891,7 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
     std::vector<AttachmentDefinition> attachments;
     std::vector<VkClearValue>         clearValues(frameBufferDefinitions.size(), makeColorClearValue(glm::vec4(0.0f)));
     std::vector<char>                 clearValuesInitialized(frameBufferDefinitions.size(), false);
+    std::vector<char>                 attachmentUsed(frameBufferDefinitions.size(), false);
     for (uint32_t i = 0; i < frameBufferDefinitions.size(); ++i)
     {
       attachments.push_back(AttachmentDefinition(
@@ -1181,7 +1932,26 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
         // if it's an output transition
         if ((transition->transitionType & rttAllOutputs) != 0)
         {
-          if (attachments[attIndex].initialLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+          // image sharing memory with other images ( or transient image, or output of rate limited operation ) is generated here : its previous content and layout are undefined
+          bool sharedMemory = workflowResults->sharedImageMemory.find(resourceName) != end(workflowResults->sharedImageMemory) ||
+                              workflowResults->transientAttachments.find(resourceName) != end(workflowResults->transientAttachments) ||
+                              isGeneratedByRateLimitedOperation(workflow, resourceName);
+          if (sharedMemory && !attachmentUsed[attIndex] && transition->load.loadType != LoadOp::Load)
+          {
+            attachments[attIndex].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            // previous users of the memory must finish before layout transition
+            VkPipelineStageFlags dstStageMask  = stencilDepthAttachment ? (VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT) : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            VkAccessFlags        dstAccessMask = stencilDepthAttachment ? (VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT) : (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+            auto dep = std::find_if(begin(renderPass->dependencies), end(renderPass->dependencies),
+              [&subPass](const SubpassDependencyDefinition& sd) -> bool { return sd.srcSubpass == VK_SUBPASS_EXTERNAL && sd.dstSubpass == subPass->subpassIndex; });
+            if (dep == end(renderPass->dependencies))
+              dep = renderPass->dependencies.insert(end(renderPass->dependencies), SubpassDependencyDefinition(VK_SUBPASS_EXTERNAL, subPass->subpassIndex, 0, 0, 0, 0, 0));
+            dep->srcStageMask  |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            dep->dstStageMask  |= dstStageMask;
+            dep->srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            dep->dstAccessMask |= dstAccessMask;
+          }
+          else if (attachments[attIndex].initialLayout == VK_IMAGE_LAYOUT_UNDEFINED)
             attachments[attIndex].initialLayout = transition->layout;
         }
 
@@ -1204,6 +1974,7 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
             clearValues[attIndex] = makeColorClearValue(transition->load.clearColor);
           clearValuesInitialized[attIndex] = true;
         }
+        attachmentUsed[attIndex] = true;
       }
     }
 
@@ -1261,7 +2032,7 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
       for (auto& outTransition : outTransitions)
         subpassResourceNames.insert(outTransition->resource->name);
       // for each unused resource : it must be preserved when
-      // - it is persistent
+      // - it is persistent or it is generated by rate limited operation
       // - it is swapchain image
       // - it was used before
       // - it is used later in a subpass or outside
@@ -1294,10 +2065,11 @@ void SingleQueueWorkflowCompiler::buildFrameBuffersAndRenderPasses(const RenderW
             break;
           }
         }
-        bool isSurfaceOrPersistent = resource->resourceType->attachment.attachmentType == atSurface || resource->resourceType->persistent;
+        bool isSurfaceOrPersistent = resource->resourceType->attachment.attachmentType == atSurface || resource->resourceType->persistent || isGeneratedByRateLimitedOperation(workflow, resName);
         bool usedNow               = subpassResourceNames.find(resName) != end(subpassResourceNames) || subpassResourceNames.find(workflowResults->resourceAlias.at(resName)) != end(subpassResourceNames);
         bool preserve              = usedBefore && !usedNow && (usedLater || isSurfaceOrPersistent);
-        bool save                  = lastSubpass && (usedLater || isSurfaceOrPersistent);
+        bool transient             = workflowResults->transientAttachments.find(workflowResults->resourceAlias.at(resName)) != end(workflowResults->transientAttachments);
+        bool save                  = lastSubpass && !transient && (usedLater || isSurfaceOrPersistent);
         uint32_t attIndex          = definedImages.at(workflowResults->resourceAlias.at(resName));
         if (preserve)
           subPassDefinition.preserveAttachments.push_back(attIndex);
@@ -1367,7 +2139,7 @@ void SingleQueueWorkflowCompiler::createPipelineBarriers(const RenderWorkflow& w
       return queueNumber[lhs->operation->name] < queueNumber[rhs->operation->name];
     });
 
-    // for now we will create a barrier/subpass dependency for each transition. It should be later optimized ( some barriers are not necessary )
+    // create a barrier/subpass dependency for each transition. Unnecessary barriers are removed later in optimizePipelineBarriers()
     for (auto& consumingTransition : consumingTransitions)
     {
       if( ((generatingTransitions[0]->transitionType & rttAllAttachmentOutputs) != 0) && ((consumingTransition->transitionType & rttAllAttachmentInputs) != 0) )
@@ -1378,12 +2150,26 @@ void SingleQueueWorkflowCompiler::createPipelineBarriers(const RenderWorkflow& w
   }
 }
 
+// operation type tells which pipeline stages may actually use the resource ( e.g. compute operation never uses fragment shader )
+static VkPipelineStageFlags narrowPipelineStages(RenderOperation::Type operationType, VkPipelineStageFlags stages)
+{
+  VkPipelineStageFlags result = stages;
+  if (operationType == RenderOperation::Compute)
+    result &= ~(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+      VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  else
+    result &= ~VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  return (result != 0) ? result : stages;
+}
+
 void SingleQueueWorkflowCompiler::createSubpassDependency(std::shared_ptr<ResourceTransition> generatingTransition, std::shared_ptr<RenderCommand> generatingCommand, std::shared_ptr<ResourceTransition> consumingTransition, std::shared_ptr<RenderCommand> consumingCommand, uint32_t generatingQueueIndex, uint32_t consumingQueueIndex, std::shared_ptr<RenderWorkflowResults> workflowResults)
 {
   VkPipelineStageFlags srcStageMask = 0,  dstStageMask = 0;
   VkAccessFlags        srcAccessMask = 0, dstAccessMask = 0;
   getPipelineStageMasks(generatingTransition, consumingTransition, srcStageMask, dstStageMask);
   getAccessMasks(generatingTransition, consumingTransition, srcAccessMask, dstAccessMask);
+  srcStageMask = narrowPipelineStages(generatingTransition->operation->operationType, srcStageMask);
+  dstStageMask = narrowPipelineStages(consumingTransition->operation->operationType, dstStageMask);
 
   uint32_t             srcSubpassIndex = VK_SUBPASS_EXTERNAL, dstSubpassIndex = VK_SUBPASS_EXTERNAL;
   // try to add subpass dependency to latter command
@@ -1429,10 +2215,37 @@ void SingleQueueWorkflowCompiler::createSubpassDependency(std::shared_ptr<Resour
     createPipelineBarrier(generatingTransition, generatingCommand, consumingTransition, consumingCommand, generatingQueueIndex, consumingQueueIndex, workflowResults);
 }
 
+// queues without graphics capabilities ( e.g. async compute queue ) cannot use graphics pipeline stages in barriers and semaphores
+static VkPipelineStageFlags limitPipelineStages(const QueueTraits& queueTraits, VkPipelineStageFlags stages)
+{
+  if ((queueTraits.mustHave & VK_QUEUE_GRAPHICS_BIT) != 0 || stages == 0)
+    return stages;
+  const VkPipelineStageFlags computeStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  stages &= computeStages;
+  return (stages != 0) ? stages : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
+
 void SingleQueueWorkflowCompiler::createPipelineBarrier(std::shared_ptr<ResourceTransition> generatingTransition, std::shared_ptr<RenderCommand> generatingCommand, std::shared_ptr<ResourceTransition> consumingTransition, std::shared_ptr<RenderCommand> consumingCommand, uint32_t generatingQueueIndex, uint32_t consumingQueueIndex, std::shared_ptr<RenderWorkflowResults> workflowResults)
 {
   auto workflow = generatingTransition->operation->renderWorkflow.lock();
 
+  VkPipelineStageFlags srcStageMask = 0,  dstStageMask = 0;
+  VkAccessFlags        srcAccessMask = 0, dstAccessMask = 0;
+  getPipelineStageMasks(generatingTransition, consumingTransition, srcStageMask, dstStageMask);
+  getAccessMasks(generatingTransition, consumingTransition, srcAccessMask, dstAccessMask);
+  srcStageMask = limitPipelineStages(workflowResults->queueTraits[generatingQueueIndex], narrowPipelineStages(generatingTransition->operation->operationType, srcStageMask));
+  dstStageMask = limitPipelineStages(workflowResults->queueTraits[consumingQueueIndex], narrowPipelineStages(consumingTransition->operation->operationType, dstStageMask));
+
+  // operations from different queues are synchronized by semaphores ( consuming queue waits for generating queue )
+  uint32_t srcQueueIndex = VK_QUEUE_FAMILY_IGNORED, dstQueueIndex = VK_QUEUE_FAMILY_IGNORED;
+  if (generatingQueueIndex != consumingQueueIndex)
+  {
+    workflowResults->queueDependencies[consumingQueueIndex][generatingQueueIndex] |= (dstStageMask != 0) ? dstStageMask : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    srcQueueIndex = generatingQueueIndex;
+    dstQueueIndex = consumingQueueIndex;
+  }
+
   // If there's no associated memory object then there can be no pipeline barrier
   // Some inputs/outputs may be added without memory objects just to enforce proper order of operations
   auto memoryObject = workflow->getAssociatedMemoryObject(generatingTransition->resource->name);
@@ -1444,19 +2257,35 @@ void SingleQueueWorkflowCompiler::createPipelineBarrier(std::shared_ptr<Resource
     memoryObject = it->second;
   }
 
-  uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  if (generatingQueueIndex != consumingQueueIndex)
+  VkDependencyFlags dependencyFlags = 0; // FIXME
+
+  // resource used by another queue must be released by generating queue ( queue family ownership transfer ). Release barrier is recorded after
+  // generating operation ( or after the render pass, when generating operation is a subpass ), and acquire barrier is recorded before consuming operation
+  if (srcQueueIndex != dstQueueIndex)
   {
-    // TODO - find family indices for both queues
+    auto releasingCommand = generatingCommand;
+    if (generatingCommand->commandType == RenderCommand::ctRenderSubPass)
+      releasingCommand = std::dynamic_pointer_cast<RenderSubPass>(generatingCommand)->renderPass->subPasses.back().lock();
+    MemoryObjectBarrierGroup releaseGroup(srcStageMask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, dependencyFlags);
+    auto releaseit = releasingCommand->barriersAfterOp.find(releaseGroup);
+    if (releaseit == end(releasingCommand->barriersAfterOp))
+      releaseit = releasingCommand->barriersAfterOp.insert({ releaseGroup, std::vector<MemoryObjectBarrier>() }).first;
+    switch (generatingTransition->resource->resourceType->metaType)
+    {
+    case RenderWorkflowResourceType::Buffer:
+      releaseit->second.push_back(MemoryObjectBarrier(srcAccessMask, 0, srcQueueIndex, dstQueueIndex, memoryObject, generatingTransition->bufferSubresourceRange));
+      break;
+    case RenderWorkflowResourceType::Image:
+    case RenderWorkflowResourceType::Attachment:
+      releaseit->second.push_back(MemoryObjectBarrier(srcAccessMask, 0, srcQueueIndex, dstQueueIndex, memoryObject, generatingTransition->layout, consumingTransition->layout, generatingTransition->imageSubresourceRange));
+      break;
+    default:
+      break;
+    }
+    srcStageMask  = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    srcAccessMask = 0;
   }
 
-  VkPipelineStageFlags srcStageMask = 0,  dstStageMask = 0;
-  VkAccessFlags        srcAccessMask = 0, dstAccessMask = 0;
-  getPipelineStageMasks(generatingTransition, consumingTransition, srcStageMask, dstStageMask);
-  getAccessMasks(generatingTransition, consumingTransition, srcAccessMask, dstAccessMask);
-
-  VkDependencyFlags dependencyFlags = 0; // FIXME
-
   MemoryObjectBarrierGroup rbg(srcStageMask, dstStageMask, dependencyFlags);
   auto rbgit = consumingCommand->barriersBeforeOp.find(rbg);
   if (rbgit == end(consumingCommand->barriersBeforeOp))
@@ -1466,7 +2295,7 @@ void SingleQueueWorkflowCompiler::createPipelineBarrier(std::shared_ptr<Resource
   case RenderWorkflowResourceType::Buffer:
   {
     auto bufferRange = generatingTransition->bufferSubresourceRange;
-    rbgit->second.push_back(MemoryObjectBarrier(srcAccessMask, dstAccessMask, srcQueueFamilyIndex, dstQueueFamilyIndex, memoryObject, bufferRange));
+    rbgit->second.push_back(MemoryObjectBarrier(srcAccessMask, dstAccessMask, srcQueueIndex, dstQueueIndex, memoryObject, bufferRange));
     break;
   }
   case RenderWorkflowResourceType::Image:
@@ -1475,10 +2304,348 @@ void SingleQueueWorkflowCompiler::createPipelineBarrier(std::shared_ptr<Resource
     VkImageLayout oldLayout = generatingTransition->layout;
     VkImageLayout newLayout = consumingTransition->layout;
     auto imageRange         = generatingTransition->imageSubresourceRange;
-    rbgit->second.push_back(MemoryObjectBarrier(srcAccessMask, dstAccessMask, srcQueueFamilyIndex, dstQueueFamilyIndex, memoryObject, oldLayout, newLayout, imageRange));
+    rbgit->second.push_back(MemoryObjectBarrier(srcAccessMask, dstAccessMask, srcQueueIndex, dstQueueIndex, memoryObject, oldLayout, newLayout, imageRange));
     break;
   }
   default:
     break;
   }
 }
+
+void SingleQueueWorkflowCompiler::createRateLimitedBarriers(const RenderWorkflow& workflow, std::shared_ptr<RenderWorkflowResults> workflowResults)
+{
+  std::map<std::string, uint32_t> queueNumber;
+  std::map<std::string, uint32_t> operationNumber;
+  std::map<std::string, std::shared_ptr<RenderCommand>> commandMap;
+  for (uint32_t queueIndex = 0; queueIndex < workflowResults->commands.size(); ++queueIndex)
+  {
+    for (uint32_t operationIndex = 0; operationIndex < workflowResults->commands[queueIndex].size(); ++operationIndex)
+    {
+      auto& command = workflowResults->commands[queueIndex][operationIndex];
+      queueNumber[command->operation->name]     = queueIndex;
+      operationNumber[command->operation->name] = operationIndex;
+      commandMap[command->operation->name]      = command;
+    }
+  }
+
+  // image layout after the command : render pass leaves its attachment in the layout of its last use within the render pass
+  auto getLayoutAfterCommand = [&workflow, &workflowResults, &commandMap](std::shared_ptr<ResourceTransition> transition) -> VkImageLayout
+  {
+    auto command = commandMap[transition->operation->name];
+    if (command->commandType != RenderCommand::ctRenderSubPass || (transition->transitionType & rttAllAttachments) == 0)
+      return transition->layout;
+    VkImageLayout layout = transition->layout;
+    auto resourceName    = workflowResults->resourceAlias.at(transition->resource->name);
+    for (auto& sb : std::dynamic_pointer_cast<RenderSubPass>(command)->renderPass->subPasses)
+      for (auto& subPassTransition : workflow.getOperationIO(sb.lock()->operation->name, rttAllAttachments))
+        if (workflowResults->resourceAlias.at(subPassTransition->resource->name) == resourceName)
+          layout = subPassTransition->layout;
+    return layout;
+  };
+  // barrier transitioning the image back to generating layout is recorded after the command ( or after the render pass, when command is a subpass )
+  auto addRestoringBarrier = [&workflow, &workflowResults, &commandMap, &getLayoutAfterCommand](std::shared_ptr<ResourceTransition> transition, std::shared_ptr<ResourceTransition> generatingTransition)
+  {
+    VkImageLayout layoutAfterCommand = getLayoutAfterCommand(transition);
+    if (layoutAfterCommand == generatingTransition->layout)
+      return;
+    auto memoryObject = workflow.getAssociatedMemoryObject(generatingTransition->resource->name);
+    if (memoryObject == nullptr)
+    {
+      auto it = workflowResults->registeredMemoryImages.find(workflowResults->resourceAlias.at(generatingTransition->resource->name));
+      if (it == end(workflowResults->registeredMemoryImages))
+        return;
+      memoryObject = it->second;
+    }
+
+    auto restoringCommand = commandMap[transition->operation->name];
+    if (restoringCommand->commandType == RenderCommand::ctRenderSubPass)
+      restoringCommand = std::dynamic_pointer_cast<RenderSubPass>(restoringCommand)->renderPass->subPasses.back().lock();
+    MemoryObjectBarrierGroup restoreGroup(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0);
+    auto restoreit = restoringCommand->barriersAfterOp.find(restoreGroup);
+    if (restoreit == end(restoringCommand->barriersAfterOp))
+      restoreit = restoringCommand->barriersAfterOp.insert({ restoreGroup, std::vector<MemoryObjectBarrier>() }).first;
+    // many subpasses of the same render pass may use the image
+    if (std::any_of(begin(restoreit->second), end(restoreit->second), [&memoryObject](const MemoryObjectBarrier& barrier) { return barrier.memoryObject == memoryObject; }))
+      return;
+    restoreit->second.push_back(MemoryObjectBarrier(0, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, memoryObject, layoutAfterCommand, generatingTransition->layout, generatingTransition->imageSubresourceRange));
+  };
+
+  // Rate limited operation skips its barriers and layout transitions in frames when it's not performed, so barriers of other operations
+  // must be valid both in frames when it is performed and when it is not :
+  // - image consumed by rate limited operation is transitioned back to generating layout right after that operation
+  // - outputs of rate limited operation must be in the same layout as they were left by the operation itself. Last operation using such image transitions it back to generating layout
+  for (auto& resourceName : workflow.getResourceNames())
+  {
+    auto resource = workflow.getResource(resourceName);
+    if (!resource->resourceType->isImageOrAttachment())
+      continue;
+    auto generatingTransitions = workflow.getResourceIO(resourceName, rttAllOutputs);
+    auto consumingTransitions  = workflow.getResourceIO(resourceName, rttAllInputs);
+    if (generatingTransitions.empty() || consumingTransitions.empty())
+      continue;
+    auto generatingOperation = generatingTransitions[0]->operation;
+
+    for (auto& consumingTransition : consumingTransitions)
+    {
+      if (!consumingTransition->operation->isRateLimited() || consumingTransition->operation == generatingOperation)
+        continue;
+      CHECK_LOG_THROW(queueNumber[consumingTransition->operation->name] != queueNumber[generatingOperation->name], "Resource " << resourceName << " consumed by rate limited operation " << consumingTransition->operation->name << " cannot be generated on another queue by operation " << generatingOperation->name);
+      addRestoringBarrier(consumingTransition, generatingTransitions[0]);
+    }
+
+    if (!generatingOperation->isRateLimited())
+      continue;
+    for (auto& consumingTransition : consumingTransitions)
+      CHECK_LOG_THROW(queueNumber[consumingTransition->operation->name] != queueNumber[generatingOperation->name], "Resource " << resourceName << " generated by rate limited operation " << generatingOperation->name << " cannot be used on another queue by operation " << consumingTransition->operation->name);
+    auto lastTransition = *std::max_element(begin(consumingTransitions), end(consumingTransitions), [&operationNumber](std::shared_ptr<ResourceTransition> lhs, std::shared_ptr<ResourceTransition> rhs)
+    {
+      return operationNumber[lhs->operation->name] < operationNumber[rhs->operation->name];
+    });
+    CHECK_LOG_THROW(lastTransition->operation->isRateLimited() && !lastTransition->operation->hasSameUpdatePeriod(*generatingOperation), "Resource " << resourceName << " generated by rate limited operation " << generatingOperation->name << " is last used by operation " << lastTransition->operation->name << " that has different update period");
+    // rate limited consumers restore the layout already
+    if (!lastTransition->operation->isRateLimited())
+      addRestoringBarrier(lastTransition, generatingTransitions[0]);
+  }
+}
+
+// barriers that may be merged into one barrier : the same memory object, layouts and queues
+static bool barriersMergeable(const MemoryObjectBarrier& lhs, const MemoryObjectBarrier& rhs)
+{
+  if (lhs.memoryObject != rhs.memoryObject || lhs.objectType != rhs.objectType || lhs.srcQueueIndex != rhs.srcQueueIndex || lhs.dstQueueIndex != rhs.dstQueueIndex)
+    return false;
+  switch (lhs.objectType)
+  {
+  case MemoryObject::moBuffer:
+    return lhs.bufferRange.touches(rhs.bufferRange);
+  case MemoryObject::moImage:
+    return lhs.oldLayout == rhs.oldLayout && lhs.newLayout == rhs.newLayout && lhs.imageRange.aspectMask == rhs.imageRange.aspectMask &&
+      (lhs.imageRange.contains(rhs.imageRange) || rhs.imageRange.contains(lhs.imageRange));
+  default:
+    return false;
+  }
+}
+
+// true when barrier recorded earlier already made results available for the later barrier
+static bool barrierImplies(const MemoryObjectBarrierGroup& group, const MemoryObjectBarrier& barrier, const MemoryObjectBarrierGroup& laterGroup, const MemoryObjectBarrier& laterBarrier)
+{
+  if (!barriersMergeable(barrier, laterBarrier))
+    return false;
+  if ((group.srcStageMask & laterGroup.srcStageMask) != laterGroup.srcStageMask || (group.dstStageMask & laterGroup.dstStageMask) != laterGroup.dstStageMask)
+    return false;
+  if ((barrier.srcAccessMask & laterBarrier.srcAccessMask) != laterBarrier.srcAccessMask || (barrier.dstAccessMask & laterBarrier.dstAccessMask) != laterBarrier.dstAccessMask)
+    return false;
+  if (barrier.objectType == MemoryObject::moBuffer)
+    return barrier.bufferRange.contains(laterBarrier.bufferRange);
+  return barrier.imageRange.contains(laterBarrier.imageRange);
+}
+
+// all barrier groups are merged into one group ( one vkCmdPipelineBarrier() call ), barriers using the same memory object are merged too
+static void mergeBarrierGroups(std::map<MemoryObjectBarrierGroup, std::vector<MemoryObjectBarrier>>& barrierGroups)
+{
+  if (barrierGroups.size() < 2 && (barrierGroups.empty() || barrierGroups.begin()->second.size() < 2))
+    return;
+  MemoryObjectBarrierGroup mergedGroup(0, 0, barrierGroups.begin()->first.dependencyFlags);
+  std::vector<MemoryObjectBarrier> mergedBarriers;
+  for (auto& group : barrierGroups)
+  {
+    mergedGroup.srcStageMask    |= group.first.srcStageMask;
+    mergedGroup.dstStageMask    |= group.first.dstStageMask;
+    mergedGroup.dependencyFlags &= group.first.dependencyFlags;
+    for (auto& barrier : group.second)
+    {
+      auto it = std::find_if(begin(mergedBarriers), end(mergedBarriers), [&barrier](const MemoryObjectBarrier& mb) { return barriersMergeable(mb, barrier); });
+      if (it == end(mergedBarriers))
+      {
+        mergedBarriers.push_back(barrier);
+        continue;
+      }
+      it->srcAccessMask |= barrier.srcAccessMask;
+      it->dstAccessMask |= barrier.dstAccessMask;
+      if (it->objectType == MemoryObject::moBuffer)
+        it->bufferRange = it->bufferRange.merge(barrier.bufferRange);
+      else if (barrier.imageRange.contains(it->imageRange))
+        it->imageRange = barrier.imageRange;
+    }
+  }
+  barrierGroups.clear();
+  barrierGroups.insert({ mergedGroup, mergedBarriers });
+}
+
+void SingleQueueWorkflowCompiler::optimizePipelineBarriers(const RenderWorkflow& workflow, std::shared_ptr<RenderWorkflowResults> workflowResults)
+{
+  auto countBarriers = [&workflowResults](uint32_t& barrierCount, uint32_t& groupCount)
+  {
+    barrierCount = groupCount = 0;
+    for (auto& commandSequence : workflowResults->commands)
+    {
+      for (auto& command : commandSequence)
+      {
+        for (auto& group : command->barriersBeforeOp)
+          barrierCount += group.second.size();
+        for (auto& group : command->barriersAfterOp)
+          barrierCount += group.second.size();
+        groupCount += command->barriersBeforeOp.size() + command->barriersAfterOp.size();
+      }
+    }
+  };
+  countBarriers(workflowResults->barrierCountBeforeOptimization, workflowResults->barrierGroupCountBeforeOptimization);
+
+  // Resource consumed by many operations on the same queue gets a barrier before each consuming operation.
+  // Later barriers are not needed when earlier barrier has already synchronized the same memory for the same stages.
+  // Queue ownership transfers are never removed
+  struct ActiveBarrier
+  {
+    MemoryObjectBarrierGroup group;
+    MemoryObjectBarrier      barrier;
+  };
+  for (auto& commandSequence : workflowResults->commands)
+  {
+    std::vector<ActiveBarrier> activeBarriers;
+    auto forgetMemoryObject = [&activeBarriers](const std::shared_ptr<MemoryObject>& memoryObject)
+    {
+      activeBarriers.erase(std::remove_if(begin(activeBarriers), end(activeBarriers), [&memoryObject](const ActiveBarrier& ab) { return ab.barrier.memoryObject == memoryObject; }), end(activeBarriers));
+    };
+    for (auto& command : commandSequence)
+    {
+      for (auto git = begin(command->barriersBeforeOp); git != end(command->barriersBeforeOp); )
+      {
+        auto& barriers = git->second;
+        for (auto bit = begin(barriers); bit != end(barriers); )
+        {
+          if (bit->srcQueueIndex != VK_QUEUE_FAMILY_IGNORED || bit->dstQueueIndex != VK_QUEUE_FAMILY_IGNORED)
+          {
+            forgetMemoryObject(bit->memoryObject);
+            ++bit;
+            continue;
+          }
+          const auto& group = git->first;
+          if (std::any_of(begin(activeBarriers), end(activeBarriers), [&group, &bit](const ActiveBarrier& ab) { return barrierImplies(ab.group, ab.barrier, group, *bit); }))
+          {
+            bit = barriers.erase(bit);
+            continue;
+          }
+          // barriers of rate limited operation are not recorded in every frame, so they cannot replace barriers of other operations
+          if (command->operation->isRateLimited())
+          {
+            forgetMemoryObject(bit->memoryObject);
+            ++bit;
+            continue;
+          }
+          // image layout changed - earlier barriers no longer describe this image
+          if (bit->objectType == MemoryObject::moImage)
+          {
+            const auto& barrier = *bit;
+            activeBarriers.erase(std::remove_if(begin(activeBarriers), end(activeBarriers), [&barrier](const ActiveBarrier& ab) { return ab.barrier.memoryObject == barrier.memoryObject && ab.barrier.newLayout != barrier.newLayout; }), end(activeBarriers));
+          }
+          activeBarriers.push_back(ActiveBarrier{ group, *bit });
+          ++bit;
+        }
+        if (barriers.empty())
+          git = command->barriersBeforeOp.erase(git);
+        else
+          ++git;
+      }
+
+      // memory written by the operation must be synchronized again by next barriers. Render pass also changes layouts of its attachments
+      ResourceTransitionTypeFlags changedResources = rttAllOutputs;
+      if (command->commandType == RenderCommand::ctRenderSubPass)
+        changedResources |= rttAllAttachments;
+      for (auto& transition : workflow.getOperationIO(command->operation->name, changedResources))
+      {
+        const auto& alias = workflowResults->resourceAlias.at(transition->resource->name);
+        auto iit = workflowResults->registeredMemoryImages.find(alias);
+        if (iit != end(workflowResults->registeredMemoryImages))
+          forgetMemoryObject(iit->second);
+        auto bit = workflowResults->registeredMemoryBuffers.find(alias);
+        if (bit != end(workflowResults->registeredMemoryBuffers))
+          forgetMemoryObject(bit->second);
+      }
+      // resources released to other queues
+      for (auto& group : command->barriersAfterOp)
+        for (auto& barrier : group.second)
+          forgetMemoryObject(barrier.memoryObject);
+    }
+  }
+
+  // each command records at most one barrier before and one barrier after the operation
+  for (auto& commandSequence : workflowResults->commands)
+  {
+    for (auto& command : commandSequence)
+    {
+      mergeBarrierGroups(command->barriersBeforeOp);
+      mergeBarrierGroups(command->barriersAfterOp);
+    }
+  }
+
+  countBarriers(workflowResults->barrierCountAfterOptimization, workflowResults->barrierGroupCountAfterOptimization);
+}
+
+std::map<std::string, uint32_t> pumex::assignOperationsToQueues(const RenderWorkflow& workflow, uint32_t mainQueueIndex, uint32_t computeQueueIndex)
+{
+  // operations are visited in order of dependencies, so all previous operations have their queues assigned already
+  std::vector<std::shared_ptr<RenderOperation>> operations;
+  std::set<std::shared_ptr<RenderOperation>> doneOperations;
+  auto nextOperations = workflow.getInitialOperations();
+  while (!nextOperations.empty())
+  {
+    std::set<std::shared_ptr<RenderOperation>> candidates;
+    for (auto& operation : nextOperations)
+    {
+      auto previousOperations = workflow.getPreviousOperations(operation->name);
+      if (!std::all_of(begin(previousOperations), end(previousOperations), [&doneOperations](const std::shared_ptr<RenderOperation>& op) { return doneOperations.find(op) != end(doneOperations); }))
+        continue;
+      if (!doneOperations.insert(operation).second)
+        continue;
+      operations.push_back(operation);
+      auto followingOperations = workflow.getNextOperations(operation->name);
+      candidates.insert(begin(followingOperations), end(followingOperations));
+    }
+    nextOperations = candidates;
+  }
+
+  std::map<std::string, uint32_t> results;
+  for (auto& operation : operations)
+  {
+    uint32_t queueIndex = mainQueueIndex;
+    if (operation->operationType == RenderOperation::Compute)
+    {
+      auto previousOperations = workflow.getPreviousOperations(operation->name);
+      if (std::all_of(begin(previousOperations), end(previousOperations), [&results, computeQueueIndex](const std::shared_ptr<RenderOperation>& op) { return results.at(op->name) == computeQueueIndex; }))
+        queueIndex = computeQueueIndex;
+    }
+    results.insert({ operation->name, queueIndex });
+  }
+  return results;
+}
+
+void MultiQueueWorkflowCompiler::scheduleOperationSequences(const RenderWorkflow& workflow, std::vector<std::vector<std::shared_ptr<RenderOperation>>>& operationSequences)
+{
+  CHECK_LOG_THROW(workflow.getQueueTraits().empty(), "Workflow does not define any queue");
+  const auto& queueTraits = workflow.getQueueTraits();
+  operationSequences.assign(queueTraits.size(), std::vector<std::shared_ptr<RenderOperation>>());
+
+  // main queue must be able to perform graphics operations, compute queue is any other queue capable of compute operations
+  uint32_t mainQueueIndex = 0, computeQueueIndex = mainQueueIndex;
+  for (uint32_t i = 0; i < queueTraits.size(); ++i)
+  {
+    if ((queueTraits[i].mustHave & VK_QUEUE_GRAPHICS_BIT) != 0)
+    {
+      mainQueueIndex = i;
+      break;
+    }
+  }
+  for (uint32_t i = 0; i < queueTraits.size(); ++i)
+  {
+    if (i != mainQueueIndex && (queueTraits[i].mustHave & VK_QUEUE_COMPUTE_BIT) != 0)
+    {
+      computeQueueIndex = i;
+      break;
+    }
+  }
+
+  // operations are scheduled as if they were sent to one queue. Each queue receives its operations in that order, which respects all dependencies
+  auto operationQueues   = assignOperationsToQueues(workflow, mainQueueIndex, computeQueueIndex);
+  auto operationSequence = scheduleOperations(workflow, *costCalculator);
+  for (auto& operation : operationSequence)
+    operationSequences[operationQueues.at(operation->name)].push_back(operation);
+}
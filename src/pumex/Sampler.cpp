@@ -100,9 +100,9 @@ std::pair<bool, VkDescriptorType> Sampler::getDefaultDescriptorType()
 void Sampler::validate(const RenderContext& renderContext)
 {
   std::lock_guard<std::mutex> lock(mutex);
-  if (swapChainImageBehaviour == swForEachImage && renderContext.imageCount > activeCount)
+  if (swapChainImageBehaviour == swForEachImage && renderContext.activeCount > activeCount)
   {
-    activeCount = renderContext.imageCount;
+    activeCount = renderContext.activeCount;
     for (auto& pdd : perObjectData)
       pdd.second.resize(activeCount);
   }
@@ -31,13 +31,19 @@
 #include <pumex/MemoryImage.h>
 #include <pumex/Image.h>
 #include <pumex/utils/Log.h>
+#include <pumex/utils/HashCombine.h>
 #include <pumex/RenderWorkflow.h>
 #include <pumex/TimeStatistics.h>
+#include <pumex/UploadBatch.h>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
 
 using namespace pumex;
 
 SurfaceTraits::SurfaceTraits(uint32_t ic, VkColorSpaceKHR ics, uint32_t ial, VkPresentModeKHR  spm, VkSurfaceTransformFlagBitsKHR pt, VkCompositeAlphaFlagBitsKHR ca)
-  : imageCount{ ic }, imageColorSpace{ ics }, imageArrayLayers{ ial }, swapchainPresentMode{ spm }, preTransform{ pt }, compositeAlpha{ ca }
+  : imageCount{ ic }, imageColorSpace{ ics }, imageArrayLayers{ ial }, swapchainPresentMode{ spm }, preTransform{ pt }, compositeAlpha{ ca }, framesInFlight{ 0 },
+  useTransferQueue{ false }, transferQueueTraits{ VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, 0.5f }, transferLatency{ 1 }
 {
 }
 
@@ -45,6 +51,7 @@ Surface::Surface(std::shared_ptr<Viewer> v, std::shared_ptr<Window> w, std::shar
   : viewer{ v }, window{ w }, device{ d }, surface{ s }, surfaceTraits(st)
 {
   timeStatistics = std::make_unique<TimeStatistics>(32);
+  uploadBatch    = std::make_unique<UploadBatch>();
 
   timeStatistics->registerGroup(TSS_GROUP_BASIC,             L"Surface operations");
   timeStatistics->registerGroup(TSS_GROUP_EVENTS,            L"Surface events");
@@ -108,14 +115,15 @@ void Surface::realize()
   {
     std::shared_ptr<Queue> queue = deviceSh->getQueue(q, true);
     CHECK_LOG_THROW(queue.get() == nullptr, "Cannot get the queue for this surface");
-    CHECK_LOG_THROW(supportsPresent[queue->familyIndex] == VK_FALSE, "Support not present for(device,surface,familyIndex) : " << queue->familyIndex);
+    // only presentation queue must support presentation - other queues ( e.g. async compute ) may come from any family
+    CHECK_LOG_THROW(queues.size() == workflowResults->presentationQueueIndex && supportsPresent[queue->familyIndex] == VK_FALSE, "Support not present for(device,surface,familyIndex) : " << queue->familyIndex);
     queues.push_back(queue);
 
     auto commandPool = std::make_shared<CommandPool>(queue->familyIndex);
     commandPool->validate(deviceSh.get());
     commandPools.push_back(commandPool);
 
-    auto commandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPool, surfaceTraits.imageCount);
+    auto commandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPool, getFrameCount());
     primaryCommandBuffers.push_back(commandBuffer);
 
     // Create a semaphore used to synchronize command submission
@@ -128,9 +136,27 @@ void Surface::realize()
     VK_CHECK_LOG_THROW(vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &semaphore1), "Could not create render complete semaphore");
     renderCompleteSemaphores.emplace_back(semaphore1);
   }
-  // define basic command buffers required to render a frame
-  prepareCommandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPools[workflowResults->presentationQueueIndex], surfaceTraits.imageCount);
-  presentCommandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPools[workflowResults->presentationQueueIndex], surfaceTraits.imageCount);
+  createQueueSemaphores();
+  // define basic command buffers required to render a frame. Command buffers using swap chain images are created with the swap chain
+  uploadCommandBuffer  = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPools[workflowResults->presentationQueueIndex], getFrameCount());
+
+  // optional transfer queue for streamed uploads
+  if (surfaceTraits.useTransferQueue)
+  {
+    transferQueue = deviceSh->getQueue(surfaceTraits.transferQueueTraits, true);
+    CHECK_LOG_THROW(transferQueue.get() == nullptr, "Cannot get the transfer queue for surface " << getID());
+    transferCommandPool = std::make_shared<CommandPool>(transferQueue->familyIndex);
+    transferCommandPool->validate(deviceSh.get());
+    // transfer is finished when frame using its data is retired, so command buffers and semaphores are reused after getFrameCount() + transferLatency frames
+    uint32_t latency       = std::max(1u, surfaceTraits.transferLatency);
+    uint32_t transferCount = getFrameCount() + latency;
+    transferCommandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), transferCommandPool, transferCount);
+    transferCompleteSemaphores.resize(transferCount);
+    for (auto& sem : transferCompleteSemaphores)
+      VK_CHECK_LOG_THROW(vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &sem), "Could not create transfer complete semaphore");
+    transferFrameNumbers.assign(transferCount, std::numeric_limits<unsigned long long>::max());
+    uploadBatch->setStreamLatency(latency);
+  }
 
   // create all semaphores required to render a frame
   VK_CHECK_LOG_THROW( vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &imageAvailableSemaphore), "Could not create image available semaphore");
@@ -139,7 +165,10 @@ void Surface::realize()
   VkFenceCreateInfo fenceCreateInfo{};
     fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  waitFences.resize(surfaceTraits.imageCount);
+  waitFences.resize(getFrameCount());
+  waitFrameNumbers.resize(getFrameCount(), 0);
+  frameUpdateStates.resize(getFrameCount(), 0);
+  createOperationUpdateStates();
   for (auto& fence : waitFences)
     VK_CHECK_LOG_THROW(vkCreateFence(vkDevice, &fenceCreateInfo, nullptr, &fence), "Could not create a surface wait fence");
 
@@ -164,14 +193,33 @@ void Surface::cleanup()
       for( auto& frameBuffer : workflowResults->frameBuffers)
         frameBuffer->reset(this);
     }
+    // frame buffers of cached workflow results may also use this surface
+    for (auto& prepared : preparedWorkflowResults)
+    {
+      auto results = prepared.first.lock();
+      if (results == nullptr || results == workflowResults)
+        continue;
+      for (auto& frameBuffer : results->frameBuffers)
+        frameBuffer->reset(this);
+    }
+    preparedWorkflowResults.clear();
 
     for (auto& fence : waitFences)
       vkDestroyFence(dev, fence, nullptr);
+    // surface no longer holds any frame
+    uploadBatch->clear(device.lock().get());
+    device.lock()->retireFrame(surface, std::numeric_limits<unsigned long long>::max());
 
     for (auto sem : renderCompleteSemaphores)
       vkDestroySemaphore(dev, sem, nullptr);
     for (auto sem : frameBufferReadySemaphores)
       vkDestroySemaphore(dev, sem, nullptr);
+    for (auto sem : transferCompleteSemaphores)
+      vkDestroySemaphore(dev, sem, nullptr);
+    transferCompleteSemaphores.clear();
+    transferFrameNumbers.clear();
+    uploadBatch->setStreamLatency(0);
+    destroyQueueSemaphores();
     if(renderFinishedSemaphore != VK_NULL_HANDLE)
       vkDestroySemaphore(dev, renderFinishedSemaphore, nullptr);
     if (imageAvailableSemaphore != VK_NULL_HANDLE)
@@ -179,6 +227,12 @@ void Surface::cleanup()
     primaryCommandBuffers.clear();
     presentCommandBuffer = nullptr;
     prepareCommandBuffer = nullptr;
+    uploadCommandBuffer  = nullptr;
+    transferCommandBuffer = nullptr;
+    transferCommandPool   = nullptr;
+    if (transferQueue != nullptr)
+      device.lock()->releaseQueue(transferQueue);
+    transferQueue = nullptr;
     commandPools.clear();
     for(auto q : queues )
       device.lock()->releaseQueue(q);
@@ -229,6 +283,7 @@ void Surface::createSwapChain()
     swapChainImages.clear();
     vkDestroySwapchainKHR(vkDevice, oldSwapChain, nullptr);
   }
+  swapChainGeneration++;
 
   // collect new swap chain images
   uint32_t imageCount;
@@ -239,14 +294,150 @@ void Surface::createSwapChain()
   for (uint32_t i = 0; i < imageCount; i++)
     swapChainImages.push_back(std::make_shared<Image>(deviceSh.get(), images[i], swapChainDefinition.format, extent, 1, 1));
 
-  prepareCommandBuffer->invalidate(std::numeric_limits<uint32_t>::max());
-  presentCommandBuffer->invalidate(std::numeric_limits<uint32_t>::max());
+  // command buffers using swap chain images are recreated, because number of images may change
+  prepareCommandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPools[workflowResults->presentationQueueIndex], imageCount);
+  presentCommandBuffer = std::make_shared<CommandBuffer>(VK_COMMAND_BUFFER_LEVEL_PRIMARY, deviceSh.get(), commandPools[workflowResults->presentationQueueIndex], imageCount);
+  imageFrameIndices.assign(imageCount, std::numeric_limits<uint32_t>::max());
+  setPrimaryVariantCount();
+}
+
+void Surface::createQueueSemaphores()
+{
+  auto deviceSh = device.lock();
+  destroyQueueSemaphores();
+
+  VkSemaphoreCreateInfo semaphoreCreateInfo{};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  queueSignalSemaphores.resize(queues.size());
+  queueWaitSemaphores.resize(queues.size());
+  queueWaitStages.resize(queues.size());
+  uploadCompleteSemaphores.resize(queues.size(), VK_NULL_HANDLE);
+  for (uint32_t i = 0; i < queues.size(); ++i)
+  {
+    // one semaphore for each pair of dependent queues
+    if (i < workflowResults->queueDependencies.size())
+    {
+      for (const auto& dep : workflowResults->queueDependencies[i])
+      {
+        VkSemaphore semaphore;
+        VK_CHECK_LOG_THROW(vkCreateSemaphore(deviceSh->device, &semaphoreCreateInfo, nullptr, &semaphore), "Could not create queue semaphore");
+        queueSignalSemaphores[dep.first].push_back(semaphore);
+        queueWaitSemaphores[i].push_back(semaphore);
+        queueWaitStages[i].push_back(dep.second);
+      }
+    }
+    // uploads are sent to presentation queue, other queues must wait for them
+    if (i != workflowResults->presentationQueueIndex)
+      VK_CHECK_LOG_THROW(vkCreateSemaphore(deviceSh->device, &semaphoreCreateInfo, nullptr, &uploadCompleteSemaphores[i]), "Could not create upload complete semaphore");
+  }
+}
+
+static uint32_t leastCommonMultiple(uint32_t a, uint32_t b)
+{
+  uint32_t x = a, y = b;
+  while (y != 0)
+  {
+    uint32_t t = x % y;
+    x = y;
+    y = t;
+  }
+  return (a / x) * b;
+}
+
+void Surface::createOperationUpdateStates()
+{
+  // operations are updated in the same pattern every LCM( update periods ) frames. First frame after frame buffers were prepared updates all operations
+  const uint32_t maxPatternLength = 1024;
+  const uint32_t maxUpdateStates  = 16;
+  std::vector<RenderOperation*> rateLimitedOperations;
+  uint32_t patternLength = 1;
+  for (auto& commandSequence : workflowResults->commands)
+  {
+    for (auto& command : commandSequence)
+    {
+      if (!command->operation->isRateLimited())
+        continue;
+      rateLimitedOperations.push_back(command->operation.get());
+      patternLength = std::min(leastCommonMultiple(patternLength, command->operation->updatePeriod), maxPatternLength + 1);
+    }
+  }
+
+  operationUpdateStates.clear();
+  if (patternLength <= maxPatternLength)
+  {
+    std::size_t allUpdatedState = 0;
+    for (uint32_t i = 0; i < rateLimitedOperations.size(); ++i)
+      hash_combine(allUpdatedState, true);
+    operationUpdateStates.push_back(allUpdatedState);
+    for (uint32_t i = 0; i < patternLength && operationUpdateStates.size() <= maxUpdateStates; ++i)
+    {
+      std::size_t operationUpdateState = 0;
+      for (auto operation : rateLimitedOperations)
+        hash_combine(operationUpdateState, (i % operation->updatePeriod) == operation->updatePhase);
+      if (std::find(begin(operationUpdateStates), end(operationUpdateStates), operationUpdateState) == end(operationUpdateStates))
+        operationUpdateStates.push_back(operationUpdateState);
+    }
+    if (operationUpdateStates.size() > maxUpdateStates)
+      operationUpdateStates.clear();
+  }
+  operationUpdateStateIndex = 0;
+  std::fill(begin(frameUpdateStates), end(frameUpdateStates), 0);
+  setPrimaryVariantCount();
+}
+
+void Surface::setPrimaryVariantCount()
+{
+  // primary command buffers refer to frame buffers of swap chain images, so each frame in flight records them for every swap chain image
+  // ( not needed when each swap chain image has its own frame in flight ) and for every update state of rate limited operations
+  uint32_t imageVariantCount = (surfaceTraits.framesInFlight > 0) ? std::max<uint32_t>(swapChainImages.size(), 1) : 1;
+  uint32_t stateVariantCount = std::max<uint32_t>(operationUpdateStates.size(), 1);
+  for (auto& pcb : primaryCommandBuffers)
+    pcb->setVariantCount(imageVariantCount * stateVariantCount);
+}
+
+uint32_t Surface::getPrimaryVariant() const
+{
+  uint32_t imageVariantCount = (surfaceTraits.framesInFlight > 0) ? std::max<uint32_t>(swapChainImages.size(), 1) : 1;
+  return (swapChainImageIndex % imageVariantCount) + imageVariantCount * operationUpdateStateIndex;
+}
+
+void Surface::destroyQueueSemaphores()
+{
+  auto deviceSh = device.lock();
+  if (!uploadCompleteSemaphores.empty())
+    vkDeviceWaitIdle(deviceSh->device);
+  for (auto& semaphores : queueWaitSemaphores)
+    for (auto sem : semaphores)
+      vkDestroySemaphore(deviceSh->device, sem, nullptr);
+  for (auto sem : uploadCompleteSemaphores)
+    if (sem != VK_NULL_HANDLE)
+      vkDestroySemaphore(deviceSh->device, sem, nullptr);
+  queueSignalSemaphores.clear();
+  queueWaitSemaphores.clear();
+  queueWaitStages.clear();
+  uploadCompleteSemaphores.clear();
 }
 
 bool Surface::checkWorkflow()
 {
   auto deviceSh = device.lock();
   renderWorkflow->compile(renderWorkflowCompiler);
+  // operations were enabled or disabled - primary command buffers must skip different operations
+  if (operationStateNumber != renderWorkflow->getOperationStateNumber())
+  {
+    operationStateNumber = renderWorkflow->getOperationStateNumber();
+    for (auto& pcb : primaryCommandBuffers)
+      pcb->invalidate(std::numeric_limits<uint32_t>::max());
+  }
+  // workflow was recompiled, but results came back unchanged from workflow cache ( e.g. only operation node has changed )
+  if (workflowResults.get() == renderWorkflow->workflowResults.get() && workflowCompilationNumber != renderWorkflow->getCompilationNumber())
+  {
+    workflowCompilationNumber = renderWorkflow->getCompilationNumber();
+    for (auto& pcb : primaryCommandBuffers)
+      pcb->invalidate(std::numeric_limits<uint32_t>::max());
+    return false;
+  }
+  workflowCompilationNumber = renderWorkflow->getCompilationNumber();
   if (workflowResults.get() != renderWorkflow->workflowResults.get())
   {
     if (workflowResults != nullptr)
@@ -307,24 +498,86 @@ void Surface::beginFrame()
   }
   VK_CHECK_LOG_THROW(result, "failed vkAcquireNextImageKHR");
 
-  VK_CHECK_LOG_THROW(vkWaitForFences(deviceSh->device, 1, &waitFences[swapChainImageIndex], VK_TRUE, UINT64_MAX), "failed to wait for fence");
-  VK_CHECK_LOG_THROW(vkResetFences(deviceSh->device, 1, &waitFences[swapChainImageIndex]), "failed to reset a fence");
+  // when number of frames in flight is not defined, each swap chain image has its own frame in flight
+  unsigned long long frameNumber = viewer.lock()->getFrameNumber();
+  frameIndex = (surfaceTraits.framesInFlight == 0) ? swapChainImageIndex % getFrameCount() : static_cast<uint32_t>(frameNumber % getFrameCount());
+  VK_CHECK_LOG_THROW(vkWaitForFences(deviceSh->device, 1, &waitFences[frameIndex], VK_TRUE, UINT64_MAX), "failed to wait for fence");
+  VK_CHECK_LOG_THROW(vkResetFences(deviceSh->device, 1, &waitFences[frameIndex]), "failed to reset a fence");
+
+  // swap chain image may still be used by other frame in flight
+  uint32_t imageFrameIndex = imageFrameIndices[swapChainImageIndex];
+  if (imageFrameIndex != frameIndex && imageFrameIndex < waitFences.size())
+    VK_CHECK_LOG_THROW(vkWaitForFences(deviceSh->device, 1, &waitFences[imageFrameIndex], VK_TRUE, UINT64_MAX), "failed to wait for fence");
+  imageFrameIndices[swapChainImageIndex] = frameIndex;
+
+  // resolution scale is recorded in render areas of primary command buffers
+  float renderScale = getRenderResolutionScale();
+  if (renderScale != renderedResolutionScale)
+  {
+    for (auto& pcb : primaryCommandBuffers)
+      pcb->invalidate(std::numeric_limits<uint32_t>::max());
+    renderedResolutionScale = renderScale;
+  }
+
+  // frame that previously used this frame in flight is finished - memory allocated for it may be reused
+  deviceSh->retireFrame(surface, waitFrameNumbers[frameIndex]);
+  waitFrameNumbers[frameIndex] = frameNumber;
+  deviceSh->beginFrame(waitFrameNumbers[frameIndex]);
 }
 
 void Surface::validateWorkflow()
 {
   RenderContext renderContext(this, workflowResults->presentationQueueIndex);
-  if (checkWorkflow() || resized)
+  updateAllOperations  = false;
+  bool workflowChanged = checkWorkflow();
+  // new workflow may synchronize its queues differently and may have different rate limited operations.
+  // Device is idle after the semaphores are recreated, so primary command buffers may be reallocated
+  if (workflowChanged)
   {
-    for (auto& frameBuffer : workflowResults->frameBuffers)
+    createQueueSemaphores();
+    createOperationUpdateStates();
+  }
+  if (workflowChanged || resized)
+  {
+    preparedWorkflowResults.erase(std::remove_if(begin(preparedWorkflowResults), end(preparedWorkflowResults), [](const std::pair<std::weak_ptr<RenderWorkflowResults>, uint32_t>& p) { return p.first.expired(); }), end(preparedWorkflowResults));
+    auto pit = std::find_if(begin(preparedWorkflowResults), end(preparedWorkflowResults), [this](const std::pair<std::weak_ptr<RenderWorkflowResults>, uint32_t>& p) { return p.first.lock() == workflowResults; });
+    if (pit == end(preparedWorkflowResults))
+      pit = preparedWorkflowResults.insert(end(preparedWorkflowResults), { workflowResults, std::numeric_limits<uint32_t>::max() });
+    if (pit->second != swapChainGeneration)
     {
-      frameBuffer->prepareMemoryImages(renderContext, swapChainImages);
-      frameBuffer->invalidate(renderContext);
+      for (auto& frameBuffer : workflowResults->frameBuffers)
+      {
+        frameBuffer->prepareMemoryImages(renderContext, swapChainImages);
+        frameBuffer->invalidate(renderContext);
+      }
+      pit->second         = swapChainGeneration;
+      updateAllOperations = true;
     }
   }
   for (auto& frameBuffer : workflowResults->frameBuffers)
     frameBuffer->validate(renderContext);
 
+  // each set of rate limited operations performed in a frame has its own variant of primary command buffers
+  std::size_t operationUpdateState = 0;
+  for (auto& commandSequence : workflowResults->commands)
+    for (auto& command : commandSequence)
+      if (command->operation->isRateLimited())
+        hash_combine(operationUpdateState, isOperationUpdated(command->operation.get()));
+  auto sit = std::find(begin(operationUpdateStates), end(operationUpdateStates), operationUpdateState);
+  if (sit != end(operationUpdateStates))
+    operationUpdateStateIndex = std::distance(begin(operationUpdateStates), sit);
+  else
+  {
+    // too many update states - primary command buffer of current frame must be built again when it performs different set of rate limited operations than before
+    operationUpdateStateIndex = 0;
+    if (frameUpdateStates[frameIndex] != operationUpdateState)
+    {
+      for (auto& pcb : primaryCommandBuffers)
+        pcb->invalidate(frameIndex);
+      frameUpdateStates[frameIndex] = operationUpdateState;
+    }
+  }
+
   // create/update render passes and compute passes for current surface
   for (auto& command : workflowResults->commands[workflowResults->presentationQueueIndex])
     command->validate(renderContext);
@@ -422,14 +675,14 @@ void Surface::validateWorkflow()
 void Surface::setCommandBufferIndices()
 {
   for (uint32_t i = 0; i < primaryCommandBuffers.size(); ++i)
-    primaryCommandBuffers[i]->setActiveIndex(swapChainImageIndex);
+    primaryCommandBuffers[i]->setActiveIndex(frameIndex, getPrimaryVariant());
 
   RenderContext renderContext(this, workflowResults->presentationQueueIndex);
   for (uint32_t i = 0; i < secondaryCommandBufferNodes.size(); ++i)
   {
     auto commandBuffer = secondaryCommandBufferNodes[i]->getSecondaryBuffer(renderContext);
     CHECK_LOG_THROW(commandBuffer == nullptr, "Secondary buffer not defined for node " << secondaryCommandBufferNodes[i]->getName());
-    commandBuffer->setActiveIndex(swapChainImageIndex);
+    commandBuffer->setActiveIndex(frameIndex);
   }
 }
 
@@ -452,7 +705,7 @@ void Surface::validatePrimaryDescriptors(uint32_t queueNumber)
 void Surface::buildPrimaryCommandBuffer(uint32_t queueNumber)
 {
   RenderContext renderContext(this, workflowResults->presentationQueueIndex);
-  primaryCommandBuffers[queueNumber]->setActiveIndex(swapChainImageIndex);
+  primaryCommandBuffers[queueNumber]->setActiveIndex(frameIndex, getPrimaryVariant());
   if (!primaryCommandBuffers[queueNumber]->isValid())
   {
     BuildCommandBufferVisitor cbVisitor(renderContext, primaryCommandBuffers[queueNumber].get(), true);
@@ -525,7 +778,7 @@ void Surface::buildSecondaryCommandBuffers()
           RenderContext renderContext(this, workflowResults->presentationQueueIndex);
           auto commandBuffer = secondaryCommandBufferNodes[i]->getSecondaryBuffer(renderContext);
           CHECK_LOG_THROW(commandBuffer == nullptr, "Secondary buffer not defined for node " << secondaryCommandBufferNodes[i]->getName());
-          commandBuffer->setActiveIndex(swapChainImageIndex);
+          commandBuffer->setActiveIndex(frameIndex);
           if (!commandBuffer->isValid())
           {
             // The problem is that above defined render context needs to use elements defined up the tree ( currentPipelineLayout, currentAssetBuffer and currentRenderMask )
@@ -551,12 +804,77 @@ void Surface::buildSecondaryCommandBuffers()
 
 void Surface::draw()
 {
+  // data written to non coherent memory must be visible to the device before submission
+  auto deviceSh = device.lock();
+  deviceSh->flushMappedMemory();
+
+  // streamed uploads are sent to the transfer queue ( if surface has one ). Their data is used transferLatency frames later : upload command buffer
+  // of that frame waits for the transfer and acquires ownership of written resources, so the transfer runs in parallel with rendering of the frames in between
+  std::vector<VkSemaphore>          uploadWaitSemaphores;
+  std::vector<VkPipelineStageFlags> uploadWaitStages;
+  if (transferQueue != nullptr)
+  {
+    unsigned long long frameNumber = waitFrameNumbers[frameIndex];
+    for (uint32_t i = 0; i < transferFrameNumbers.size(); ++i)
+    {
+      if (transferFrameNumbers[i] == std::numeric_limits<unsigned long long>::max() || transferFrameNumbers[i] + uploadBatch->getStreamLatency() > frameNumber)
+        continue;
+      uploadWaitSemaphores.push_back(transferCompleteSemaphores[i]);
+      uploadWaitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+      transferFrameNumbers[i] = std::numeric_limits<unsigned long long>::max();
+    }
+    if (uploadBatch->hasStreamedUploads())
+    {
+      uint32_t transferIndex = frameNumber % transferCompleteSemaphores.size();
+      transferCommandBuffer->setActiveIndex(transferIndex);
+      transferCommandBuffer->cmdBegin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+      uploadBatch->recordStreamed(deviceSh.get(), transferCommandBuffer.get(), frameNumber, transferQueue->familyIndex, queues[workflowResults->presentationQueueIndex]->familyIndex);
+      transferCommandBuffer->cmdEnd();
+      transferCommandBuffer->queueSubmit(transferQueue->queue, {}, {}, { transferCompleteSemaphores[transferIndex] }, VK_NULL_HANDLE);
+      transferFrameNumbers[transferIndex] = frameNumber;
+    }
+  }
+
+  // all remaining uploads gathered during validation go first. Queue ordering and barriers recorded by UploadBatch make them visible to the frame
+  uploadCommandBuffer->setActiveIndex(frameIndex);
+  bool uploadSubmitted = false;
+  if (!uploadBatch->isEmpty() || !uploadWaitSemaphores.empty())
+  {
+    std::vector<VkSemaphore> uploadSignalSemaphores;
+    for (auto sem : uploadCompleteSemaphores)
+      if (sem != VK_NULL_HANDLE)
+        uploadSignalSemaphores.push_back(sem);
+    uploadCommandBuffer->cmdBegin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    uploadBatch->record(deviceSh.get(), uploadCommandBuffer.get(), waitFrameNumbers[frameIndex]);
+    uploadCommandBuffer->cmdEnd();
+    uploadCommandBuffer->queueSubmit(queues[workflowResults->presentationQueueIndex]->queue, uploadWaitSemaphores, uploadWaitStages, uploadSignalSemaphores, VK_NULL_HANDLE);
+    uploadSubmitted = true;
+  }
+
   prepareCommandBuffer->queueSubmit(queues[workflowResults->presentationQueueIndex]->queue, { imageAvailableSemaphore }, { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT }, frameBufferReadySemaphores, VK_NULL_HANDLE );
 
-  for (uint32_t i = 0; i < queues.size(); ++i)
+  // queues are submitted in order that ensures that each semaphore is signaled before someone waits for it
+  std::vector<uint32_t> submissionOrder = workflowResults->queueSubmissionOrder;
+  if (submissionOrder.size() != queues.size())
   {
-    // submit command buffer to each queue with a semaphore signaling ent of work (renderCompleteSemaphores[i])
-    primaryCommandBuffers[i]->queueSubmit(queues[i]->queue, { frameBufferReadySemaphores[i] }, { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT }, { renderCompleteSemaphores[i] }, VK_NULL_HANDLE);
+    submissionOrder.resize(queues.size());
+    std::iota(begin(submissionOrder), end(submissionOrder), 0);
+  }
+  for (auto i : submissionOrder)
+  {
+    std::vector<VkSemaphore>          waitSemaphores{ frameBufferReadySemaphores[i] };
+    std::vector<VkPipelineStageFlags> waitStages{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
+    waitSemaphores.insert(end(waitSemaphores), begin(queueWaitSemaphores[i]), end(queueWaitSemaphores[i]));
+    waitStages.insert(end(waitStages), begin(queueWaitStages[i]), end(queueWaitStages[i]));
+    if (uploadSubmitted && uploadCompleteSemaphores[i] != VK_NULL_HANDLE)
+    {
+      waitSemaphores.push_back(uploadCompleteSemaphores[i]);
+      waitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    }
+    std::vector<VkSemaphore> signalSemaphores{ renderCompleteSemaphores[i] };
+    signalSemaphores.insert(end(signalSemaphores), begin(queueSignalSemaphores[i]), end(queueSignalSemaphores[i]));
+    // submit command buffer to each queue with a semaphore signaling end of work (renderCompleteSemaphores[i])
+    primaryCommandBuffers[i]->queueSubmit(queues[i]->queue, waitSemaphores, waitStages, signalSemaphores, VK_NULL_HANDLE);
   }
 }
 
@@ -565,7 +883,7 @@ void Surface::endFrame()
   // wait for all queues to finish work ( using renderCompleteSemaphores ), then submit command buffer converting output image to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR layout
   std::vector<VkPipelineStageFlags> waitStages;
   waitStages.resize(renderCompleteSemaphores.size(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-  presentCommandBuffer->queueSubmit(queues[workflowResults->presentationQueueIndex]->queue, renderCompleteSemaphores, waitStages, { renderFinishedSemaphore }, waitFences[swapChainImageIndex]);
+  presentCommandBuffer->queueSubmit(queues[workflowResults->presentationQueueIndex]->queue, renderCompleteSemaphores, waitStages, { renderFinishedSemaphore }, waitFences[frameIndex]);
 
   // present output image when its layout is transformed into VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
   VkPresentInfoKHR presentInfo{};
@@ -592,6 +910,62 @@ void Surface::resizeSurface(uint32_t newWidth, uint32_t newHeight)
   }
 }
 
+void Surface::setDynamicResolution(bool enabled, double tft, float minScale, float maxScale)
+{
+  CHECK_LOG_THROW(minScale <= 0.0f || minScale > maxScale || maxScale > 1.0f, "Wrong resolution scale range : " << minScale << " - " << maxScale << " ( attachments are not bigger than the surface )");
+  dynamicResolution      = enabled;
+  targetFrameTime        = tft;
+  minResolutionScale     = minScale;
+  maxResolutionScale     = maxScale;
+  averageFrameTime       = 0.0;
+  framesSinceScaleChange = 0;
+  // new scale reaches frames when update thread starts next frame
+  resolutionScale        = enabled ? std::min(std::max(resolutionScale, minResolutionScale), maxResolutionScale) : 1.0f;
+}
+
+float Surface::getResolutionScale() const
+{
+  return frameResolutionScales[viewer.lock()->getUpdateIndex()];
+}
+
+float Surface::getRenderResolutionScale() const
+{
+  return frameResolutionScales[viewer.lock()->getRenderIndex()];
+}
+
+void Surface::updateResolutionScale(double renderTime)
+{
+  // scale changes in steps, because each change rebuilds primary command buffers
+  const float    scaleStep      = 0.05f;
+  const uint32_t framesToSettle = 8;
+  if (!dynamicResolution || renderTime <= 0.0)
+    return;
+  // moving average hides single frame spikes
+  averageFrameTime = (averageFrameTime > 0.0) ? 0.9 * averageFrameTime + 0.1 * renderTime : renderTime;
+  if (++framesSinceScaleChange < framesToSettle)
+    return;
+  // number of rendered pixels grows with the square of the scale
+  float desiredScale = resolutionScale * static_cast<float>(std::sqrt(targetFrameTime / averageFrameTime));
+  desiredScale       = std::min(std::max(std::round(desiredScale / scaleStep) * scaleStep, minResolutionScale), maxResolutionScale);
+  if (std::abs(desiredScale - resolutionScale) < 0.5f * scaleStep)
+    return;
+  resolutionScale        = desiredScale;
+  averageFrameTime       = 0.0;
+  framesSinceScaleChange = 0;
+}
+
+void Surface::storeResolutionScale(uint32_t updateIndex)
+{
+  frameResolutionScales[updateIndex] = resolutionScale;
+}
+
+bool Surface::isOperationUpdated(const RenderOperation* operation) const
+{
+  if (!operation->isRateLimited() || updateAllOperations)
+    return true;
+  return (waitFrameNumbers[frameIndex] % operation->updatePeriod) == operation->updatePhase;
+}
+
 void Surface::setRenderWorkflow(std::shared_ptr<RenderWorkflow> workflow, std::shared_ptr<RenderWorkflowCompiler> compiler)
 {
   renderWorkflow         = workflow;
@@ -186,7 +186,7 @@ void Text::cmdDraw(const RenderContext& renderContext, CommandBuffer* commandBuf
 
   commandBuffer->addSource(this);
   VkBuffer     vBuffer = vertexBuffer->getHandleBuffer(renderContext);
-  VkDeviceSize offsets = 0;
+  VkDeviceSize offsets = vertexBuffer->getBufferOffset(renderContext);
   vkCmdBindVertexBuffers(commandBuffer->getHandle(), 0, 1, &vBuffer, &offsets);
   commandBuffer->cmdDraw(sit->second->size(), 1, 0, 0, 0);
 }
@@ -0,0 +1,301 @@
+//
+// Copyright(c) 2017-2018 Paweł Księżopolski ( pumexx )
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <pumex/UploadBatch.h>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <pumex/Device.h>
+#include <pumex/Image.h>
+#include <pumex/Command.h>
+#include <pumex/utils/Buffer.h>
+
+using namespace pumex;
+
+void UploadBatch::addBufferUpload(std::shared_ptr<StagingBuffer> stagingBuffer, VkBuffer dstBuffer, const VkBufferCopy& region, bool streamed)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  bufferUploads.push_back({ stagingBuffer, stagingBuffer->buffer, dstBuffer, region, streamed });
+}
+
+void UploadBatch::addImageUpload(std::shared_ptr<StagingBuffer> stagingBuffer, std::shared_ptr<Image> dstImage, VkImageAspectFlags aspectMask, const std::vector<VkBufferImageCopy>& regions, bool streamed)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  imageUploads.push_back({ stagingBuffer, dstImage, aspectMask, regions, streamed });
+}
+
+void UploadBatch::addBufferCopy(VkBuffer srcBuffer, VkBuffer dstBuffer, const VkBufferCopy& region)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  bufferUploads.push_back({ nullptr, srcBuffer, dstBuffer, region, false });
+}
+
+void UploadBatch::addImageCopy(std::shared_ptr<Image> srcImage, std::shared_ptr<Image> dstImage, VkImageAspectFlags aspectMask, const std::vector<VkImageCopy>& regions)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  imageCopies.push_back({ srcImage, dstImage, aspectMask, regions });
+}
+
+void UploadBatch::cancelBufferUploads(Device* device, VkBuffer buffer)
+{
+  std::vector<BufferUpload> buffers;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto bit = std::stable_partition(begin(bufferUploads), end(bufferUploads), [buffer](const BufferUpload& bu) { return bu.dstBuffer != buffer && bu.srcBuffer != buffer; });
+    buffers.assign(bit, end(bufferUploads));
+    bufferUploads.erase(bit, end(bufferUploads));
+  }
+  // staging ring reclaims memory in order, so cancelled uploads must release their staging memory too
+  for (auto& bu : buffers)
+  {
+    if (bu.stagingBuffer != nullptr)
+      device->releaseStagingBuffer(bu.stagingBuffer);
+  }
+}
+
+bool UploadBatch::hasImageUploads(VkImage image) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return std::any_of(begin(imageUploads), end(imageUploads), [image](const ImageUpload& iu) { return iu.dstImage->getHandleImage() == image; }) ||
+    std::any_of(begin(imageCopies), end(imageCopies), [image](const ImageCopy& ic) { return ic.dstImage->getHandleImage() == image; });
+}
+
+bool UploadBatch::isEmpty() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return bufferUploads.empty() && imageUploads.empty() && imageCopies.empty();
+}
+
+bool UploadBatch::hasStreamedUploads() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return std::any_of(begin(bufferUploads), end(bufferUploads), [](const BufferUpload& bu) { return bu.streamed; }) ||
+    std::any_of(begin(imageUploads), end(imageUploads), [](const ImageUpload& iu) { return iu.streamed; });
+}
+
+bool UploadBatch::recordStreamed(Device* device, CommandBuffer* commandBuffer, unsigned long long frameNumber, uint32_t transferFamilyIndex, uint32_t dstFamilyIndex)
+{
+  std::vector<BufferUpload> buffers;
+  std::vector<ImageUpload>  images;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto bit = std::stable_partition(begin(bufferUploads), end(bufferUploads), [](const BufferUpload& bu) { return !bu.streamed; });
+    buffers.assign(bit, end(bufferUploads));
+    bufferUploads.erase(bit, end(bufferUploads));
+    auto iit = std::stable_partition(begin(imageUploads), end(imageUploads), [](const ImageUpload& iu) { return !iu.streamed; });
+    images.assign(iit, end(imageUploads));
+    imageUploads.erase(iit, end(imageUploads));
+  }
+  // data is used by the frame streamLatency frames later, so staging memory must live until that frame is finished.
+  // Queues from the same family need no ownership transfer
+  if (transferFamilyIndex == dstFamilyIndex)
+    return recordUploads(device, commandBuffer, frameNumber + streamLatency, buffers, images, std::vector<ImageCopy>(), VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+  return recordUploads(device, commandBuffer, frameNumber + streamLatency, buffers, images, std::vector<ImageCopy>(), transferFamilyIndex, dstFamilyIndex);
+}
+
+bool UploadBatch::record(Device* device, CommandBuffer* commandBuffer, unsigned long long frameNumber)
+{
+  std::vector<BufferUpload>    buffers;
+  std::vector<ImageUpload>     images;
+  std::vector<ImageCopy>       copies;
+  std::vector<PipelineBarrier> acquires;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.swap(bufferUploads);
+    images.swap(imageUploads);
+    copies.swap(imageCopies);
+    auto ait = acquireBarriers.upper_bound(frameNumber);
+    for (auto it = begin(acquireBarriers); it != ait; ++it)
+      acquires.insert(end(acquires), begin(it->second), end(it->second));
+    acquireBarriers.erase(begin(acquireBarriers), ait);
+  }
+  // resources written on transfer queue streamLatency frames ago are acquired first. Semaphore waited by commandBuffer submission orders them after the transfer
+  if (!acquires.empty())
+    commandBuffer->cmdPipelineBarrier(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, acquires);
+  bool uploadsRecorded = recordUploads(device, commandBuffer, frameNumber, buffers, images, copies, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+  return uploadsRecorded || !acquires.empty();
+}
+
+bool UploadBatch::recordUploads(Device* device, CommandBuffer* commandBuffer, unsigned long long frameNumber, const std::vector<BufferUpload>& buffers, const std::vector<ImageUpload>& images, const std::vector<ImageCopy>& copies, uint32_t srcFamilyIndex, uint32_t dstFamilyIndex)
+{
+  if (buffers.empty() && images.empty() && copies.empty())
+    return false;
+
+  // copies writing to the same memory must be ordered : every copy is placed in a wave following the waves of all previous copies it overlaps with.
+  // Waves are separated by barriers. Usually all copies fit into first wave
+  uint32_t waveCount = 1;
+  std::vector<uint32_t> bufferWaves(buffers.size(), 0);
+  std::unordered_map<VkBuffer, std::vector<size_t>> previousBufferUploads;
+  for (size_t i = 0; i < buffers.size(); ++i)
+  {
+    // copy of relocated buffer must also read the data uploaded to the old buffer before
+    if (buffers[i].stagingBuffer == nullptr)
+    {
+      auto sit = previousBufferUploads.find(buffers[i].srcBuffer);
+      if (sit != end(previousBufferUploads))
+      {
+        for (auto j : sit->second)
+        {
+          if (buffers[j].region.dstOffset < buffers[i].region.srcOffset + buffers[i].region.size && buffers[i].region.srcOffset < buffers[j].region.dstOffset + buffers[j].region.size)
+            bufferWaves[i] = std::max(bufferWaves[i], bufferWaves[j] + 1);
+        }
+      }
+    }
+    auto& previous = previousBufferUploads[buffers[i].dstBuffer];
+    for (auto j : previous)
+    {
+      if (buffers[j].region.dstOffset < buffers[i].region.dstOffset + buffers[i].region.size && buffers[i].region.dstOffset < buffers[j].region.dstOffset + buffers[j].region.size)
+        bufferWaves[i] = std::max(bufferWaves[i], bufferWaves[j] + 1);
+    }
+    previous.push_back(i);
+    waveCount = std::max(waveCount, bufferWaves[i] + 1);
+  }
+  std::vector<uint32_t> imageWaves(images.size(), 0);
+  std::unordered_map<VkImage, uint32_t> imageUploadCount;
+  // relocated images are new, so their copies go first. Images with pending uploads are not relocated ( see hasImageUploads() )
+  for (const auto& ic : copies)
+    imageUploadCount[ic.dstImage->getHandleImage()]++;
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    imageWaves[i] = imageUploadCount[images[i].dstImage->getHandleImage()]++;
+    waveCount     = std::max(waveCount, imageWaves[i] + 1);
+  }
+
+  // all image layouts are changed before copying. Memory may still be read by previous frames, so copies wait for all earlier commands.
+  // Copies of relocated data read memory written by earlier commands
+  bool hasCopies = !copies.empty() || std::any_of(begin(buffers), end(buffers), [](const BufferUpload& bu) { return bu.stagingBuffer == nullptr; });
+  std::vector<PipelineBarrier> barriers;
+  barriers.emplace_back(PipelineBarrier(hasCopies ? VK_ACCESS_MEMORY_WRITE_BIT : 0, hasCopies ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT));
+  for (const auto& ic : copies)
+  {
+    const ImageTraits& traits = ic.dstImage->getImageTraits();
+    VkImageSubresourceRange range{ ic.aspectMask, 0, traits.mipLevels, 0, traits.arrayLayers };
+    barriers.emplace_back(PipelineBarrier(0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, ic.dstImage->getHandleImage(), range, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+  }
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    if (imageWaves[i] > 0)
+      continue;
+    const ImageTraits& traits = images[i].dstImage->getImageTraits();
+    VkImageSubresourceRange range{ images[i].aspectMask, 0, traits.mipLevels, 0, traits.arrayLayers };
+    barriers.emplace_back(PipelineBarrier(0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, images[i].dstImage->getHandleImage(), range, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+  }
+  commandBuffer->cmdPipelineBarrier(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, barriers);
+
+  for (uint32_t wave = 0; wave < waveCount; ++wave)
+  {
+    if (wave > 0)
+      commandBuffer->cmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, PipelineBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT));
+
+    // copies between the same pair of buffers are sent in one call
+    std::map<std::pair<VkBuffer, VkBuffer>, std::vector<VkBufferCopy>> bufferCopies;
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+      if (bufferWaves[i] == wave)
+        bufferCopies[std::make_pair(buffers[i].srcBuffer, buffers[i].dstBuffer)].push_back(buffers[i].region);
+    }
+    for (auto& bc : bufferCopies)
+      commandBuffer->cmdCopyBuffer(bc.first.first, bc.first.second, bc.second);
+
+    if (wave == 0)
+    {
+      for (const auto& ic : copies)
+        commandBuffer->cmdCopyImage(*(ic.srcImage), VK_IMAGE_LAYOUT_GENERAL, *(ic.dstImage), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, ic.regions);
+    }
+
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+      if (imageWaves[i] == wave)
+        commandBuffer->cmdCopyBufferToImage(images[i].stagingBuffer->buffer, *(images[i].dstImage), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, images[i].regions);
+    }
+  }
+
+  // uploaded data is made visible to all commands that follow, images are left in VK_IMAGE_LAYOUT_GENERAL.
+  // When data is uploaded on a queue from other family, the barriers release ownership and the same barriers acquire it later on destination queue
+  bool ownershipTransfer    = (srcFamilyIndex != dstFamilyIndex);
+  VkAccessFlags dstAccess   = ownershipTransfer ? 0 : VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+  std::vector<PipelineBarrier> acquires;
+  barriers.clear();
+  std::vector<VkBuffer> dstBuffers;
+  for (const auto& bu : buffers)
+  {
+    if (std::find(begin(dstBuffers), end(dstBuffers), bu.dstBuffer) != end(dstBuffers))
+      continue;
+    dstBuffers.push_back(bu.dstBuffer);
+    barriers.emplace_back(PipelineBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, dstAccess, srcFamilyIndex, dstFamilyIndex, bu.dstBuffer, 0, VK_WHOLE_SIZE));
+    if (ownershipTransfer)
+      acquires.emplace_back(PipelineBarrier(0, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, srcFamilyIndex, dstFamilyIndex, bu.dstBuffer, 0, VK_WHOLE_SIZE));
+  }
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    if (imageWaves[i] > 0)
+      continue;
+    const ImageTraits& traits = images[i].dstImage->getImageTraits();
+    VkImageSubresourceRange range{ images[i].aspectMask, 0, traits.mipLevels, 0, traits.arrayLayers };
+    barriers.emplace_back(PipelineBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, dstAccess, srcFamilyIndex, dstFamilyIndex, images[i].dstImage->getHandleImage(), range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL));
+    if (ownershipTransfer)
+      acquires.emplace_back(PipelineBarrier(0, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, srcFamilyIndex, dstFamilyIndex, images[i].dstImage->getHandleImage(), range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL));
+  }
+  for (const auto& ic : copies)
+  {
+    const ImageTraits& traits = ic.dstImage->getImageTraits();
+    VkImageSubresourceRange range{ ic.aspectMask, 0, traits.mipLevels, 0, traits.arrayLayers };
+    barriers.emplace_back(PipelineBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, dstAccess, srcFamilyIndex, dstFamilyIndex, ic.dstImage->getHandleImage(), range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL));
+  }
+  commandBuffer->cmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, ownershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, barriers);
+  if (ownershipTransfer)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& frameAcquires = acquireBarriers[frameNumber];
+    frameAcquires.insert(end(frameAcquires), begin(acquires), end(acquires));
+  }
+
+  // staging memory is reused when frame is retired
+  for (auto& bu : buffers)
+  {
+    if (bu.stagingBuffer != nullptr)
+      device->releaseStagingBuffer(bu.stagingBuffer, frameNumber);
+  }
+  for (auto& iu : images)
+    device->releaseStagingBuffer(iu.stagingBuffer, frameNumber);
+  return true;
+}
+
+void UploadBatch::clear(Device* device)
+{
+  std::vector<BufferUpload> buffers;
+  std::vector<ImageUpload>  images;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.swap(bufferUploads);
+    images.swap(imageUploads);
+    imageCopies.clear();
+    acquireBarriers.clear();
+  }
+  for (auto& bu : buffers)
+  {
+    if (bu.stagingBuffer != nullptr)
+      device->releaseStagingBuffer(bu.stagingBuffer);
+  }
+  for (auto& iu : images)
+    device->releaseStagingBuffer(iu.stagingBuffer);
+}
@@ -228,6 +228,13 @@ void Viewer::run()
       auto prevRenderStartTime = renderStartTime;
       {
         std::lock_guard<std::mutex> lck(updateMutex);
+        // resolution scale follows the duration of previous render ( the same value is stored in TSV_CHANNEL_RENDER statistics ).
+        // New scale must be set before update thread starts next frame
+        if (frameNumber > 0)
+        {
+          for (auto& it : surfaces)
+            it.second->updateResolutionScale(inSeconds(renderDuration));
+        }
         renderIndex      = getNextRenderSlot();
         renderStartTime  = HPClock::now();
         updateConditionVariable.notify_one();
@@ -258,10 +265,10 @@ void Viewer::run()
         updateConditionVariable.notify_one();
       }
 
+      renderDuration = HPClock::now() - renderStartTime;
       if (timeStatistics->hasFlags(TSV_STAT_RENDER))
       {
-        auto renderEndTime = HPClock::now();
-        timeStatistics->setValues(TSV_CHANNEL_RENDER, inSeconds(renderStartTime - viewerStartTime), inSeconds(renderEndTime - renderStartTime));
+        timeStatistics->setValues(TSV_CHANNEL_RENDER, inSeconds(renderStartTime - viewerStartTime), inSeconds(renderDuration));
         timeStatistics->setValues(TSV_CHANNEL_FRAME, inSeconds(prevRenderStartTime - viewerStartTime), inSeconds(renderStartTime - prevRenderStartTime));
       }
 
@@ -285,6 +292,9 @@ void Viewer::run()
       updateIndex              = getNextUpdateSlot();
       updateInProgress         = true;
       updateTimes[updateIndex] = updateTimes[prevUpdateIndex] + getUpdateDuration();
+      // update and render of this frame use the same resolution scale
+      for (auto& it : surfaces)
+        it.second->storeResolutionScale(updateIndex);
     }
     //switch (updateIndex)
     //{
@@ -388,6 +398,8 @@ void Viewer::realize()
     auto device = s.second->device.lock();
     for (auto& qt : s.second->renderWorkflow->getQueueTraits())
       device->addRequestedQueue(qt);
+    if (s.second->surfaceTraits.useTransferQueue)
+      device->addRequestedQueue(s.second->surfaceTraits.transferQueueTraits);
   }
   for (auto& d : devices)
     d.second->realize();
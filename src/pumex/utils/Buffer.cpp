@@ -23,6 +23,7 @@
 #include <pumex/utils/Buffer.h>
 #include <algorithm>
 #include <cstring>
+#include <limits>
 #include <pumex/Device.h>
 #include <pumex/PhysicalDevice.h>
 #include <pumex/utils/Log.h>
@@ -141,31 +142,129 @@ StagingBuffer::StagingBuffer(Device* d, VkDeviceSize s)
 {
   memorySize = createBuffer(d, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, s, &buffer, &memory);
   CHECK_LOG_THROW(memorySize == 0, "Cannot create staging buffer");
+  VK_CHECK_LOG_THROW(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mappedPointer), "Cannot map memory");
+}
+
+StagingBuffer::StagingBuffer(VkBuffer b, VkDeviceSize o, VkDeviceSize s, void* mp)
+  : buffer{ b }, memorySize{ s }, offset{ o }, mappedPointer{ mp }
+{
 }
 
 StagingBuffer::~StagingBuffer()
 {
-  destroyBuffer(device, buffer, memory);
+  // ranges of StagingRing own no Vulkan objects
+  if (memory != VK_NULL_HANDLE)
+    destroyBuffer(device, buffer, memory);
 }
 
 void StagingBuffer::fillBuffer(const void* data, VkDeviceSize size)
 {
-  void *mapAddress;
-  VK_CHECK_LOG_THROW(vkMapMemory(device, memory, 0, size, 0, &mapAddress), "Cannot map memory");
-  std::memcpy(mapAddress, data, size);
-  vkUnmapMemory(device, memory);
+  CHECK_LOG_THROW(size > memorySize, "Staging buffer is too small : " << memorySize << " < " << size);
+  std::memcpy(mappedPointer, data, size);
 }
 
 void* StagingBuffer::mapMemory(VkDeviceSize size)
 {
-  void *mapAddress;
-  VK_CHECK_LOG_THROW(vkMapMemory(device, memory, 0, size, 0, &mapAddress), "Cannot map memory");
-  return mapAddress;
+  CHECK_LOG_THROW(size > memorySize, "Staging buffer is too small : " << memorySize << " < " << size);
+  return mappedPointer;
 }
 
 void StagingBuffer::unmapMemory()
 {
-  vkUnmapMemory(device, memory);
+  // memory is persistently mapped and coherent - nothing to do here
+}
+
+StagingRing::StagingRing(Device* d, VkDeviceSize b)
+  : device{ d->device }, budget{ b }
+{
+  alignment = std::max<VkDeviceSize>(alignment, d->physical.lock()->properties.limits.optimalBufferCopyOffsetAlignment);
+  VkDeviceSize memorySize = createBuffer(d, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, budget, &buffer, &memory);
+  CHECK_LOG_THROW(memorySize == 0, "Cannot create staging ring");
+  void* mapAddress;
+  VK_CHECK_LOG_THROW(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapAddress), "Cannot map memory");
+  mappedPointer = static_cast<unsigned char*>(mapAddress);
+}
+
+StagingRing::~StagingRing()
+{
+  ranges.clear();
+  dedicatedBuffers.clear();
+  destroyBuffer(device, buffer, memory);
+}
+
+std::shared_ptr<StagingBuffer> StagingRing::acquire(Device* d, VkDeviceSize size, VkDeviceSize requiredAlignment)
+{
+  reclaim();
+
+  // offset must be a multiple of ring alignment and alignment required by the caller ( e.g. texel block size )
+  requiredAlignment = std::max<VkDeviceSize>(1, requiredAlignment);
+  VkDeviceSize rangeAlignment = alignment;
+  while (rangeAlignment % requiredAlignment != 0)
+    rangeAlignment += alignment;
+  size = std::max<VkDeviceSize>(1, size);
+
+  VkDeviceSize offset = std::numeric_limits<VkDeviceSize>::max();
+  if (size <= budget)
+  {
+    // when head is not behind tail, free memory is at the end and at the beginning of the ring. Otherwise it lies between head and tail
+    bool         wrapped     = !ranges.empty() && head <= tail;
+    VkDeviceSize alignedHead = ((head + rangeAlignment - 1) / rangeAlignment) * rangeAlignment;
+    if (!wrapped)
+    {
+      if (alignedHead + size <= budget)
+        offset = alignedHead;
+      else if (size <= tail)
+        offset = 0;
+    }
+    else if (alignedHead + size <= tail)
+      offset = alignedHead;
+  }
+  // upload is bigger than the budget or there's no room left in the ring - data goes through dedicated buffer
+  if (offset == std::numeric_limits<VkDeviceSize>::max())
+    return std::make_shared<StagingBuffer>(d, size);
+
+  auto result = std::make_shared<StagingBuffer>(buffer, offset, size, mappedPointer + offset);
+  ranges.emplace_back(result, offset + size);
+  head = offset + size;
+  return result;
+}
+
+void StagingRing::release(std::shared_ptr<StagingBuffer> stagingBuffer, unsigned long long frameNumber)
+{
+  if (stagingBuffer->isDedicated())
+  {
+    if (frameNumber > retiredFrame)
+    {
+      dedicatedBuffers.emplace_back(stagingBuffer, 0);
+      dedicatedBuffers.back().released    = true;
+      dedicatedBuffers.back().frameNumber = frameNumber;
+    }
+    return;
+  }
+  auto it = std::find_if(begin(ranges), end(ranges), [&stagingBuffer](const Range& r) { return r.buffer == stagingBuffer; });
+  CHECK_LOG_THROW(it == end(ranges), "Staging buffer does not belong to staging ring");
+  it->released    = true;
+  it->frameNumber = frameNumber;
+  reclaim();
+}
+
+void StagingRing::retireFrame(unsigned long long frameNumber)
+{
+  retiredFrame = frameNumber;
+  reclaim();
+}
+
+void StagingRing::reclaim()
+{
+  while (!ranges.empty() && ranges.front().released && ranges.front().frameNumber <= retiredFrame)
+  {
+    tail = ranges.front().rangeEnd;
+    ranges.pop_front();
+  }
+  if (ranges.empty())
+    head = tail = 0;
+  auto rf = retiredFrame;
+  dedicatedBuffers.erase(std::remove_if(begin(dedicatedBuffers), end(dedicatedBuffers), [rf](const Range& r) { return r.frameNumber <= rf; }), end(dedicatedBuffers));
 }
 
 
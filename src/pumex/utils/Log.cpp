@@ -21,6 +21,7 @@
 //
 
 #include <pumex/utils/Log.h>
+#include <iomanip>
 
 class NullStreamBuffer : public std::streambuf
 {
@@ -85,3 +86,24 @@ default:
   return "UNKNOWN_ERROR";
   }
 }
+
+std::string jsonEscape(const std::string& text)
+{
+  std::ostringstream result;
+  for (auto c : text)
+  {
+    switch (c)
+    {
+    case '"':  result << "\\\""; break;
+    case '\\': result << "\\\\"; break;
+    case '\n': result << "\\n"; break;
+    case '\t': result << "\\t"; break;
+    default:
+      if ((unsigned char)c < 0x20)
+        result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+      else
+        result << c;
+    }
+  }
+  return result.str();
+}
@@ -0,0 +1,144 @@
+//
+// Copyright(c) 2017-2018 Paweł Księżopolski ( pumexx )
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Benchmark of allocation strategies used by DeviceMemoryAllocator. Strategies are called directly - no Vulkan device is created.
+// Random allocations and deallocations are performed on one memory block, then all blocks are released and the strategy must
+// report the whole memory as free again.
+// Usage : pumexallocatorbenchmark [operation count]
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <pumex/DeviceMemoryAllocator.h>
+
+namespace
+{
+
+const VkDeviceSize heapSize      = 1024 * 1024 * 1024;
+const VkDeviceSize maxBlockSize  = 1024 * 1024;
+const size_t       maxLiveBlocks = 4000;
+
+struct BenchmarkResult
+{
+  double   milliseconds      = 0.0;
+  uint32_t failedAllocations = 0;
+  bool     valid             = true;
+};
+
+// live blocks ( realOffset, alignedSize - including alignment padding ) must not overlap and must stay inside the memory.
+// Aligned data must fit inside its block
+bool checkBlocks(std::vector<pumex::DeviceMemoryBlock> blocks)
+{
+  std::sort(begin(blocks), end(blocks), [](const pumex::DeviceMemoryBlock& lhs, const pumex::DeviceMemoryBlock& rhs) { return lhs.realOffset < rhs.realOffset; });
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (blocks[i].realOffset + blocks[i].alignedSize > heapSize)
+      return false;
+    if (blocks[i].alignedOffset < blocks[i].realOffset || blocks[i].alignedOffset + blocks[i].realSize > blocks[i].realOffset + blocks[i].alignedSize)
+      return false;
+    if (i > 0 && blocks[i - 1].realOffset + blocks[i - 1].alignedSize > blocks[i].realOffset)
+      return false;
+  }
+  return true;
+}
+
+BenchmarkResult runBenchmark(pumex::DeviceMemoryAllocator::EnumStrategy strategyType, uint32_t operationCount)
+{
+  BenchmarkResult result;
+  auto strategy = pumex::createAllocationStrategy(strategyType, heapSize);
+
+  // the same sequence of operations for each strategy
+  std::mt19937                                 generator(1234);
+  std::uniform_int_distribution<VkDeviceSize>  sizeDistribution(1, maxBlockSize);
+  std::uniform_int_distribution<uint32_t>      alignmentDistribution(0, 8);
+  std::uniform_int_distribution<uint32_t>      operationDistribution(0, 1);
+  std::vector<pumex::DeviceMemoryBlock>        blocks;
+  blocks.reserve(maxLiveBlocks);
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  for (uint32_t i = 0; i < operationCount; ++i)
+  {
+    bool allocate = blocks.empty() || (blocks.size() < maxLiveBlocks && operationDistribution(generator) == 0);
+    if (allocate)
+    {
+      VkMemoryRequirements memoryRequirements{};
+        memoryRequirements.size      = sizeDistribution(generator);
+        memoryRequirements.alignment = VkDeviceSize(1) << alignmentDistribution(generator);
+      auto block = strategy->allocate(VK_NULL_HANDLE, memoryRequirements);
+      if (block.alignedSize > 0)
+      {
+        result.valid = result.valid && (block.alignedOffset % memoryRequirements.alignment == 0);
+        blocks.push_back(block);
+      }
+      else
+        result.failedAllocations++;
+    }
+    else
+    {
+      std::uniform_int_distribution<size_t> blockDistribution(0, blocks.size() - 1);
+      size_t index = blockDistribution(generator);
+      strategy->deallocate(blocks[index]);
+      blocks[index] = blocks.back();
+      blocks.pop_back();
+    }
+  }
+  result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+  result.valid = result.valid && checkBlocks(blocks);
+  for (auto& block : blocks)
+    strategy->deallocate(block);
+
+  // released memory must be available again
+  std::vector<pumex::FreeBlock> freeBlocks;
+  strategy->getFreeBlocks(freeBlocks);
+  VkDeviceSize freeSize = 0;
+  for (auto& freeBlock : freeBlocks)
+    freeSize += freeBlock.size;
+  result.valid = result.valid && (freeSize == heapSize);
+  return result;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t operationCount = (argc > 1) ? std::stoul(argv[1]) : 1000000;
+  std::vector<std::pair<std::string, pumex::DeviceMemoryAllocator::EnumStrategy>> strategies
+  {
+    { "first fit", pumex::DeviceMemoryAllocator::FIRST_FIT },
+    { "TLSF",      pumex::DeviceMemoryAllocator::TLSF }
+  };
+
+  std::cout << operationCount << " random allocations / deallocations, sizes 1 B - " << maxBlockSize << " B, alignments 1 - 256, up to " << maxLiveBlocks << " live blocks, heap size " << heapSize << " B" << std::endl;
+  int failedCount = 0;
+  for (auto& strategy : strategies)
+  {
+    auto result = runBenchmark(strategy.second, operationCount);
+    std::cout << strategy.first << " : " << result.milliseconds << " ms, failed allocations : " << result.failedAllocations << (result.valid ? "" : ", INVALID MEMORY LAYOUT") << std::endl;
+    if (!result.valid)
+      failedCount++;
+  }
+  return (failedCount == 0) ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+//
+// Copyright(c) 2017-2018 Paweł Księżopolski ( pumexx )
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Tests of the render workflow compiler. Workflows are only compiled - no Vulkan device is created, so these tests may run on machines without GPU.
+// Usage : pumexworkflowtest [test name]. All tests are run when test name is not provided.
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <pumex/Device.h>
+#include <pumex/DeviceMemoryAllocator.h>
+#include <pumex/FrameBuffer.h>
+#include <pumex/RenderPass.h>
+#include <pumex/RenderWorkflow.h>
+
+#define TEST_CHECK(condition) if (!(condition)) { std::cerr << __FILE__ << "(" << __LINE__ << ") : check failed : " #condition << std::endl; return false; }
+
+namespace
+{
+
+std::shared_ptr<pumex::RenderWorkflow> createWorkflow(const std::string& name, const std::vector<pumex::QueueTraits>& queueTraits)
+{
+  auto frameBufferAllocator = std::make_shared<pumex::DeviceMemoryAllocator>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 16 * 1024 * 1024, pumex::DeviceMemoryAllocator::FIRST_FIT);
+  auto workflow             = std::make_shared<pumex::RenderWorkflow>(name, frameBufferAllocator, queueTraits);
+  workflow->addResourceType("surface", false, VK_FORMAT_B8G8R8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, pumex::atSurface, pumex::AttachmentSize{ pumex::AttachmentSize::SurfaceDependent, glm::vec2(1.0f,1.0f) }, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+  workflow->addResourceType("color",   false, VK_FORMAT_R8G8B8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, pumex::atColor,   pumex::AttachmentSize{ pumex::AttachmentSize::SurfaceDependent, glm::vec2(1.0f,1.0f) }, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+  workflow->addResourceType("buffer",  false, pumex::RenderWorkflowResourceType::Buffer);
+  return workflow;
+}
+
+// returns queue index and position of the command performing the operation
+bool findCommand(const pumex::RenderWorkflowResults& results, const std::string& opName, uint32_t& queueIndex, uint32_t& commandIndex)
+{
+  for (uint32_t i = 0; i < results.commands.size(); ++i)
+  {
+    for (uint32_t j = 0; j < results.commands[i].size(); ++j)
+    {
+      if (results.commands[i][j]->operation->name == opName)
+      {
+        queueIndex   = i;
+        commandIndex = j;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<pumex::RenderPass> getRenderPass(const pumex::RenderWorkflowResults& results, uint32_t queueIndex, uint32_t commandIndex)
+{
+  auto subPass = std::dynamic_pointer_cast<pumex::RenderSubPass>(results.commands[queueIndex][commandIndex]);
+  return (subPass != nullptr) ? subPass->renderPass : nullptr;
+}
+
+// follows layout of the image through all commands recorded in one frame. Barriers must always transition the image from its current layout.
+// Rate limited operations are skipped in frames when they are not performed
+bool checkImageLayouts(const pumex::RenderWorkflowResults& results, std::shared_ptr<pumex::MemoryObject> memoryObject, bool rateLimitedPerformed)
+{
+  for (auto& commandSequence : results.commands)
+  {
+    // layout at the beginning of a frame is not known
+    VkImageLayout currentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    auto applyBarriers = [&memoryObject, &currentLayout](const std::map<pumex::MemoryObjectBarrierGroup, std::vector<pumex::MemoryObjectBarrier>>& barrierGroups) -> bool
+    {
+      for (auto& group : barrierGroups)
+      {
+        for (auto& barrier : group.second)
+        {
+          if (barrier.memoryObject != memoryObject)
+            continue;
+          TEST_CHECK(currentLayout == VK_IMAGE_LAYOUT_UNDEFINED || barrier.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED || barrier.oldLayout == currentLayout);
+          currentLayout = barrier.newLayout;
+        }
+      }
+      return true;
+    };
+
+    for (auto& command : commandSequence)
+    {
+      if (command->operation->isRateLimited() && !rateLimitedPerformed)
+        continue;
+      if (!applyBarriers(command->barriersBeforeOp))
+        return false;
+      auto subPass = std::dynamic_pointer_cast<pumex::RenderSubPass>(command);
+      if (subPass != nullptr && subPass->subpassIndex == 0)
+      {
+        for (auto& attachment : subPass->renderPass->attachments)
+        {
+          if (subPass->renderPass->frameBuffer->getMemoryImage(attachment.imageDefinitionIndex) != memoryObject)
+            continue;
+          TEST_CHECK(currentLayout == VK_IMAGE_LAYOUT_UNDEFINED || attachment.initialLayout == VK_IMAGE_LAYOUT_UNDEFINED || attachment.initialLayout == currentLayout);
+          currentLayout = attachment.finalLayout;
+        }
+      }
+      if (!applyBarriers(command->barriersAfterOp))
+        return false;
+    }
+  }
+  return true;
+}
+
+// graphics operation must not be moved in front of the compute operation that generates its input, even when it may share render pass with an operation before it
+bool testRenderPassMergeKeepsDependencies()
+{
+  std::vector<pumex::QueueTraits> queueTraits{ { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, 0, 0.75f } };
+  auto workflow = createWorkflow("merge_dependencies", queueTraits);
+
+  workflow->addRenderOperation("A", pumex::RenderOperation::Graphics);
+  workflow->addAttachmentOutput("A", "color", "color_a", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  workflow->addRenderOperation("C", pumex::RenderOperation::Compute);
+  workflow->addImageInput("C", "color", "color_a", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  workflow->addBufferOutput("C", "buffer", "buf", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  workflow->addRenderOperation("B", pumex::RenderOperation::Graphics);
+  workflow->addBufferInput("B", "buffer", "buf", VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  workflow->addAttachmentOutput("B", "surface", "final", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  workflow->compile(std::make_shared<pumex::SingleQueueWorkflowCompiler>());
+  auto results = workflow->workflowResults;
+  TEST_CHECK(results != nullptr);
+
+  uint32_t queueA, queueB, queueC, commandA, commandB, commandC;
+  TEST_CHECK(findCommand(*results, "A", queueA, commandA));
+  TEST_CHECK(findCommand(*results, "B", queueB, commandB));
+  TEST_CHECK(findCommand(*results, "C", queueC, commandC));
+  TEST_CHECK(queueA == 0 && queueB == 0 && queueC == 0);
+  TEST_CHECK(commandA < commandC);
+  TEST_CHECK(commandC < commandB);
+  TEST_CHECK(getRenderPass(*results, queueA, commandA) != getRenderPass(*results, queueB, commandB));
+  return true;
+}
+
+// image read by rate limited operation and later by operation performed in every frame : barriers of the later operation must be valid
+// in frames when rate limited operation is performed and when it is not
+bool testRateLimitedConsumerLayouts()
+{
+  std::vector<pumex::QueueTraits> queueTraits{ { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, 0, 0.75f } };
+  auto workflow = createWorkflow("rate_limited_consumer", queueTraits);
+
+  workflow->addRenderOperation("P", pumex::RenderOperation::Graphics);
+  workflow->addAttachmentOutput("P", "color", "X", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  workflow->addRenderOperation("R", pumex::RenderOperation::Compute);
+  workflow->setRenderOperationUpdatePeriod("R", 2);
+  workflow->addImageInput("R", "color", "X", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  workflow->addBufferOutput("R", "buffer", "histogram", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  workflow->addRenderOperation("C", pumex::RenderOperation::Graphics);
+  workflow->addImageInput("C", "color", "X", VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  workflow->addBufferInput("C", "buffer", "histogram", VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  workflow->addAttachmentOutput("C", "surface", "final", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  workflow->compile(std::make_shared<pumex::SingleQueueWorkflowCompiler>());
+  auto results = workflow->workflowResults;
+  TEST_CHECK(results != nullptr);
+
+  uint32_t queueR, queueC, commandR, commandC;
+  TEST_CHECK(findCommand(*results, "R", queueR, commandR));
+  TEST_CHECK(findCommand(*results, "C", queueC, commandC));
+  TEST_CHECK(commandR < commandC);
+
+  auto memoryImage = results->registeredMemoryImages.at(results->resourceAlias.at("X"));
+  TEST_CHECK(checkImageLayouts(*results, memoryImage, true));
+  TEST_CHECK(checkImageLayouts(*results, memoryImage, false));
+  return true;
+}
+
+// buffer written again by another operation ( two resources associated with the same memory buffer ) must be synchronized again before next read,
+// even when earlier barrier had the same stages and access masks
+bool testBarrierAfterMemoryRewrite()
+{
+  std::vector<pumex::QueueTraits> queueTraits{ { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, 0, 0.75f } };
+  auto workflow = createWorkflow("memory_rewrite", queueTraits);
+
+  workflow->addRenderOperation("A", pumex::RenderOperation::Compute);
+  workflow->addBufferOutput("A", "buffer", "first", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  workflow->addRenderOperation("B", pumex::RenderOperation::Compute);
+  workflow->addBufferInput("B", "buffer", "first", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  workflow->addBufferOutput("B", "buffer", "link", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  workflow->addRenderOperation("C", pumex::RenderOperation::Compute);
+  workflow->addBufferInput("C", "buffer", "link", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  workflow->addBufferOutput("C", "buffer", "second", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  workflow->addRenderOperation("D", pumex::RenderOperation::Graphics);
+  workflow->addBufferInput("D", "buffer", "second", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  workflow->addAttachmentOutput("D", "surface", "final", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  auto bufferAllocator = std::make_shared<pumex::DeviceMemoryAllocator>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1024 * 1024, pumex::DeviceMemoryAllocator::FIRST_FIT);
+  auto memoryBuffer    = std::make_shared<pumex::Buffer<std::vector<uint32_t>>>(bufferAllocator, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pumex::pbPerDevice, pumex::swOnce);
+  workflow->associateMemoryObject("first", memoryBuffer);
+  workflow->associateMemoryObject("second", memoryBuffer);
+
+  workflow->compile(std::make_shared<pumex::SingleQueueWorkflowCompiler>());
+  auto results = workflow->workflowResults;
+  TEST_CHECK(results != nullptr);
+
+  // D reads memory written by C, so it must have a barrier for that buffer
+  uint32_t queueD, commandD;
+  TEST_CHECK(findCommand(*results, "D", queueD, commandD));
+  bool barrierFound = false;
+  for (auto& group : results->commands[queueD][commandD]->barriersBeforeOp)
+    for (auto& barrier : group.second)
+      barrierFound |= (barrier.memoryObject == memoryBuffer);
+  TEST_CHECK(barrierFound);
+  return true;
+}
+
+// returns barrier for memory object stored in one of the barrier groups
+const pumex::MemoryObjectBarrier* findBarrier(const std::map<pumex::MemoryObjectBarrierGroup, std::vector<pumex::MemoryObjectBarrier>>& barrierGroups, std::shared_ptr<pumex::MemoryObject> memoryObject)
+{
+  for (auto& group : barrierGroups)
+    for (auto& barrier : group.second)
+      if (barrier.memoryObject == memoryObject)
+        return &barrier;
+  return nullptr;
+}
+
+// compute operation goes to async compute queue, graphics queue waits for it and takes ownership of the buffer generated by compute queue
+bool testMultiQueueOwnershipTransfer()
+{
+  std::vector<pumex::QueueTraits> queueTraits{ { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, 0, 0.75f }, { VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, 0.5f } };
+  auto workflow = createWorkflow("multi_queue", queueTraits);
+
+  workflow->addRenderOperation("cull", pumex::RenderOperation::Compute);
+  workflow->addBufferOutput("cull", "buffer", "visible", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  workflow->addRenderOperation("render", pumex::RenderOperation::Graphics);
+  workflow->addBufferInput("render", "buffer", "visible", VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  workflow->addAttachmentOutput("render", "surface", "final", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  auto bufferAllocator = std::make_shared<pumex::DeviceMemoryAllocator>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1024 * 1024, pumex::DeviceMemoryAllocator::FIRST_FIT);
+  auto memoryBuffer    = std::make_shared<pumex::Buffer<std::vector<uint32_t>>>(bufferAllocator, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, pumex::pbPerDevice, pumex::swOnce);
+  workflow->associateMemoryObject("visible", memoryBuffer);
+
+  auto operationQueues = pumex::assignOperationsToQueues(*workflow, 0, 1);
+  TEST_CHECK(operationQueues.at("cull") == 1);
+  TEST_CHECK(operationQueues.at("render") == 0);
+
+  workflow->compile(std::make_shared<pumex::MultiQueueWorkflowCompiler>());
+  auto results = workflow->workflowResults;
+  TEST_CHECK(results != nullptr);
+
+  uint32_t queueCull, queueRender, commandCull, commandRender;
+  TEST_CHECK(findCommand(*results, "cull", queueCull, commandCull));
+  TEST_CHECK(findCommand(*results, "render", queueRender, commandRender));
+  TEST_CHECK(queueCull == 1 && queueRender == 0);
+
+  // compute queue is submitted first and graphics queue waits for it on draw indirect stage
+  TEST_CHECK(results->queueSubmissionOrder == std::vector<uint32_t>({ 1, 0 }));
+  TEST_CHECK(results->queueDependencies[1].empty());
+  auto dependency = results->queueDependencies[0].find(1);
+  TEST_CHECK(dependency != end(results->queueDependencies[0]));
+  TEST_CHECK((dependency->second & VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT) != 0);
+
+  // release barrier after cull and acquire barrier before render describe the same ownership transfer
+  auto releaseBarrier = findBarrier(results->commands[queueCull][commandCull]->barriersAfterOp, memoryBuffer);
+  auto acquireBarrier = findBarrier(results->commands[queueRender][commandRender]->barriersBeforeOp, memoryBuffer);
+  TEST_CHECK(releaseBarrier != nullptr && acquireBarrier != nullptr);
+  TEST_CHECK(releaseBarrier->srcQueueIndex == 1 && releaseBarrier->dstQueueIndex == 0);
+  TEST_CHECK(acquireBarrier->srcQueueIndex == 1 && acquireBarrier->dstQueueIndex == 0);
+  TEST_CHECK(releaseBarrier->srcAccessMask == VK_ACCESS_SHADER_WRITE_BIT && releaseBarrier->dstAccessMask == 0);
+  TEST_CHECK(acquireBarrier->srcAccessMask == 0 && acquireBarrier->dstAccessMask == VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  return true;
+}
+
+// workflow with 121 operations : 40 full size and 40 half size graphics operations, each pair read by compute operation. Compute operations form a chain
+// that ends with the operation rendering to surface. Scheduler must keep all dependencies, group operations with the same attachment size
+// into one render pass and must not take more than a millisecond
+bool testLargeWorkflowScheduling()
+{
+  const uint32_t groupCount = 40;
+  std::vector<pumex::QueueTraits> queueTraits{ { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, 0, 0.75f } };
+  auto workflow = createWorkflow("large_workflow", queueTraits);
+  workflow->addResourceType("half", false, VK_FORMAT_R8G8B8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, pumex::atColor, pumex::AttachmentSize{ pumex::AttachmentSize::SurfaceDependent, glm::vec2(0.5f,0.5f) }, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+  // operations are added in the worst order for render pass grouping
+  for (uint32_t i = 0; i < groupCount; ++i)
+  {
+    std::string index = std::to_string(i);
+    workflow->addRenderOperation("full_" + index, pumex::RenderOperation::Graphics);
+    workflow->addAttachmentOutput("full_" + index, "color", "full_image_" + index, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+    workflow->addRenderOperation("half_" + index, pumex::RenderOperation::Graphics, 0x0, pumex::AttachmentSize{ pumex::AttachmentSize::SurfaceDependent, glm::vec2(0.5f,0.5f) });
+    workflow->addAttachmentOutput("half_" + index, "half", "half_image_" + index, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+    workflow->addRenderOperation("compute_" + index, pumex::RenderOperation::Compute);
+    workflow->addImageInput("compute_" + index, "color", "full_image_" + index, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    workflow->addImageInput("compute_" + index, "half", "half_image_" + index, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if (i > 0)
+      workflow->addBufferInput("compute_" + index, "buffer", "result_" + std::to_string(i - 1), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    workflow->addBufferOutput("compute_" + index, "buffer", "result_" + index, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+  }
+  workflow->addRenderOperation("final", pumex::RenderOperation::Graphics);
+  workflow->addBufferInput("final", "buffer", "result_" + std::to_string(groupCount - 1), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  workflow->addAttachmentOutput("final", "surface", "final", VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, pumex::loadOpClear(glm::vec4(0.0f)));
+
+  // best time of a few runs, so that the test does not fail when the machine is busy for a moment. Unoptimized builds are several times slower
+#ifdef NDEBUG
+  const double maxSchedulingTime = 1.0;
+#else
+  const double maxSchedulingTime = 10.0;
+#endif
+  pumex::StandardRenderWorkflowCostCalculator costCalculator;
+  costCalculator.tagOperationByAttachmentType(*workflow);
+  double bestTime = std::numeric_limits<double>::max();
+  std::vector<std::shared_ptr<pumex::RenderOperation>> schedule;
+  for (uint32_t i = 0; i < 10; ++i)
+  {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    schedule = pumex::scheduleOperations(*workflow, costCalculator);
+    bestTime = std::min(bestTime, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
+  }
+  TEST_CHECK(schedule.size() == 3 * groupCount + 1);
+  TEST_CHECK(bestTime < maxSchedulingTime);
+
+  workflow->compile(std::make_shared<pumex::SingleQueueWorkflowCompiler>());
+  auto results = workflow->workflowResults;
+  TEST_CHECK(results != nullptr);
+
+  uint32_t queueFinal, commandFinal;
+  TEST_CHECK(findCommand(*results, "final", queueFinal, commandFinal));
+  auto fullRenderPass  = std::shared_ptr<pumex::RenderPass>();
+  auto halfRenderPass  = std::shared_ptr<pumex::RenderPass>();
+  uint32_t previousCompute = 0;
+  for (uint32_t i = 0; i < groupCount; ++i)
+  {
+    std::string index = std::to_string(i);
+    uint32_t queueFull, queueHalf, queueCompute, commandFull, commandHalf, commandCompute;
+    TEST_CHECK(findCommand(*results, "full_" + index, queueFull, commandFull));
+    TEST_CHECK(findCommand(*results, "half_" + index, queueHalf, commandHalf));
+    TEST_CHECK(findCommand(*results, "compute_" + index, queueCompute, commandCompute));
+    TEST_CHECK(queueFull == 0 && queueHalf == 0 && queueCompute == 0);
+    TEST_CHECK(commandFull < commandCompute && commandHalf < commandCompute);
+    TEST_CHECK(i == 0 || previousCompute < commandCompute);
+    TEST_CHECK(commandCompute < commandFinal);
+    previousCompute = commandCompute;
+
+    // operations with the same attachment size are subpasses of one render pass
+    auto full = getRenderPass(*results, queueFull, commandFull);
+    auto half = getRenderPass(*results, queueHalf, commandHalf);
+    TEST_CHECK(full != nullptr && half != nullptr);
+    TEST_CHECK(fullRenderPass == nullptr || fullRenderPass == full);
+    TEST_CHECK(halfRenderPass == nullptr || halfRenderPass == half);
+    fullRenderPass = full;
+    halfRenderPass = half;
+  }
+  TEST_CHECK(fullRenderPass != halfRenderPass);
+  TEST_CHECK(fullRenderPass->subPasses.size() == groupCount && halfRenderPass->subPasses.size() == groupCount);
+  TEST_CHECK(getRenderPass(*results, queueFinal, commandFinal) != fullRenderPass);
+  return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  std::vector<std::pair<std::string, std::function<bool()>>> tests
+  {
+    { "renderPassMergeKeepsDependencies", testRenderPassMergeKeepsDependencies },
+    { "rateLimitedConsumerLayouts",       testRateLimitedConsumerLayouts },
+    { "barrierAfterMemoryRewrite",        testBarrierAfterMemoryRewrite },
+    { "multiQueueOwnershipTransfer",      testMultiQueueOwnershipTransfer },
+    { "largeWorkflowScheduling",          testLargeWorkflowScheduling }
+  };
+
+  std::string testName = (argc > 1) ? argv[1] : "";
+  int failedCount = 0, runCount = 0;
+  for (auto& test : tests)
+  {
+    if (!testName.empty() && test.first != testName)
+      continue;
+    bool result;
+    try
+    {
+      result = test.second();
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << test.first << " : exception caught : " << e.what() << std::endl;
+      result = false;
+    }
+    std::cout << test.first << " : " << (result ? "passed" : "FAILED") << std::endl;
+    runCount++;
+    if (!result)
+      failedCount++;
+  }
+  if (runCount == 0)
+  {
+    std::cerr << "Unknown test : " << testName << std::endl;
+    return 1;
+  }
+  return (failedCount == 0) ? 0 : 1;
+}